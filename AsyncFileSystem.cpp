@@ -0,0 +1,240 @@
+#include "AsyncFileSystem.hpp"
+#include <utility>
+using namespace std;
+
+///////////////////////////////////////////////////
+// Task
+///////////////////////////////////////////////////
+
+/**
+ * @brief constructor, used by the promise
+ * @param handle - the coroutine the task owns
+*/
+Task::Task(coroutine_handle<promise_type> handle) {
+    this->handle = handle;
+}
+
+/**
+ * @brief move constructor
+*/
+Task::Task(Task &&other) noexcept {
+    handle = exchange(other.handle, nullptr);
+}
+
+/**
+ * @brief move assignment
+*/
+Task &Task::operator=(Task &&other) noexcept {
+    if (this != &other) {
+        if (handle) {
+            handle.destroy();
+        }
+        handle = exchange(other.handle, nullptr);
+    }
+    return *this;
+}
+
+/**
+ * @brief destructor, a task that was never spawned is destroyed without running
+*/
+Task::~Task() {
+    if (handle) {
+        handle.destroy();
+    }
+}
+
+/**
+ * @brief give up ownership of the coroutine
+ * @return coroutine_handle<> - the coroutine, the caller has to destroy it
+*/
+coroutine_handle<> Task::release() {
+    return exchange(handle, nullptr);
+}
+
+///////////////////////////////////////////////////
+// Executor
+///////////////////////////////////////////////////
+
+/**
+ * @brief default constructor
+*/
+Executor::Executor() {
+    pending = 0;
+}
+
+/**
+ * @brief destructor, destroys coroutines that were spawned but never run to the end
+*/
+Executor::~Executor() {
+    for (coroutine_handle<> task : tasks) {
+        task.destroy();
+    }
+}
+
+/**
+ * @brief take ownership of a coroutine and queue it to start
+ * @param task - the coroutine
+*/
+void Executor::spawn(Task task) {
+    coroutine_handle<> handle = task.release();
+    lock_guard<mutex> guard(lock);
+    tasks.push_back(handle);
+    ready.push_back(handle);
+}
+
+/**
+ * @brief count an operation that was handed to another thread, run doesn't return while it is in flight
+*/
+void Executor::submitted() {
+    lock_guard<mutex> guard(lock);
+    pending++;
+}
+
+/**
+ * @brief queue the coroutine of an operation that finished so run resumes it
+ * @param handle - the coroutine waiting on the operation
+*/
+void Executor::complete(coroutine_handle<> handle) {
+    lock_guard<mutex> guard(lock);
+    pending--;
+    ready.push_back(handle);
+    wake.notify_one();
+}
+
+/**
+ * @brief resume coroutines as they become ready, sleeping while every one of them is waiting on an operation
+ * returns once nothing is ready and nothing is in flight, which is when every spawned coroutine has finished
+*/
+void Executor::run() {
+    while (true) {
+        coroutine_handle<> next;
+        {
+            unique_lock<mutex> guard(lock);
+            wake.wait(guard, [this]() { return !ready.empty() || pending == 0; });
+            if (ready.empty()) {
+                break;
+            }
+            next = ready.front();
+            ready.pop_front();
+        }
+        next.resume();
+    }
+    for (coroutine_handle<> task : tasks) {
+        task.destroy();
+    }
+    tasks.clear();
+}
+
+///////////////////////////////////////////////////
+// Operations
+///////////////////////////////////////////////////
+
+/**
+ * @brief constructor
+ * @param fs - the file system that runs the operation
+ * @param work - the blocking call that does the operation
+*/
+IoOperation::IoOperation(AsyncFileSystem &fs, function<FsError()> work) : fs(fs), work(move(work)) {
+    result = FS_OK;
+}
+
+/**
+ * @brief queue the operation, the coroutine is resumed by the executor once it has run
+ * @param handle - the awaiting coroutine
+*/
+void IoOperation::await_suspend(coroutine_handle<> handle) {
+    fs.submit(this, handle);
+}
+
+///////////////////////////////////////////////////
+// Async File System
+///////////////////////////////////////////////////
+
+/**
+ * @brief constructor, starts the I/O threads
+ * @param fs - the file system the operations run on, its disk should already be mounted
+ * @param executor - the executor the awaiting coroutines run on
+ * @param ioThreads - the number of operations that can be running at once
+*/
+AsyncFileSystem::AsyncFileSystem(FileSystem &fs, Executor &executor, size_t ioThreads) : fs(fs), executor(executor) {
+    stopping = false;
+    for (size_t i = 0; i < ioThreads; i++) {
+        threads.emplace_back(&AsyncFileSystem::ioLoop, this);
+    }
+}
+
+/**
+ * @brief destructor, runs any queued operations and stops the I/O threads
+*/
+AsyncFileSystem::~AsyncFileSystem() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (thread &t : threads) {
+        t.join();
+    }
+}
+
+/**
+ * @brief queue an operation for an I/O thread
+ * @param operation - the operation, it lives in the awaiting coroutine's frame until it is resumed
+ * @param handle - the awaiting coroutine
+*/
+void AsyncFileSystem::submit(IoOperation *operation, coroutine_handle<> handle) {
+    executor.submitted();
+    {
+        lock_guard<mutex> guard(lock);
+        submissions.push_back({operation, handle});
+    }
+    wake.notify_one();
+}
+
+/**
+ * @brief run queued operations, the file system's own locking lets reads run at the same time
+*/
+void AsyncFileSystem::ioLoop() {
+    while (true) {
+        Request request;
+        {
+            unique_lock<mutex> guard(lock);
+            wake.wait(guard, [this]() { return stopping || !submissions.empty(); });
+            if (submissions.empty()) {
+                return;
+            }
+            request = submissions.front();
+            submissions.pop_front();
+        }
+        request.operation->result = request.operation->work();
+        executor.complete(request.handle);
+    }
+}
+
+/**
+ * @brief read a block of a file without blocking the calling coroutine's thread
+ * @param session - the session of the awaiting task
+ * @param name - the name of the file in the session's working directory
+ * @param block - the index of the block within the file
+ * @param data - where the block goes, it has to stay valid until the operation completes
+ * @return IoOperation - awaiting it gives the error of the read
+*/
+IoOperation AsyncFileSystem::read(Session &session, const string &name, int block, span<uint8_t> data) {
+    return IoOperation(*this, [this, &session, name, block, data]() {
+        return fs.read(session, name, block, data);
+    });
+}
+
+/**
+ * @brief write a block of a file without blocking the calling coroutine's thread
+ * @param session - the session of the awaiting task
+ * @param name - the name of the file in the session's working directory
+ * @param block - the index of the block within the file
+ * @param data - the contents of the block, it has to stay valid until the operation completes
+ * @return IoOperation - awaiting it gives the error of the write
+*/
+IoOperation AsyncFileSystem::write(Session &session, const string &name, int block, span<const uint8_t> data) {
+    return IoOperation(*this, [this, &session, name, block, data]() {
+        return fs.write(session, name, block, data);
+    });
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FileSystem.hpp"
+#include "Session.hpp"
+using namespace std;
+
+/**
+ * a coroutine run by an executor, it starts suspended and is started by spawning it
+*/
+class Task {
+    public:
+        struct promise_type {
+            Task get_return_object() { return Task(coroutine_handle<promise_type>::from_promise(*this)); }
+            suspend_always initial_suspend() noexcept { return {}; }
+            suspend_always final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { terminate(); }
+        };
+        Task(Task &&other) noexcept;                    // move constructor
+        Task &operator=(Task &&other) noexcept;         // move assignment
+        Task(const Task&) = delete;
+        Task &operator=(const Task&) = delete;
+        ~Task();                                        // destroys the coroutine if it is still owned
+        coroutine_handle<> release();                   // give up ownership of the coroutine
+    private:
+        coroutine_handle<promise_type> handle;          // the coroutine
+        explicit Task(coroutine_handle<promise_type> handle);
+};
+
+/**
+ * a single threaded executor, coroutines only ever run on the thread that calls run and are resumed
+ * from its queue when the block operation they are waiting on completes
+*/
+class Executor {
+    private:
+        mutex lock;                                     // guards the queue and the pending count
+        condition_variable wake;                        // signalled when a coroutine becomes ready
+        deque<coroutine_handle<>> ready;                // coroutines waiting to be resumed
+        vector<coroutine_handle<>> tasks;               // every spawned coroutine, destroyed when run returns
+        size_t pending;                                 // operations submitted that haven't completed
+    public:
+        Executor();                                     // default constructor
+        ~Executor();                                    // destroys the spawned coroutines
+        Executor(const Executor&) = delete;
+        Executor &operator=(const Executor&) = delete;
+        void spawn(Task task);                          // start a coroutine the next time run goes through the queue
+        void submitted();                               // an operation was handed to another thread
+        void complete(coroutine_handle<> handle);       // an operation finished, resume its coroutine, safe from any thread
+        void run();                                     // run coroutines until all of them are finished
+};
+
+class AsyncFileSystem;
+
+/**
+ * a block operation that can be awaited, the result of co_await is the operation's error
+*/
+class IoOperation {
+    private:
+        AsyncFileSystem &fs;                            // the file system that runs the operation
+        function<FsError()> work;                       // the blocking call
+        FsError result;                                 // set once the operation has run
+        friend class AsyncFileSystem;
+    public:
+        IoOperation(AsyncFileSystem &fs, function<FsError()> work);
+        bool await_ready() { return false; }
+        void await_suspend(coroutine_handle<> handle);  // queue the operation
+        FsError await_resume() { return result; }
+};
+
+/**
+ * an awaitable interface to the block operations of a file system, operations are queued and run by
+ * a few I/O threads which put the waiting coroutine back on the executor's queue when they complete,
+ * so one thread can have many operations in flight
+ * a session may only have one operation in flight at a time, so each task should use its own session
+*/
+class AsyncFileSystem {
+    private:
+        struct Request {
+            IoOperation *operation;                     // the operation to run
+            coroutine_handle<> handle;                  // the coroutine waiting on it
+        };
+        FileSystem &fs;                                 // the file system the operations run on
+        Executor &executor;                             // where completed operations are resumed
+        mutex lock;                                     // guards the submission queue
+        condition_variable wake;                        // signalled when a request is queued or on shutdown
+        deque<Request> submissions;                     // operations waiting for an I/O thread
+        bool stopping;                                  // set when the I/O threads should exit
+        vector<thread> threads;                         // the I/O threads
+        void ioLoop();                                  // run queued operations until stopped
+    public:
+        AsyncFileSystem(FileSystem &fs, Executor &executor, size_t ioThreads = ASYNC_IO_THREADS);
+        ~AsyncFileSystem();                             // finishes queued operations and stops the I/O threads
+        AsyncFileSystem(const AsyncFileSystem&) = delete;
+        AsyncFileSystem &operator=(const AsyncFileSystem&) = delete;
+        void submit(IoOperation *operation, coroutine_handle<> handle);     // queue an operation
+        IoOperation read(Session &session, const string &name, int block, span<uint8_t> data);           // read a block of a file
+        IoOperation write(Session &session, const string &name, int block, span<const uint8_t> data);    // write a block of a file
+};
@@ -1,24 +1,30 @@
 #include "CommandParser.hpp"
-#include <sstream>
-#include <algorithm>
-#include <iostream>
-#include <stdexcept>
-#include "Constants.hpp"
+#include "Encoding.hpp"
+#include <charconv>
+#include <cctype>
 using namespace std;
 
 /**
  * @brief default constructor
 */
-CommandParser::CommandParser() {}
+CommandParser::CommandParser() {
+    numTokens = 0;
+    command = Command();
+}
 
 /**
- * @brief parse a command string into a vector of tokens
+ * @brief parse a command string into tokens, nothing is copied or allocated
  * @param commandString - the original whole string of the command
- * @return vector<string> - a vector of the tokenized command
+ * @return Command - the command with its letter filled in, the arguments are filled in by validate()
 */
-vector<string> CommandParser::parse(const string &commandString) {
+const Command &CommandParser::parse(string_view commandString) {
     tokenize(commandString);
-    return commandTokens;
+    command = Command();
+    command.op = NO_COMMAND;
+    if (commandTokens[0].length() == 1) {
+        command.op = commandTokens[0][0];
+    }
+    return command;
 }
 
 /**
@@ -26,14 +32,35 @@ vector<string> CommandParser::parse(const string &commandString) {
  * @return bool - true if the command is valid
 */
 bool CommandParser::validate() {
-    string command = commandTokens[0];
-    // try and find the command name in the commandMap (SEE Constants.h)
-    if (commandMap.find(command) == commandMap.end()) {
-        return false;
-    } else {
-        // run the command specific check
-        FunctionPointer p = commandMap[command];
-        return (this->*p)();
+    // run the command specific check
+    switch (command.op) {
+        case MOUNT:
+            return checkMount();
+        case CREATE:
+            return validCreateOp();
+        case READ:
+        case WRITE:
+            return validReadWrite();
+        case RESIZE:
+            return validFileOp();
+        case BUFFER:
+            return validBuffOp();
+        case BUFFER_FILE:
+            return validBufferFileOp();
+        case BUFFER_DATA:
+            return validBufferDataOp();
+        case LS:
+        case DEFRAG:
+        case STATS:
+        case BLOCK_MAP:
+        case SNAPSHOT:
+        case ROLLBACK:
+            return validNoArgOp();
+        case CD:
+        case DELETE:
+            return validOneArgOp();
+        default:
+            return false;
     }
 }
 
@@ -46,8 +73,8 @@ bool CommandParser::validate() {
  * @return bool true if the command is valid
 */
 bool CommandParser::checkMount() {
-    commandTokens[1].erase(remove_if(commandTokens[1].begin(), commandTokens[1].end(), ::isspace), commandTokens[1].end());
-    if (commandTokens.size() == ONE_ARG_COMMAND) {
+    if (numTokens == ONE_ARG_COMMAND) {
+        command.name = commandTokens[1];
         return true;
     }
     return false;
@@ -58,7 +85,8 @@ bool CommandParser::checkMount() {
  * @return bool true if the command is valid
 */
 bool CommandParser::validReadWrite() {
-    if (commandTokens.size() == TWO_ARG_COMMAND && !nameTooLong(commandTokens[1]) && validFileSize(commandTokens[2])) {
+    if (numTokens == TWO_ARG_COMMAND && !nameTooLong(commandTokens[1]) && validFileSize(commandTokens[2])) {
+        command.name = commandTokens[1];
         return true;
     }
     return false;
@@ -69,8 +97,8 @@ bool CommandParser::validReadWrite() {
  * @return bool true if the command is valid
 */
 bool CommandParser::validFileOp() {
-    commandTokens[1].erase(remove_if(commandTokens[1].begin(), commandTokens[1].end(), ::isspace), commandTokens[1].end());
-    if (commandTokens.size() == TWO_ARG_COMMAND && (!nameTooLong(commandTokens[1])) && blockNumInRange(commandTokens[2])) {
+    if (numTokens == TWO_ARG_COMMAND && (!nameTooLong(commandTokens[1])) && blockNumInRange(commandTokens[2])) {
+        command.name = commandTokens[1];
         return true;
     }
     return false;
@@ -81,18 +109,59 @@ bool CommandParser::validFileOp() {
  * @return bool true if the command is valid
 */
 bool CommandParser::validBuffOp() {
-    if (commandTokens.size() == ONE_ARG_COMMAND && commandTokens[1].length() <= MAX_BUFF_LEN && commandTokens[1].length() > 0) {
+    if (numTokens == ONE_ARG_COMMAND && commandTokens[1].length() <= MAX_BUFF_LEN && commandTokens[1].length() > 0) {
+        command.name = commandTokens[1];
         return true;
     }
     return false;
 }
 
+/**
+ * @brief validate a command that loads the buffer from a host file, "F <file> <offset> <blocks>"
+ * @return bool true if the command is valid
+*/
+bool CommandParser::validBufferFileOp() {
+    if (numTokens != THREE_ARG_COMMAND || !parseOffset(commandTokens[2], command.offset)) {
+        return false;
+    }
+    int blocks = 0;
+    if (!parseNumber(commandTokens[3], blocks) || blocks < 1 || (size_t)blocks > MAX_BUFFER_BLOCKS) {
+        return false;
+    }
+    command.name = commandTokens[1];
+    command.number = blocks;
+    return true;
+}
+
+/**
+ * @brief validate a command that loads the buffer from inline data, "X hex <digits>" or "X base64 <data>"
+ * @return bool true if the command is valid
+*/
+bool CommandParser::validBufferDataOp() {
+    if (numTokens != TWO_ARG_COMMAND) {
+        return false;
+    }
+    if (commandTokens[1] == HEX_STRING) {
+        command.number = ENCODING_HEX;
+    } else if (commandTokens[1] == BASE64_STRING) {
+        command.number = ENCODING_BASE64;
+    } else {
+        return false;
+    }
+    size_t length = 0;
+    if (!decodedLength(commandTokens[2], command.number, length) || length == 0 || length > MAX_BUFFER_BLOCKS * BLOCK_SIZE) {
+        return false;
+    }
+    command.name = commandTokens[2];
+    return true;
+}
+
 /**
  * @brief used for LS and Defrag commands
  * @return bool true if the command is valid
 */
 bool CommandParser::validNoArgOp() {
-    if (commandTokens.size() == NO_ARG_COMMAND) {
+    if (numTokens == NO_ARG_COMMAND) {
         return true;
     }
     return false;
@@ -103,8 +172,8 @@ bool CommandParser::validNoArgOp() {
  * @return bool true if the command is valid
 */
 bool CommandParser::validOneArgOp() {
-    commandTokens[1].erase(remove_if(commandTokens[1].begin(), commandTokens[1].end(), ::isspace), commandTokens[1].end());
-    if (commandTokens.size() == ONE_ARG_COMMAND && !nameTooLong(commandTokens[1])) {
+    if (numTokens == ONE_ARG_COMMAND && !nameTooLong(commandTokens[1])) {
+        command.name = commandTokens[1];
         return true;
     }
     return false;
@@ -115,8 +184,8 @@ bool CommandParser::validOneArgOp() {
  * @return bool true if the command is valid
 */
 bool CommandParser::validCreateOp() {
-    commandTokens[1].erase(remove_if(commandTokens[1].begin(), commandTokens[1].end(), ::isspace), commandTokens[1].end());
-    if (commandTokens.size() == TWO_ARG_COMMAND && (!nameTooLong(commandTokens[1])) && validCreateSize(commandTokens[2])) {
+    if (numTokens == TWO_ARG_COMMAND && (!nameTooLong(commandTokens[1])) && validCreateSize(commandTokens[2])) {
+        command.name = commandTokens[1];
         return true;
     }
     return false;
@@ -130,44 +199,105 @@ bool CommandParser::validCreateOp() {
 
 /**
  * @brief tokenizes a command and removes spaces
+ * this splits the string the same way reading it token by token from a stringstream did,
+ * including that trailing whitespace repeats the last token, so the same commands are rejected
 */
-void CommandParser::tokenize(const string &commandString) {
-    commandTokens.clear();
-    stringstream ss(commandString);
-    string token;
-    while (ss.good()) {
-        ss >> token;
-        commandTokens.push_back(token);
-        if (token == BUFFER) {
-            getline(ss, token);
-            if (token != commandTokens[0]) {
-                commandTokens.push_back(token);
+void CommandParser::tokenize(string_view commandString) {
+    numTokens = 0;
+    for (size_t i = 0; i < MAX_TOKENS; i++) {
+        commandTokens[i] = string_view();
+    }
+    string_view token;
+    size_t pos = 0;
+    size_t len = commandString.length();
+    do {
+        while (pos < len && isspace((unsigned char)commandString[pos])) {
+            pos++;
+        }
+        if (pos == len) {
+            // nothing left to read, the previous token gets added again
+            addToken(token);
+            break;
+        }
+        size_t start = pos;
+        while (pos < len && !isspace((unsigned char)commandString[pos])) {
+            pos++;
+        }
+        token = commandString.substr(start, pos - start);
+        addToken(token);
+        if (token.length() == 1 && token[0] == BUFFER) {
+            // the rest of the line is the buffer contents
+            if (pos < len) {
+                addToken(commandString.substr(pos));
+            } else if (token != commandTokens[0]) {
+                addToken(token);
             }
             break;
         }
+    } while (pos < len);
+}
+
+/**
+ * @brief add a token to the current command, only the first few are kept since no command uses more
+*/
+void CommandParser::addToken(string_view token) {
+    if (numTokens < MAX_TOKENS) {
+        commandTokens[numTokens] = token;
     }
+    numTokens++;
 }
 
 /**
  * @brief checks if a given string name is longer than the limit of 5 characters
  * @return bool - true if the string is no more than 5 characters
 */
-bool CommandParser::nameTooLong(const string &name) {
+bool CommandParser::nameTooLong(string_view name) {
     return name.length() > MAX_NAME_LEN;
 }
 
+/**
+ * @brief read the integer at the start of a token, anything after the digits is ignored
+ * @param token - the token to read
+ * @param value - set to the number that was read
+ * @return bool - false if the token doesn't start with a number or it doesn't fit in an int
+*/
+bool CommandParser::parseNumber(string_view token, int &value) {
+    size_t pos = 0;
+    while (pos < token.length() && isspace((unsigned char)token[pos])) {
+        pos++;
+    }
+    // from_chars doesn't accept a leading plus sign
+    if (pos < token.length() && token[pos] == '+' && pos + 1 < token.length() && token[pos + 1] != '-') {
+        pos++;
+    }
+    const char *end = token.data() + token.length();
+    from_chars_result result = from_chars(token.data() + pos, end, value);
+    return result.ec == errc();
+}
+
+/**
+ * @brief read a byte offset into a host file, the whole token has to be a number that isn't negative
+ * @param token - the token to read
+ * @param offset - set to the offset that was read
+ * @return bool - false if the token isn't a valid offset
+*/
+bool CommandParser::parseOffset(string_view token, long &offset) {
+    const char *end = token.data() + token.length();
+    from_chars_result result = from_chars(token.data(), end, offset);
+    return result.ec == errc() && result.ptr == end && offset >= 0;
+}
+
 /**
  * @brief check if a given block number is within the valid range
  * @return bool - true is the block number is valid
 */
-bool CommandParser::blockNumInRange(const string &blockNum) {
-    size_t block = 0;
-    try {
-        block = stoi(blockNum);
-    } catch (const invalid_argument&) {
+bool CommandParser::blockNumInRange(string_view blockNum) {
+    int block = 0;
+    if (!parseNumber(blockNum, block)) {
         return false;
     }
-    if (block >= MIN_BLOCK_NUM && block <= MAX_BLOCK_NUM) {
+    if (block >= (int)MIN_BLOCK_NUM && block <= (int)MAX_BLOCK_NUM) {
+        command.number = block;
         return true;
     }
     return false;
@@ -177,14 +307,13 @@ bool CommandParser::blockNumInRange(const string &blockNum) {
  * @brief checks if a given file size is valid
  * @return bool - true if the file size is valid
 */
-bool CommandParser::validFileSize(const string &fileSize) {
+bool CommandParser::validFileSize(string_view fileSize) {
     int size = 0;
-    try {
-        size = stoi(fileSize);
-    } catch(const invalid_argument&) {
+    if (!parseNumber(fileSize, size)) {
         return false;
     }
     if (size > -1 && (size_t)size <= MAX_BLOCK_NUM) {
+        command.number = size;
         return true;
     }
     return false;
@@ -194,14 +323,13 @@ bool CommandParser::validFileSize(const string &fileSize) {
  * @brief checks if the size of new file is valid
  * @return bool - true if the file size is valid
 */
-bool CommandParser::validCreateSize(const string &size) {
+bool CommandParser::validCreateSize(string_view size) {
     int intSize = 0;
-    try {
-        intSize = stoi(size);
-    } catch(const invalid_argument&) {
+    if (!parseNumber(size, intSize)) {
         return false;
     }
     if (intSize >= 0 && intSize <= 126) {
+        command.number = intSize;
         return true;
     }
     return false;
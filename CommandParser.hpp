@@ -1,26 +1,44 @@
 #pragma once
 
-#include <vector>
 #include <string>
+#include <string_view>
+#include "Constants.hpp"
 using namespace std;
 
+/**
+ * a parsed command, the views point into the command string so it is only valid as long as that string is
+*/
+struct Command {
+    char op;                // the command letter, NO_COMMAND if it isn't a known command
+    string_view name;       // the file/dir/disk name, the buffer contents for a buffer command, or the host file or data to load the buffer from
+    int number;             // the size or block number argument, the number of blocks to load or the encoding of the data
+    long offset;            // the byte offset in the host file to load the buffer from
+};
+
 class CommandParser {
     private:
-        vector<string> commandTokens;                       // vector of tokens for the current command being parsed
-        bool nameTooLong(const string &name);               // checks if a filename is longer than 5 characters
-        void tokenize(const string &commandString);         // tokenize the initial command string
-        bool blockNumInRange(const string &blockNum);       // checks if a block number is valid
-        bool validFileSize(const string &fileSize);         // checks if a file size is valid
-        bool validCreateSize(const string &size);           // checks if the size of a create file command is valid
+        string_view commandTokens[MAX_TOKENS];                  // the first tokens of the current command being parsed
+        size_t numTokens;                                       // the total number of tokens in the current command
+        Command command;                                        // the command being parsed
+        void addToken(string_view token);                       // add a token to the current command
+        bool nameTooLong(string_view name);                     // checks if a filename is longer than 5 characters
+        void tokenize(string_view commandString);               // tokenize the initial command string
+        bool parseNumber(string_view token, int &value);        // read the integer at the start of a token
+        bool blockNumInRange(string_view blockNum);             // checks if a block number is valid
+        bool validFileSize(string_view fileSize);               // checks if a file size is valid
+        bool validCreateSize(string_view size);                 // checks if the size of a create file command is valid
+        bool parseOffset(string_view token, long &offset);      // read a host file offset
     public:
-        bool checkMount();                                  // return true if commandTokens represents a valid mount command
-        bool validReadWrite();                              // return true if valid read/write command
-        bool validFileOp();                                 // retrun true if valid file operation
-        bool validBuffOp();                                 // return true if valid buffer operation
-        bool validNoArgOp();                                // return true if valid no arg operation
-        bool validOneArgOp();                               // return true if valid one arg operation
-        bool validCreateOp();                               // retun true if valid create operation
-        bool validate();                                    // return true if command is valid
-        CommandParser();                                    // default constructor
-        vector<string> parse(const string &commandString);  // parse a command string
-};
\ No newline at end of file
+        bool checkMount();                                      // return true if commandTokens represents a valid mount command
+        bool validReadWrite();                                  // return true if valid read/write command
+        bool validFileOp();                                     // retrun true if valid file operation
+        bool validBuffOp();                                     // return true if valid buffer operation
+        bool validBufferFileOp();                               // return true if valid load from a host file
+        bool validBufferDataOp();                               // return true if valid load from hex or base64 data
+        bool validNoArgOp();                                    // return true if valid no arg operation
+        bool validOneArgOp();                                   // return true if valid one arg operation
+        bool validCreateOp();                                   // retun true if valid create operation
+        bool validate();                                        // return true if command is valid
+        CommandParser();                                        // default constructor
+        const Command &parse(string_view commandString);        // parse a command string
+};
@@ -0,0 +1,321 @@
+#include "CommandRunner.hpp"
+#include "Encoding.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+/**
+ * @brief add a line for a directory to a listing
+ * @param out - the listing
+ * @param entry - the directory, its size is the number of entries in it
+*/
+static void formatDir(string &out, const DirEntry &entry) {
+    // using printf style formatting so its easier to get the formating right
+    char line[32];
+    int len = snprintf(line, sizeof(line), "%-5s %3d\n", entry.name.c_str(), entry.size);
+    out.append(line, len);
+}
+
+/**
+ * @brief add a line for a file to a listing
+ * @param out - the listing
+ * @param entry - the file, its size is in blocks
+*/
+static void formatFile(string &out, const DirEntry &entry) {
+    char line[32];
+    int len = snprintf(line, sizeof(line), "%-5s %3d KB\n", entry.name.c_str(), entry.size);
+    out.append(line, len);
+}
+
+/**
+ * @brief the number of blocks in a session's buffer
+*/
+static int bufferBlocks(Session &session) {
+    return session.buffer.size() / BLOCK_SIZE;
+}
+
+/**
+ * @brief print the error of a command that failed
+ * the messages are the ones the commands have always printed, so they depend on which command failed
+ * @param session - the session that ran the command, errors go to its error stream
+ * @param command - the command that failed
+ * @param error - what went wrong
+*/
+static void printError(Session &session, const Command &command, FsError error) {
+    ostream &err = *session.err;
+    switch (error) {
+        case FS_NOT_MOUNTED:
+            err << "Error: No file system is mounted" << endl;
+            break;
+        case FS_DISK_NOT_FOUND:
+            err << "Error: Cannot find disk: " << command.name << endl;
+            break;
+        case FS_NO_FREE_NODE:
+            err << "Error: Superblock in disk " << session.diskName << " is full, cannot create " << command.name << endl;
+            break;
+        case FS_NAME_EXISTS:
+            err << "Error: File or directory " << command.name << " already exists" << endl;
+            break;
+        case FS_NO_SPACE:
+            if (command.op == CREATE) {
+                err << "Error: cannot allocate " << command.number << " on " << session.diskName << endl;
+            } else {
+                err << "Error: File " << command.name << " cannot be expanded to size " << command.number << endl;
+            }
+            break;
+        case FS_NO_SUCH_BLOCK:
+            if (command.op == WRITE || command.op == WRITE_REPEAT) {
+                // a buffer of many blocks is written to a range, the last block of it is the one that is missing
+                err << "Error: " << command.name << " does not have block " << command.number + bufferBlocks(session) - 1 << endl;
+            } else {
+                err << "Error: " << command.name << " does not have block " << command.number << endl;
+            }
+            break;
+        case FS_NOT_FOUND:
+            if (command.op == DELETE) {
+                err << "Error: File or directory " << command.name << " does not exist" << endl;
+            } else if (command.op == READ) {
+                err << "Error: File" << command.name << " does not exist" << endl;
+            } else if (command.op == CD) {
+                err << "Error: Directory " << command.name << " does not exist" << endl;
+            } else {
+                err << "Error: " << command.name << " does not exist" << endl;
+            }
+            break;
+        case FS_INVALID_ARGUMENT:
+            err << "Error: invalid argument: " << command.name << endl;
+            break;
+        case FS_NO_SNAPSHOT:
+            err << "Error: Disk " << session.diskName << " has no snapshot to roll back to" << endl;
+            break;
+        case FS_SNAPSHOT_FAILED:
+            err << "Error: Cannot create a snapshot of disk " << session.diskName << endl;
+            break;
+        case FS_IO_ERROR:
+            err << "Error: I/O error on disk " << session.diskName << endl;
+            break;
+        default:
+            // the inconsistent disk error has always gone to the normal output
+            if (isConsistencyError(error)) {
+                *session.out << "Error: File system in " << command.name << " is inconsistent (error code: " << consistencyCode(error) << ")" << endl;
+            }
+            break;
+    }
+}
+
+/**
+ * @brief list the session's working directory and print it
+ * the listing is kept so an unchanged directory can be printed again without listing it again
+*/
+static FsError listDirectory(FileSystem &fs, Session &session) {
+    vector<DirEntry> entries;
+    FsError error = fs.list(session, entries);
+    if (error != FS_OK) {
+        return error;
+    }
+    session.lastListing.clear();
+    for (const DirEntry &entry : entries) {
+        if (entry.isDirectory) {
+            formatDir(session.lastListing, entry);
+        } else {
+            formatFile(session.lastListing, entry);
+        }
+    }
+    session.out->write(session.lastListing.data(), session.lastListing.size());
+    return FS_OK;
+}
+
+/**
+ * @brief print which file owns each block of the disk, a row of blocks at a time, followed by the file of each symbol
+*/
+static FsError printBlockMap(FileSystem &fs, Session &session) {
+    string map;
+    vector<Extent> extents;
+    FsError error = fs.blockMap(session, map, extents);
+    if (error != FS_OK) {
+        return error;
+    }
+    string output;
+    char line[MAP_ROW_BLOCKS + 32];
+    int len = snprintf(line, sizeof(line), "Block map: %zu of %zu blocks free\n", (size_t)count(map.begin(), map.end(), MAP_FREE), map.size());
+    output.append(line, len);
+    for (size_t row = 0; row < map.size(); row += MAP_ROW_BLOCKS) {
+        len = snprintf(line, sizeof(line), "%3zu %s\n", row, map.substr(row, MAP_ROW_BLOCKS).c_str());
+        output.append(line, len);
+    }
+    for (const Extent &extent : extents) {
+        len = snprintf(line, sizeof(line), "%c %-5s %3d-%d\n", extent.symbol, extent.name.c_str(), extent.start, extent.start + extent.blocks - 1);
+        output.append(line, len);
+    }
+    session.out->write(output.data(), output.size());
+    return FS_OK;
+}
+
+/**
+ * @brief load the buffer from a host file with a single read, anything past the end of the file is zeroed
+ * @param command - the command, with the file, the byte offset and the number of blocks
+ * @return bool - false if the file can't be read, the buffer is then a single zeroed block
+*/
+static bool loadHostFile(Session &session, const Command &command) {
+    int fd = open(string(command.name).c_str(), O_RDONLY);
+    if (fd == -1) {
+        session.clearBuffer();
+        return false;
+    }
+    size_t length = command.number * BLOCK_SIZE;
+    session.buffer.resize(length);
+    ssize_t bytesRead = pread(fd, session.buffer.data(), length, command.offset);
+    ::close(fd);
+    if (bytesRead == -1) {
+        session.clearBuffer();
+        return false;
+    }
+    memset(session.buffer.data() + bytesRead, 0, length - bytesRead);
+    return true;
+}
+
+/**
+ * @brief load the buffer from hex or base64 data, the last block is padded with zeros
+ * @param command - the command, with the data and its encoding
+*/
+static void loadData(Session &session, const Command &command) {
+    size_t length = 0;
+    decodedLength(command.name, command.number, length);
+    size_t blocks = (length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    session.buffer.resize(blocks * BLOCK_SIZE);
+    decode(command.name, command.number, session.buffer.data());
+    memset(session.buffer.data() + length, 0, blocks * BLOCK_SIZE - length);
+}
+
+/**
+ * @brief run the defrag the file system is set up to use, the locality defrag prints how much it helped
+*/
+static FsError defragDisk(FileSystem &fs, Session &session) {
+    if (!fs.usesLocalityDefrag()) {
+        return fs.defrag(session);
+    }
+    double seekBefore;
+    double seekAfter;
+    FsError error = fs.defragLocality(session, seekBefore, seekAfter);
+    if (error == FS_OK) {
+        char line[80];
+        snprintf(line, sizeof(line), "Average seek distance per directory scan: %.2f -> %.2f\n", seekBefore, seekAfter);
+        *session.out << line;
+    }
+    return error;
+}
+
+/**
+ * @brief run a parsed command for a session through the library api, printing anything it outputs
+ * names are at most 5 characters so the strings made from them don't allocate
+ * @param fs - the file system the command runs on
+ * @param session - the session running the command
+ * @param command - the validated command
+*/
+static void dispatch(FileSystem &fs, Session &session, const Command &command) {
+    if (command.op != MOUNT && !fs.isMounted()) {
+        printError(session, command, FS_NOT_MOUNTED);
+        return;
+    }
+
+    FsError error = FS_OK;
+    switch (command.op) {
+        case MOUNT:
+            error = fs.mount(session, string(command.name));
+            break;
+        case CREATE:
+            error = fs.create(session, string(command.name), command.number);
+            break;
+        case DELETE:
+            error = fs.remove(session, string(command.name));
+            break;
+        case READ:
+            // a read fills the first block, once it works the buffer is just that block
+            error = fs.read(session, string(command.name), command.number, span(session.buffer.data(), BLOCK_SIZE));
+            if (error == FS_OK) {
+                session.buffer.resize(BLOCK_SIZE);
+            }
+            break;
+        case WRITE:
+            error = fs.write(session, string(command.name), command.number, session.buffer);
+            break;
+        case BUFFER:
+            // only the characters themselves are copied, the rest of the buffer is zeroed
+            session.clearBuffer();
+            memcpy(session.buffer.data(), command.name.data(), min(command.name.length(), MAX_BUFF_LEN));
+            break;
+        case BUFFER_FILE:
+            if (!loadHostFile(session, command)) {
+                *session.err << "Error: Cannot read host file: " << command.name << endl;
+            }
+            break;
+        case BUFFER_DATA:
+            loadData(session, command);
+            break;
+        case LS:
+            error = listDirectory(fs, session);
+            break;
+        case RESIZE:
+            error = fs.resize(session, string(command.name), command.number);
+            break;
+        case DEFRAG:
+            error = defragDisk(fs, session);
+            break;
+        case CD:
+            error = fs.changeDirectory(session, string(command.name));
+            break;
+        case NOP:
+            break;
+        case LS_REPEAT:
+            session.out->write(session.lastListing.data(), session.lastListing.size());
+            break;
+        case STATS:
+            if (fs.getStats().isEnabled()) {
+                fs.getStats().print(*session.out);
+            } else {
+                *session.err << "Error: Stats are not enabled" << endl;
+            }
+            break;
+        case BLOCK_MAP:
+            error = printBlockMap(fs, session);
+            break;
+        case SNAPSHOT:
+            error = fs.snapshot(session);
+            break;
+        case ROLLBACK:
+            error = fs.rollback(session);
+            break;
+        case WRITE_REPEAT:
+            // the block already holds the buffer so only the checks of the write are needed
+            error = fs.checkWrite(session, string(command.name), command.number, bufferBlocks(session));
+            break;
+    }
+    if (error != FS_OK) {
+        printError(session, command, error);
+    }
+}
+
+/**
+ * @brief run a parsed command for a session, recording how long it took if stats are enabled
+ * @param fs - the file system the command runs on
+ * @param session - the session running the command
+ * @param command - the validated command
+*/
+void runCommand(FileSystem &fs, Session &session, const Command &command) {
+    session.command = command.op;
+    Stats &stats = fs.getStats();
+    if (!stats.isEnabled()) {
+        dispatch(fs, session, command);
+        return;
+    }
+    auto start = chrono::steady_clock::now();
+    dispatch(fs, session, command);
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+    stats.recordLatency(command.op, elapsed.count());
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "CommandParser.hpp"
+#include "FileSystem.hpp"
+#include "Session.hpp"
+using namespace std;
+
+void runCommand(FileSystem &fs, Session &session, const Command &command);     // run a parsed command and print its output and errors
@@ -0,0 +1,390 @@
+#include "Compression.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+static_assert(sizeof(CompressedHeader) <= BLOCK_SIZE, "the compressed image header must fit in one block");
+
+///////////////////////////////////////////////////
+// Codec
+///////////////////////////////////////////////////
+
+/**
+ * The codec is a byte oriented lz77 in the style of lz4. The output is a list of sequences, each one a token byte
+ * with the number of literals in its high 4 bits and the match length minus LZ_MIN_MATCH in its low 4 bits, any
+ * length of 15 or more continuing in bytes of 255 and a last byte below 255, then the literals, then the match
+ * offset as 2 little endian bytes. The last sequence only has literals and ends the input.
+*/
+
+/**
+ * @brief hash the 4 bytes at a position into the match table
+*/
+static uint32_t lzHash(const uint8_t *at) {
+    uint32_t value;
+    memcpy(&value, at, sizeof(value));
+    return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/**
+ * @brief write the part of a length that doesn't fit in its 4 bits of the token
+ * @return bool - false if it doesn't fit in the output
+*/
+static bool putLength(size_t length, uint8_t *out, size_t &used, size_t capacity) {
+    for (; length >= 255; length -= 255) {
+        if (used >= capacity) {
+            return false;
+        }
+        out[used++] = 255;
+    }
+    if (used >= capacity) {
+        return false;
+    }
+    out[used++] = length;
+    return true;
+}
+
+/**
+ * @brief write one sequence, a match length of 0 writes the last sequence which has no match
+ * @return bool - false if it doesn't fit in the output
+*/
+static bool putSequence(const uint8_t *literals, size_t literalLength, size_t offset, size_t matchLength,
+                        uint8_t *out, size_t &used, size_t capacity) {
+    if (used >= capacity) {
+        return false;
+    }
+    size_t matchCode = matchLength == 0 ? 0 : matchLength - LZ_MIN_MATCH;
+    out[used++] = (min(literalLength, (size_t)15) << 4) | min(matchCode, (size_t)15);
+    if (literalLength >= 15 && !putLength(literalLength - 15, out, used, capacity)) {
+        return false;
+    }
+    if (used + literalLength > capacity) {
+        return false;
+    }
+    memcpy(out + used, literals, literalLength);
+    used += literalLength;
+    if (matchLength == 0) {
+        return true;
+    }
+    if (used + 2 > capacity) {
+        return false;
+    }
+    out[used++] = offset & 0xFF;
+    out[used++] = offset >> 8;
+    return matchCode < 15 || putLength(matchCode - 15, out, used, capacity);
+}
+
+/**
+ * @brief compress data, the output is only used if it is smaller than the capacity given
+ * @param in - the data
+ * @param length - the bytes of data, at most 65535 so every offset fits in 2 bytes
+ * @param out - where the compressed data goes
+ * @param capacity - the bytes out has room for
+ * @return size_t - the compressed bytes, 0 if they don't fit
+*/
+size_t lzCompress(const uint8_t *in, size_t length, uint8_t *out, size_t capacity) {
+    // where each hash was last seen plus one, 0 for never
+    uint16_t table[1 << LZ_HASH_BITS] = {0};
+    size_t used = 0;
+    size_t anchor = 0;
+    size_t pos = 0;
+    while (pos + LZ_MIN_MATCH <= length) {
+        uint32_t hash = lzHash(in + pos);
+        size_t candidate = table[hash];
+        table[hash] = pos + 1;
+        if (candidate == 0 || memcmp(in + candidate - 1, in + pos, LZ_MIN_MATCH) != 0) {
+            pos++;
+            continue;
+        }
+        size_t ref = candidate - 1;
+        size_t matchLength = LZ_MIN_MATCH;
+        while (pos + matchLength < length && in[ref + matchLength] == in[pos + matchLength]) {
+            matchLength++;
+        }
+        if (!putSequence(in + anchor, pos - anchor, pos - ref, matchLength, out, used, capacity)) {
+            return 0;
+        }
+        pos += matchLength;
+        anchor = pos;
+    }
+    if (!putSequence(in + anchor, length - anchor, 0, 0, out, used, capacity)) {
+        return 0;
+    }
+    return used < capacity ? used : 0;
+}
+
+/**
+ * @brief read the part of a length that didn't fit in its 4 bits of the token
+ * @return bool - false if the input ends first
+*/
+static bool getLength(const uint8_t *in, size_t length, size_t &pos, size_t &value) {
+    uint8_t next;
+    do {
+        if (pos >= length) {
+            return false;
+        }
+        next = in[pos++];
+        value += next;
+    } while (next == 255);
+    return true;
+}
+
+/**
+ * @brief decompress data written by lzCompress
+ * @param in - the compressed data
+ * @param length - the compressed bytes
+ * @param out - where the data goes
+ * @param outLength - the bytes the data has to decompress to
+ * @return bool - false if it is malformed or isn't outLength bytes
+*/
+bool lzDecompress(const uint8_t *in, size_t length, uint8_t *out, size_t outLength) {
+    size_t pos = 0;
+    size_t written = 0;
+    while (pos < length) {
+        uint8_t token = in[pos++];
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !getLength(in, length, pos, literalLength)) {
+            return false;
+        }
+        if (pos + literalLength > length || written + literalLength > outLength) {
+            return false;
+        }
+        memcpy(out + written, in + pos, literalLength);
+        pos += literalLength;
+        written += literalLength;
+        if (pos == length) {
+            break;
+        }
+        if (pos + 2 > length) {
+            return false;
+        }
+        size_t offset = in[pos] | (in[pos + 1] << 8);
+        pos += 2;
+        size_t matchLength = token & 0xF;
+        if (matchLength == 15 && !getLength(in, length, pos, matchLength)) {
+            return false;
+        }
+        matchLength += LZ_MIN_MATCH;
+        if (offset == 0 || offset > written || written + matchLength > outLength) {
+            return false;
+        }
+        // a match can overlap what it writes so it is copied a byte at a time
+        for (size_t i = 0; i < matchLength; i++) {
+            out[written + i] = out[written - offset + i];
+        }
+        written += matchLength;
+    }
+    return written == outLength;
+}
+
+///////////////////////////////////////////////////
+// Compressed Image
+///////////////////////////////////////////////////
+
+/**
+ * @brief default constructor, no image is open
+*/
+CompressedImage::CompressedImage() {
+    fd = -1;
+    fill(lengths, lengths + NUM_BLOCKS, 0);
+}
+
+/**
+ * @brief destructor, closes the image
+*/
+CompressedImage::~CompressedImage() {
+    close();
+}
+
+/**
+ * @brief move constructor, the other image is left closed
+*/
+CompressedImage::CompressedImage(CompressedImage &&other) noexcept {
+    fd = -1;
+    *this = move(other);
+}
+
+/**
+ * @brief move assignment, an image that was open here is closed first and the other image is left closed
+*/
+CompressedImage &CompressedImage::operator=(CompressedImage &&other) noexcept {
+    if (this != &other) {
+        close();
+        fd = other.fd;
+        copy(other.lengths, other.lengths + NUM_BLOCKS, lengths);
+        other.fd = -1;
+    }
+    return *this;
+}
+
+/**
+ * @brief checks if a disk file is a compressed image
+ * @param start - the first block of the file
+ * @return bool - true if it starts with COMPRESSED_MAGIC
+*/
+bool CompressedImage::isCompressed(const char start[BLOCK_SIZE]) {
+    return memcmp(start, COMPRESSED_MAGIC, sizeof(COMPRESSED_MAGIC)) == 0;
+}
+
+/**
+ * @brief write a compressed image of a disk that is all zeros, the file is sparse so only the header takes space
+ * @param path - the image, it is replaced if it exists
+ * @return bool - false if it can't be written
+*/
+bool CompressedImage::create(const string &path) {
+    int newFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (newFd == -1) {
+        return false;
+    }
+    char block[BLOCK_SIZE] = {0};
+    CompressedHeader header = {};
+    memcpy(header.magic, COMPRESSED_MAGIC, sizeof(header.magic));
+    header.version = COMPRESSED_VERSION;
+    header.blockSize = BLOCK_SIZE;
+    header.blocks = NUM_BLOCKS;
+    memcpy(block, &header, sizeof(header));
+    bool ok = ftruncate(newFd, (NUM_BLOCKS + 1) * BLOCK_SIZE) == 0 && pwrite(newFd, block, BLOCK_SIZE, 0) == BLOCK_SIZE;
+    return ::close(newFd) == 0 && ok;
+}
+
+/**
+ * @brief open a compressed image and read the lengths of its blocks
+ * @param path - the image
+ * @return bool - false if it can't be opened or isn't a compressed image this file system can use
+*/
+bool CompressedImage::open(const string &path) {
+    close();
+    int newFd = ::open(path.c_str(), O_RDWR);
+    if (newFd == -1) {
+        return false;
+    }
+    char block[BLOCK_SIZE];
+    CompressedHeader header;
+    if (pread(newFd, block, BLOCK_SIZE, 0) != BLOCK_SIZE || !isCompressed(block)) {
+        ::close(newFd);
+        return false;
+    }
+    memcpy(&header, block, sizeof(header));
+    // a version 1 image is one with every block in its first slot, writing to it makes it version 2
+    bool known = header.version == 1 || header.version == COMPRESSED_VERSION;
+    if (!known || header.blockSize != BLOCK_SIZE || header.blocks != NUM_BLOCKS) {
+        ::close(newFd);
+        return false;
+    }
+    if (header.version != COMPRESSED_VERSION) {
+        header.version = COMPRESSED_VERSION;
+        off_t at = offsetof(CompressedHeader, version);
+        if (pwrite(newFd, &header.version, sizeof(header.version), at) != sizeof(header.version)) {
+            ::close(newFd);
+            return false;
+        }
+    }
+    copy(header.lengths, header.lengths + NUM_BLOCKS, lengths);
+    fd = newFd;
+    return true;
+}
+
+/**
+ * @brief where the slot a block is stored in starts
+ * @param block - the block of the disk
+ * @param stored - the length the header has for the block
+ * @return off_t - the offset in the image
+*/
+off_t CompressedImage::slotOf(int block, uint16_t stored) {
+    int first = block + 1;
+    return (off_t)((stored & COMPRESSED_SECOND_SLOT) ? first + NUM_BLOCKS : first) * BLOCK_SIZE;
+}
+
+/**
+ * @brief read a block
+ * @param readFd - a descriptor of the image so sessions can read with their own at the same time, -1 for the image's own
+ * @param block - the block of the disk
+ * @param data - where the block is read to
+ * @return long - the bytes read from the image, -1 if the slot can't be read, is cut short or doesn't decompress
+*/
+long CompressedImage::read(int readFd, int block, uint8_t *data) {
+    if (readFd == -1) {
+        readFd = fd;
+    }
+    // the image has no slots past the end of the disk, those blocks are zeros
+    uint16_t stored = block < NUM_BLOCKS ? lengths[block] : 0;
+    size_t length = lengthOf(stored);
+    off_t slot = slotOf(block, stored);
+    if (length == 0) {
+        memset(data, 0, BLOCK_SIZE);
+        return 0;
+    }
+    if (length > BLOCK_SIZE) {
+        return -1;
+    }
+    if (length == BLOCK_SIZE) {
+        return pread(readFd, data, BLOCK_SIZE, slot) == BLOCK_SIZE ? (long)length : -1;
+    }
+    uint8_t packed[BLOCK_SIZE];
+    if (pread(readFd, packed, length, slot) != (ssize_t)length || !lzDecompress(packed, length, data, BLOCK_SIZE)) {
+        return -1;
+    }
+    return length;
+}
+
+/**
+ * @brief write a block, compressed if that makes it smaller, a block past the end of the disk is dropped. it goes
+ * to the slot the block isn't stored in and only then is its length in the header switched to that slot, so the
+ * block keeps its old contents until the new ones are all in the image
+ * @param block - the block of the disk
+ * @param data - the contents of the block
+ * @return long - the bytes written to the image, -1 if the block couldn't be written and has its old contents
+*/
+long CompressedImage::write(int block, const uint8_t *data) {
+    if (block >= NUM_BLOCKS) {
+        return 0;
+    }
+    uint8_t packed[BLOCK_SIZE];
+    size_t length = 0;
+    const uint8_t *from = packed;
+    if (any_of(data, data + BLOCK_SIZE, [](uint8_t byte) { return byte != 0; })) {
+        length = lzCompress(data, BLOCK_SIZE, packed, BLOCK_SIZE);
+        if (length == 0) {
+            length = BLOCK_SIZE;
+            from = data;
+        }
+    }
+    // a block of zeros has nothing stored, so it only has to be written if it wasn't zeros already
+    if (length == 0 && storesZeros(block)) {
+        return 0;
+    }
+    uint16_t stored = length | (~lengths[block] & COMPRESSED_SECOND_SLOT);
+    if (length > 0 && pwrite(fd, from, length, slotOf(block, stored)) != (ssize_t)length) {
+        return -1;
+    }
+    off_t at = offsetof(CompressedHeader, lengths) + block * sizeof(uint16_t);
+    if (pwrite(fd, &stored, sizeof(stored), at) != sizeof(stored)) {
+        return -1;
+    }
+    lengths[block] = stored;
+    return length + sizeof(stored);
+}
+
+/**
+ * @brief close the image, every length is already in the header
+*/
+void CompressedImage::close() {
+    if (fd == -1) {
+        return;
+    }
+    ::close(fd);
+    fd = -1;
+}
+
+/**
+ * @brief the bytes stored for every block, the size the disk compresses to
+ * @return long - the total of the lengths
+*/
+long CompressedImage::storedBytes() {
+    long total = 0;
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+        total += lengthOf(lengths[i]);
+    }
+    return total;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include "Constants.hpp"
+using namespace std;
+
+size_t lzCompress(const uint8_t *in, size_t length, uint8_t *out, size_t capacity);     // compress, 0 if it doesn't fit
+bool lzDecompress(const uint8_t *in, size_t length, uint8_t *out, size_t outLength);     // decompress, false if it is malformed
+
+/**
+ * the first block of a compressed image, the rest of the block is zeros
+*/
+struct CompressedHeader {
+    char magic[8];                      // COMPRESSED_MAGIC
+    uint32_t version;                   // COMPRESSED_VERSION
+    uint32_t blockSize;                 // the bytes in a block of the disk
+    uint32_t blocks;                    // the blocks of the disk
+    uint32_t reserved;                  // zero
+    uint16_t lengths[NUM_BLOCKS];       // the bytes stored for each block and which slot, see CompressedImage
+};
+
+/**
+ * a disk stored with every block compressed, block i of the disk has the slot at block i + 1 of the image and
+ * only as many bytes of the slot as the block compresses to are written and read, the header keeps how many
+ * that is for each block, 0 for a block of zeros which is never read or written at all and BLOCK_SIZE for a
+ * block that doesn't compress and is stored as it is. block i also has a second slot at block NUM_BLOCKS + i + 1,
+ * a write goes to the slot the block isn't in and then switches the block's length in the header to it, so a
+ * crash leaves either the old contents or the new ones
+*/
+class CompressedImage {
+    private:
+        int fd;                                         // the image file, -1 if the disk isn't compressed
+        uint16_t lengths[NUM_BLOCKS];                   // the bytes stored for each block, as the header has them
+        static size_t lengthOf(uint16_t stored) { return stored & ~COMPRESSED_SECOND_SLOT; }
+        static off_t slotOf(int block, uint16_t stored);    // where the slot a length is for starts
+    public:
+        CompressedImage();                              // default constructor, no image is open
+        ~CompressedImage();                             // closes the image
+        CompressedImage(CompressedImage &&other) noexcept;              // move constructor
+        CompressedImage &operator=(CompressedImage &&other) noexcept;   // move assignment
+        CompressedImage(const CompressedImage&) = delete;
+        CompressedImage &operator=(const CompressedImage&) = delete;
+        static bool isCompressed(const char start[BLOCK_SIZE]);        // checks the first block of a disk file
+        static bool create(const string &path);         // write an empty compressed image, every block zeros
+        bool open(const string &path);                  // open a compressed image, false if it isn't one
+        bool isOpen() { return fd != -1; }
+        bool storesZeros(int block) { return lengthOf(lengths[block]) == 0; }  // if a block is a block of zeros with nothing stored
+        long read(int readFd, int block, uint8_t *data);    // read a block with a descriptor of the image, returns the bytes read or -1
+        long write(int block, const uint8_t *data);     // write a block, returns the bytes written or -1
+        void close();                                   // close the image
+        long storedBytes();                             // the bytes stored for all the blocks
+};
@@ -4,9 +4,8 @@
 #include <set>
 #include <string>
 #include <map>
-#include "CommandParser.hpp"
-
-typedef bool (CommandParser::*FunctionPointer)();
+#include <stdint.h>
+using namespace std;
 
 /**
  * Putting all my constants here for the good practice
@@ -19,12 +18,29 @@ const size_t MAX_NAME_LEN = 5;
 const size_t TWO_ARG_COMMAND = 3;
 const size_t NO_ARG_COMMAND = 1;
 const size_t ONE_ARG_COMMAND = 2;
+const size_t THREE_ARG_COMMAND = 4;
 const size_t LEN_CREATE_COMMAND = 3;
+const size_t MAX_TOKENS = 4;
 const size_t MAX_BUFF_LEN = 1024;
+const size_t MAX_BUFFER_BLOCKS = 127;       // blocks a buffer loaded from a host file or inline data can hold
 const size_t MIN_BLOCK_NUM = 1;
 const size_t MAX_BLOCK_NUM = 127;
 const size_t BLOCK_SIZE = 1024;
 const size_t BITS_IN_BYTE = 8;
+const size_t INPUT_BUFFER_SIZE = 1 << 20;   // bytes read from the command file at a time
+const size_t OUTPUT_BUFFER_SIZE = 1 << 20;  // bytes an output sink holds before it has to write
+const size_t CLIENT_BUFFER_SIZE = 1 << 16;  // bytes read from and buffered for each daemon client
+const size_t CLIENT_MAX_LINE = 2 * MAX_BUFFER_BLOCKS * BLOCK_SIZE + 16;   // longest line a daemon client may send, a hex X line of a full buffer
+const int DAEMON_POLL_MS = 200;             // how often the daemon checks if it was asked to stop
+const int DAEMON_STOP_GRACE_MS = 2000;      // how long a stopping daemon waits for clients before cutting them off
+const size_t ASYNC_IO_THREADS = 4;          // threads that run the block operations of the async api
+
+const int DEFRAG_STEP_BLOCKS = 8;           // max number of blocks an incremental defrag step moves
+const int DEFRAG_TIME_BUDGET_US = 500;      // time an incremental defrag may use between two commands
+const int DEFRAG_THRESHOLD = 50;            // fragmentation percentage that starts an incremental defrag
+
+const int READ_AHEAD_MIN_BLOCKS = 2;        // blocks read ahead once the reads of a file are sequential
+const int READ_AHEAD_MAX_BLOCKS = 32;       // the window doubles up to this many blocks while reads stay sequential
 
 const uint8_t ROOT_DIR = 127;
 const uint8_t INVALID_NODE_NUM = 129;
@@ -33,30 +49,72 @@ const size_t LAST_BIT_MASK = 0x80;
 const size_t ALL_BUT_LAST_MASK = 0x7F;
 const size_t NO_BITS_MASK = 0;
 
-const string MOUNT = "M";
-const string CREATE = "C";
-const string DELETE = "D";
-const string READ = "R";
-const string WRITE = "W";
-const string BUFFER = "B";
-const string LS = "L";
-const string RESIZE = "E";
-const string DEFRAG = "O";
-const string CD = "Y";
+const char NO_COMMAND = 0;
+const char MOUNT = 'M';
+const char CREATE = 'C';
+const char DELETE = 'D';
+const char READ = 'R';
+const char WRITE = 'W';
+const char BUFFER = 'B';
+const char LS = 'L';
+const char RESIZE = 'E';
+const char DEFRAG = 'O';
+const char CD = 'Y';
+const char BUFFER_FILE = 'F';               // load the buffer from an offset of a host file
+const char BUFFER_DATA = 'X';               // load the buffer from hex or base64 data
+const char STATS = 'S';                     // print the stats of the file system
+const char BLOCK_MAP = 'P';                 // print which file owns each block of the disk
+const char SNAPSHOT = 'K';                  // take a snapshot of the mounted disk
+const char ROLLBACK = 'U';                  // put the mounted disk back the way the latest snapshot has it
+
+// encodings of the data of a BUFFER_DATA command
+const int ENCODING_HEX = 0;
+const int ENCODING_BASE64 = 1;
+const string HEX_STRING = "hex";
+const string BASE64_STRING = "base64";
+
+// operations the script compiler replaces redundant commands with, these can't appear in a script
+const char NOP = 'n';
+const char LS_REPEAT = 'l';
+const char WRITE_REPEAT = 'w';
+// every command letter that latencies are recorded for, including the ones the script compiler adds
+const char STAT_OPS[] = "MCDRWBLEOYFXSPKUnlw";
+const size_t NUM_STAT_OPS = sizeof(STAT_OPS) - 1;
+const size_t HISTOGRAM_BUCKETS = 496;       // 8 buckets for each power of two of a 64 bit value
+
+// disk accesses in a trace, and the mark left where a block map was printed
+const char TRACE_READ = 'r';
+const char TRACE_WRITE = 'w';
+const char TRACE_MARK = 'm';
+const char TRACE_MAGIC[8] = {'F', 'S', 'T', 'R', 'A', 'C', 'E', 0};
+const uint32_t TRACE_VERSION = 1;
+const size_t TRACE_BUFFER_RECORDS = 4096;   // records a trace holds before writing them
+
+// compressed disk images, blocks are compressed with a small lz77 codec
+const char COMPRESSED_MAGIC[8] = {'F', 'S', 'L', 'Z', 'I', 'M', 'G', 0};
+const uint32_t COMPRESSED_VERSION = 2;
+const uint16_t COMPRESSED_SECOND_SLOT = 0x8000;  // set in a header length if the block is stored in its second slot
+const size_t LZ_MIN_MATCH = 4;              // the shortest run the codec copies from earlier in the block
+const int LZ_HASH_BITS = 10;                // bits of the hash of 4 bytes the codec finds earlier runs with
+
+// the dedup table of a disk is kept in a block of the disk file past the end of the disk
+const char DEDUP_MAGIC[8] = {'F', 'S', 'D', 'E', 'D', 'U', 'P', 0};
+const int DEDUP_MAP_BLOCK = 2 * NUM_BLOCKS; // past any block of a file that runs off the end of the disk
+
+// files that aren't one run of blocks list their runs in an extent block, a count byte then a start and length byte
+// for each run, and the high bit of the start block in their inode is set with the extent block in the rest of it
+const uint8_t EXTENT_BLOCK_FLAG = 0x80;
+
+// the characters of a block map, files get a symbol each in the order they start on the disk
+const char MAP_SUPER_BLOCK = 'S';
+const char MAP_FREE = '.';
+const char MAP_ORPHAN = '#';                // marked used but no file has it
+const char MAP_EXTENT_BLOCK = '+';          // the extent block of a file
+const char MAP_RESERVED = '~';              // reserved for the file before it to grow into
+const string MAP_SYMBOLS = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+const size_t MAP_ROW_BLOCKS = 64;           // blocks printed on each row of a block map
+const size_t COMPILE_WINDOW = 4096;         // number of commands the script compiler looks at together
+const size_t MOUNT_TABLE_SIZE = 8;          // number of recently mounted disks kept open
 
 const string CUR_DIR_STRING = ".";
 const string PARENT_DIR_STRING = "..";
-
-// a map from the command strings to their CommandParser check functions
-static map<string, FunctionPointer>  commandMap {
-    {"M", &CommandParser::checkMount},
-    {"C", &CommandParser::validCreateOp},
-    {"R", &CommandParser::validReadWrite},
-    {"W", &CommandParser::validReadWrite},
-    {"E", &CommandParser::validFileOp},
-    {"B", &CommandParser::validBuffOp},
-    {"L", &CommandParser::validNoArgOp},
-    {"O", &CommandParser::validNoArgOp},
-    {"Y", &CommandParser::validOneArgOp},
-    {"D", &CommandParser::validOneArgOp},
-};
\ No newline at end of file
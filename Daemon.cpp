@@ -0,0 +1,230 @@
+#include "Daemon.hpp"
+#include "CommandRunner.hpp"
+#include "OutputSink.hpp"
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+using namespace std;
+
+// set by the signal handler, checked by the accept loop
+static volatile sig_atomic_t stopRequested = 0;
+
+/**
+ * @brief constructor
+ * @param socketPath - the path of the unix domain socket to listen on
+ * @param options - the defrag, dedup, growth and stats options for the file system
+*/
+Daemon::Daemon(const string &socketPath, const RunOptions &options) {
+    this->socketPath = socketPath;
+    listenFd = -1;
+    fs.useLocalityDefrag(options.localityDefrag);
+    if (options.dedup) {
+        fs.enableDedup();
+    }
+    if (options.extents) {
+        fs.enableExtents();
+    }
+    if (options.growBackward) {
+        fs.enableBackwardGrowth();
+    }
+    if (options.prealloc > 0) {
+        fs.enablePrealloc(options.prealloc);
+    }
+    if (options.autoDefrag) {
+        fs.enableAutoDefrag(options.defragThreshold, options.defragStep, options.defragBudget);
+    }
+    if (options.stats) {
+        fs.enableStats(options.statsFile);
+    }
+    if (!options.traceFile.empty() && !fs.enableTrace(options.traceFile)) {
+        cerr << "Error: Cannot write trace: " << options.traceFile << endl;
+    }
+}
+
+/**
+ * @brief destructor, the socket file is removed so the next daemon can use the path
+*/
+Daemon::~Daemon() {
+    if (listenFd != -1) {
+        ::close(listenFd);
+        unlink(socketPath.c_str());
+    }
+    fs.close();
+}
+
+/**
+ * @brief signal handler for SIGINT and SIGTERM
+ * @param signal - the signal that was received
+*/
+void Daemon::requestStop(int signal) {
+    stopRequested = 1;
+}
+
+/**
+ * @brief create the socket and start listening on it
+ * a socket left behind by a daemon that didn't shut down cleanly is replaced, any other file is not.
+ * the socket is only usable by the user running the daemon, a client can read the host's files with F
+ * @return bool - false if the socket couldn't be created
+*/
+bool Daemon::listen() {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.length() >= sizeof(address.sun_path)) {
+        cerr << "Error: socket path is too long: " << socketPath << endl;
+        return false;
+    }
+    strcpy(address.sun_path, socketPath.c_str());
+
+    struct stat info;
+    if (stat(socketPath.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(socketPath.c_str());
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    // made with mode 0600 by bind, there is no moment when another user could connect
+    mode_t oldMask = umask(0177);
+    bool bound = fd != -1 && bind(fd, (sockaddr*)&address, sizeof(address)) == 0;
+    umask(oldMask);
+    if (!bound || ::listen(fd, SOMAXCONN) == -1) {
+        cerr << "Error: cannot listen on " << socketPath << ": " << strerror(errno) << endl;
+        if (fd != -1) {
+            ::close(fd);
+        }
+        return false;
+    }
+    listenFd = fd;
+    return true;
+}
+
+/**
+ * @brief accept clients until SIGINT or SIGTERM, each client is served on its own thread
+ * when asked to stop, clients finish the commands they already sent and then get disconnected,
+ * a client still connected after DAEMON_STOP_GRACE_MS is cut off even if it isn't reading its output
+*/
+void Daemon::run() {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = Daemon::requestStop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    // a client that disconnects early shouldn't kill the daemon when its output is written
+    signal(SIGPIPE, SIG_IGN);
+
+    pollfd waiting;
+    waiting.fd = listenFd;
+    waiting.events = POLLIN;
+    while (!stopRequested) {
+        if (poll(&waiting, 1, DAEMON_POLL_MS) <= 0) {
+            continue;
+        }
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd == -1) {
+            continue;
+        }
+        lock_guard<mutex> guard(clientsLock);
+        clients.insert(fd);
+        thread(&Daemon::serveClient, this, fd).detach();
+    }
+
+    unique_lock<mutex> guard(clientsLock);
+    for (int fd : clients) {
+        shutdown(fd, SHUT_RD);
+    }
+    auto finished = [&]() { return clients.empty(); };
+    // a client that stopped reading would keep its thread in a write forever, shutting down writes ends it
+    if (!clientsDone.wait_for(guard, chrono::milliseconds(DAEMON_STOP_GRACE_MS), finished)) {
+        for (int fd : clients) {
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+    clientsDone.wait(guard, finished);
+}
+
+/**
+ * @brief read commands from a client and run them in its own session
+ * commands can be pipelined, everything that arrives in one read is run before the output is
+ * sent back, so a client can send many commands before it reads any responses
+ * output and errors both go back over the socket in the order they happen, a client that sends a line
+ * longer than CLIENT_MAX_LINE gets an error and is disconnected without it being run
+ * @param fd - the client's socket
+*/
+void Daemon::serveClient(int fd) {
+    OutputSink sink(fd, FLUSH_AT_EXIT, 0, CLIENT_BUFFER_SIZE);
+    ostream out(&sink);
+    Session session(out, out);
+    CommandParser parser = CommandParser();
+    vector<char> input(CLIENT_BUFFER_SIZE);
+    size_t pending = 0;
+    int lineNumber = 1;
+    bool tooLong = false;
+
+    while (true) {
+        if (pending == input.size()) {
+            // the buffer has room for the longest line and its newline
+            if (input.size() > CLIENT_MAX_LINE) {
+                *session.err << "Error: line " << lineNumber << " is longer than " << CLIENT_MAX_LINE << " bytes" << endl;
+                tooLong = true;
+                break;
+            }
+            input.resize(min(input.size() * 2, CLIENT_MAX_LINE + 1));
+        }
+        ssize_t received = read(fd, input.data() + pending, input.size() - pending);
+        if (received == -1 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            break;
+        }
+        pending += received;
+        // run every complete line, a partial line waits for the rest of it
+        size_t start = 0;
+        char *newline;
+        while ((newline = (char*)memchr(input.data() + start, '\n', pending - start)) != nullptr) {
+            size_t end = newline - input.data();
+            runLine(session, parser, string_view(input.data() + start, end - start), lineNumber++);
+            start = end + 1;
+        }
+        memmove(input.data(), input.data() + start, pending - start);
+        pending -= start;
+        sink.flush();
+    }
+    // the last line doesn't need a newline, same as a script
+    if (pending > 0 && !tooLong) {
+        runLine(session, parser, string_view(input.data(), pending), lineNumber);
+    }
+    sink.flush();
+
+    // closed while holding the lock so a new client can't get the same descriptor before it is removed
+    lock_guard<mutex> guard(clientsLock);
+    clients.erase(fd);
+    ::close(fd);
+    clientsDone.notify_all();
+}
+
+/**
+ * @brief parse and run one command line for a client
+ * @param session - the client's session
+ * @param parser - the client's parser
+ * @param line - the command line
+ * @param lineNumber - the number of the line since the client connected
+*/
+void Daemon::runLine(Session &session, CommandParser &parser, string_view line, int lineNumber) {
+    const Command &parsed = parser.parse(line);
+    if (parser.validate()) {
+        session.line = lineNumber;
+        runCommand(fs, session, parsed);
+    } else {
+        *session.err << "Command Error: " << socketPath << ", " << lineNumber << endl;
+    }
+    fs.runBackgroundTasks();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include "CommandParser.hpp"
+#include "FileSystem.hpp"
+#include "ScriptRunner.hpp"
+using namespace std;
+
+/**
+ * serves the command protocol to local clients over a unix domain socket,
+ * the file system stays alive between clients so mounted disks and their super blocks stay warm
+*/
+class Daemon {
+    private:
+        FileSystem fs;                                      // the file system every client runs commands on
+        string socketPath;                                  // where the socket is created
+        int listenFd;                                       // the listening socket, -1 if not listening
+        mutex clientsLock;                                  // guards the set of clients
+        condition_variable clientsDone;                     // signalled when a client disconnects
+        set<int> clients;                                   // the sockets of the connected clients
+        void serveClient(int fd);                           // run the commands a client sends until it disconnects
+        void runLine(Session &session, CommandParser &parser, string_view line, int lineNumber);   // run one command line
+    public:
+        Daemon(const string &socketPath, const RunOptions &options);    // constructor
+        ~Daemon();                                          // closes and removes the socket
+        bool listen();                                      // create the socket, returns false if it couldn't be
+        void run();                                         // accept clients until asked to stop
+        static void requestStop(int signal);                // signal handler that stops the daemon
+};
@@ -0,0 +1,215 @@
+#include "Dedup.hpp"
+#include <cstring>
+using namespace std;
+
+/**
+ * @brief default constructor, dedup is off until it is enabled
+*/
+BlockDedup::BlockDedup() {
+    wanted = false;
+    enabled = false;
+    dirty = false;
+    reset();
+}
+
+/**
+ * @brief hash the contents of a block with 64 bit fnv-1a, a word at a time, folded to the 32 bits the table keeps
+ * @param data - the BLOCK_SIZE bytes of the block
+ * @return uint32_t - the hash
+*/
+uint32_t BlockDedup::hash(const uint8_t *data) {
+    uint64_t value = 14695981039346656037ull;
+    for (size_t i = 0; i < BLOCK_SIZE; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        value = (value ^ word) * 1099511628211ull;
+    }
+    return (uint32_t)(value ^ (value >> 32));
+}
+
+/**
+ * @brief read the slots of a stored table, a table is only used if every block that another block shares
+ * is in its own slot
+ * @param block - the block of the disk file the table is kept in
+ * @param slots - set to the slot of each block
+ * @return bool - false if the block isn't a table
+*/
+bool BlockDedup::readSlots(const char block[BLOCK_SIZE], int slots[NUM_BLOCKS]) {
+    DedupTable table;
+    memcpy(&table, block, sizeof(table));
+    if (memcmp(table.magic, DEDUP_MAGIC, sizeof(DEDUP_MAGIC)) != 0) {
+        return false;
+    }
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+        if (table.slots[i] >= NUM_BLOCKS || table.slots[table.slots[i]] != table.slots[i]) {
+            return false;
+        }
+        slots[i] = table.slots[i];
+    }
+    return true;
+}
+
+/**
+ * @brief find a slot that is in use and has contents with the hash, the caller still has to compare the contents
+ * @return int - the slot, or -1 if there is none
+*/
+int BlockDedup::find(uint32_t hash) {
+    unordered_map<uint32_t, int>::iterator it = index.find(hash);
+    if (it == index.end()) {
+        return -1;
+    }
+    int at = it->second;
+    // the entry is left behind when its slot changes, it is only right while the slot still has those contents
+    if (refs[at] == 0 || !holds(at, hash)) {
+        index.erase(it);
+        return -1;
+    }
+    return at;
+}
+
+/**
+ * @brief find another block that shares a block's slot
+ * @return int - the block, or -1 if only the block itself uses its slot
+*/
+int BlockDedup::sharer(int block) {
+    if (slot[block] != block || refs[block] < 2) {
+        return -1;
+    }
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+        if (i != block && slot[i] == block) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief remember the hash of a slot that was read, so later writes of the same contents can share it
+*/
+void BlockDedup::learn(int at, uint32_t hash) {
+    if (known[at]) {
+        return;
+    }
+    known[at] = true;
+    hashes[at] = hash;
+    if (find(hash) == -1) {
+        index[hash] = at;
+    }
+}
+
+/**
+ * @brief a slot's contents were copied to another block's slot so the slot can be overwritten,
+ * every block that shared the slot other than its own block uses the copy from now on
+ * @param from - the slot that was copied, its block keeps it
+ * @param to - the slot of one of the blocks that shared it, no block uses it
+*/
+void BlockDedup::moveSlot(int from, int to) {
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+        if (i != from && slot[i] == from) {
+            slot[i] = to;
+        }
+    }
+    refs[to] = refs[from] - 1;
+    refs[from] = 1;
+    dirty = true;
+    known[to] = known[from];
+    hashes[to] = hashes[from];
+    if (known[to]) {
+        index[hashes[to]] = to;
+    }
+}
+
+/**
+ * @brief take a block out of the slot it uses before it gets new contents, the block has to be the only one using
+ * its own slot. its own slot keeps the hash of what is still in it, which is only used if the new contents match
+*/
+void BlockDedup::release(int block) {
+    refs[slot[block]]--;
+    dirty = dirty || slot[block] != block;
+    slot[block] = block;
+}
+
+/**
+ * @brief make a block use a slot that has the same contents as it
+*/
+void BlockDedup::share(int block, int at) {
+    slot[block] = at;
+    refs[at]++;
+    dirty = true;
+}
+
+/**
+ * @brief make a block use its own slot, which has contents with the hash
+*/
+void BlockDedup::store(int block, uint32_t hash) {
+    // the hashes are only hints checked against the contents, so only a change of slot has to be written
+    dirty = dirty || slot[block] != block;
+    slot[block] = block;
+    refs[block] = 1;
+    known[block] = true;
+    hashes[block] = hash;
+    if (find(hash) == -1) {
+        index[hash] = block;
+    }
+}
+
+/**
+ * @brief start on a disk that was just mounted, its blocks are shared the way its stored table says, a disk
+ * without one has every block in its own slot and only gets a table if dedup is on
+ * @param block - the block of the disk file the table is kept in
+ * @param canShare - false for a compressed image, which has no room past the end of the disk for a table
+*/
+void BlockDedup::load(const char block[BLOCK_SIZE], bool canShare) {
+    reset();
+    dirty = false;
+    int slots[NUM_BLOCKS];
+    if (!canShare || !readSlots(block, slots)) {
+        enabled = wanted && canShare;
+        return;
+    }
+    enabled = true;
+    DedupTable table;
+    memcpy(&table, block, sizeof(table));
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+        if (slots[i] != i) {
+            refs[i]--;
+            share(i, slots[i]);
+        }
+    }
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+        if (table.known[i]) {
+            learn(i, table.hashes[i]);
+        }
+    }
+    dirty = false;
+}
+
+/**
+ * @brief the table as it is stored in the disk file
+ * @param block - where the table is written to
+*/
+void BlockDedup::save(char block[BLOCK_SIZE]) {
+    DedupTable table;
+    memset(block, 0, BLOCK_SIZE);
+    memcpy(table.magic, DEDUP_MAGIC, sizeof(DEDUP_MAGIC));
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+        table.slots[i] = slot[i];
+        table.known[i] = known[i];
+        table.hashes[i] = known[i] ? hashes[i] : 0;
+    }
+    memcpy(block, &table, sizeof(table));
+    dirty = false;
+}
+
+/**
+ * @brief put every block back in its own slot and forget every hash, the shared blocks have to be copied first
+*/
+void BlockDedup::reset() {
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+        slot[i] = i;
+        refs[i] = 1;
+        known[i] = false;
+        hashes[i] = 0;
+    }
+    index.clear();
+}
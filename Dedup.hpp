@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <unordered_map>
+#include "Constants.hpp"
+using namespace std;
+
+/**
+ * the dedup table as it is stored in the disk file, the rest of the block is zeros
+*/
+struct DedupTable {
+    char magic[8];                      // DEDUP_MAGIC
+    uint8_t slots[NUM_BLOCKS];          // the slot each block's contents are stored in
+    uint8_t known[NUM_BLOCKS];          // 1 if the hash of a slot is known
+    uint32_t hashes[NUM_BLOCKS];        // the hash of what is in each slot
+};
+
+/**
+ * the content index of a disk with dedup on, every block of the disk has its own slot in the disk file, the
+ * place it is normally stored, but a block written with the same contents as a block already stored shares that
+ * block's slot instead and the write is only a change to this table. a slot that is shared is copied to one of
+ * the blocks sharing it before it is overwritten. the table is kept in the disk file at DEDUP_MAP_BLOCK, so a
+ * disk that has one is read through it whether dedup is on or not
+*/
+class BlockDedup {
+    private:
+        bool wanted;                                    // if disks without a table get one
+        bool enabled;                                   // if the mounted disk's blocks are shared at all
+        bool dirty;                                     // if the table changed since it was written to the disk
+        int slot[NUM_BLOCKS];                           // the slot each block's contents are stored in
+        int refs[NUM_BLOCKS];                           // the blocks whose contents are in each slot
+        uint32_t hashes[NUM_BLOCKS];                    // the hash of what is in each slot
+        bool known[NUM_BLOCKS];                         // if the hash of a slot is known
+        unordered_map<uint32_t, int> index;             // a slot with the contents of each hash, checked before it is used
+    public:
+        BlockDedup();                                   // default constructor, dedup is off
+        static uint32_t hash(const uint8_t *data);      // hash the contents of a block
+        static bool readSlots(const char block[BLOCK_SIZE], int slots[NUM_BLOCKS]);     // the slots a stored table has, false if it isn't one
+        void enable() { wanted = true; }
+        bool isEnabled() { return enabled; }
+        bool isDirty() { return dirty; }
+        int slotOf(int block) { return slot[block]; }   // the slot the contents of a block are in
+        bool holds(int at, uint32_t hash) { return known[at] && hashes[at] == hash; }    // if a slot is known to have contents with the hash
+        int find(uint32_t hash);                        // a slot in use with contents with the hash, -1 if there is none
+        int sharer(int block);                          // a block sharing the block's slot, -1 if no other block uses it
+        void learn(int at, uint32_t hash);              // the hash of what was read from a slot
+        void moveSlot(int from, int to);                // the contents of a slot were copied to another, its other blocks use that
+        void release(int block);                        // the block is getting new contents, no other block may share its slot
+        void share(int block, int at);                  // the block has the contents of another slot
+        void store(int block, uint32_t hash);           // the block's own slot has its contents, with the hash
+        void load(const char block[BLOCK_SIZE], bool canShare);    // start on a newly mounted disk from its stored table
+        void save(char block[BLOCK_SIZE]);              // the table as it is stored, it isn't dirty anymore
+        void reset();                                   // every block back in its own slot, nothing known
+};
@@ -0,0 +1,110 @@
+#include "Encoding.hpp"
+using namespace std;
+
+/**
+ * @brief the value of a hex digit
+ * @return int - the value, -1 if it isn't a hex digit
+*/
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @brief the value of a base64 character
+ * @return int - the value, -1 if it isn't a base64 character
+*/
+static int base64Value(char c) {
+    if (c >= 'A' && c <= 'Z') {
+        return c - 'A';
+    }
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 26;
+    }
+    if (c >= '0' && c <= '9') {
+        return c - '0' + 52;
+    }
+    if (c == '+') {
+        return 62;
+    }
+    if (c == '/') {
+        return 63;
+    }
+    return -1;
+}
+
+/**
+ * @brief check that inline buffer data is valid and find out how many bytes it decodes to
+ * hex needs an even number of digits, base64 needs whole groups of 4 with at most 2 padding characters at the end
+ * @param data - the encoded data
+ * @param encoding - ENCODING_HEX or ENCODING_BASE64
+ * @param length - set to the number of decoded bytes
+ * @return bool - false if the data isn't valid for the encoding
+*/
+bool decodedLength(string_view data, int encoding, size_t &length) {
+    if (encoding == ENCODING_HEX) {
+        if (data.length() % 2 != 0) {
+            return false;
+        }
+        for (char c : data) {
+            if (hexValue(c) == -1) {
+                return false;
+            }
+        }
+        length = data.length() / 2;
+        return true;
+    }
+    if (data.length() % 4 != 0) {
+        return false;
+    }
+    size_t padding = 0;
+    while (padding < 2 && padding < data.length() && data[data.length() - 1 - padding] == '=') {
+        padding++;
+    }
+    for (size_t i = 0; i < data.length() - padding; i++) {
+        if (base64Value(data[i]) == -1) {
+            return false;
+        }
+    }
+    length = data.length() / 4 * 3 - padding;
+    return true;
+}
+
+/**
+ * @brief decode inline buffer data that decodedLength accepted
+ * @param data - the encoded data
+ * @param encoding - ENCODING_HEX or ENCODING_BASE64
+ * @param out - where the bytes go, it has to hold the decoded length
+*/
+void decode(string_view data, int encoding, uint8_t *out) {
+    if (encoding == ENCODING_HEX) {
+        for (size_t i = 0; i < data.length(); i += 2) {
+            *out++ = (uint8_t)(hexValue(data[i]) << 4 | hexValue(data[i + 1]));
+        }
+        return;
+    }
+    for (size_t i = 0; i < data.length(); i += 4) {
+        uint32_t group = 0;
+        int bytes = 3;
+        for (size_t j = 0; j < 4; j++) {
+            int value = base64Value(data[i + j]);
+            if (value == -1) {
+                // padding, the group has one less byte for each
+                value = 0;
+                bytes--;
+            }
+            group = group << 6 | value;
+        }
+        for (int j = 0; j < bytes; j++) {
+            *out++ = (uint8_t)(group >> (16 - 8 * j));
+        }
+    }
+}
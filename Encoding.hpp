@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+#include <string_view>
+#include "Constants.hpp"
+using namespace std;
+
+bool decodedLength(string_view data, int encoding, size_t &length);    // check inline buffer data and get the number of bytes it holds
+void decode(string_view data, int encoding, uint8_t *out);             // decode checked inline buffer data
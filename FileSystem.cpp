@@ -4,6 +4,9 @@
 #include <vector>
 #include <cstdio>
 #include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <cstring>
 using namespace std;
 
 /**
@@ -15,9 +18,395 @@ struct defragSorter {
     }
 };
 
+// the session whose call is running on this thread, the disk accesses it makes are traced with its command and line
+static thread_local Session *tracedSession = nullptr;
+
 FileSystem::FileSystem() {
     diskIsMounted = false;
+    autoDefrag = false;
+    defragInProgress = false;
+    defragThreshold = DEFRAG_THRESHOLD;
+    defragStepBlocks = DEFRAG_STEP_BLOCKS;
+    defragBudget = DEFRAG_TIME_BUDGET_US;
+    localityDefrag = false;
+    extentFiles = false;
+    backwardGrowth = false;
+    preallocBlocks = 0;
+    forgetTails();
+    forgetReadAhead();
+    fill(accessCount, accessCount + NUM_NODES, 0);
+    mountCount = 0;
     superBlock = SuperBlock();
+    superBlock.setStats(&stats);
+}
+
+///////////////////////////////////////////////////
+// Library API
+///////////////////////////////////////////////////
+
+/**
+ * @brief checks a file or directory name could be used by a command
+ * @return bool - true if the name isn't empty and no longer than 5 characters
+*/
+static bool validName(const string &name) {
+    return !name.empty() && name.length() <= MAX_NAME_LEN;
+}
+
+/**
+ * @brief mount a disk, a disk that was mounted recently is switched back to without reading it again
+ * @param session - the session making the call, it starts in the root directory of the new disk
+ * @param diskName - the path of the disk file
+ * @return FsError - FS_DISK_NOT_FOUND, or one of the inconsistent disk errors if the disk fails the consistency check
+*/
+FsError FileSystem::mount(Session &session, const string &diskName) {
+    if (diskName.empty()) {
+        return FS_INVALID_ARGUMENT;
+    }
+    unique_lock<shared_mutex> guard(diskLock);
+    tracedSession = &session;
+    FsError error = fs_mount(session, diskName);
+    attach(session);
+    return error;
+}
+
+/**
+ * @brief create a file in the session's working directory
+ * @param name - the name of the file, at most 5 characters
+ * @param size - the number of blocks of the file, 0 creates a directory
+ * @return FsError - FS_NO_FREE_NODE, FS_NAME_EXISTS or FS_NO_SPACE if it can't be created
+*/
+FsError FileSystem::create(Session &session, const string &name, int size) {
+    if (!validName(name) || size < 0 || size > NUM_NODES) {
+        return FS_INVALID_ARGUMENT;
+    }
+    unique_lock<shared_mutex> guard(diskLock);
+    FsError error = attach(session);
+    if (error == FS_OK) {
+        // the super block reports blocks it is asked to set twice on the caller's error stream
+        superBlock.setErrorStream(*session.err);
+        error = fs_create(session, name, size);
+        flushDisk();
+    }
+    return error;
+}
+
+/**
+ * @brief delete a file, or a directory and everything in it, from the session's working directory
+ * @param name - the name of the file or directory
+ * @return FsError - FS_NOT_FOUND if there is nothing with that name
+*/
+FsError FileSystem::remove(Session &session, const string &name) {
+    if (!validName(name)) {
+        return FS_INVALID_ARGUMENT;
+    }
+    unique_lock<shared_mutex> guard(diskLock);
+    FsError error = attach(session);
+    if (error == FS_OK) {
+        superBlock.setErrorStream(*session.err);
+        error = fs_delete(session, name);
+        flushDisk();
+    }
+    return error;
+}
+
+/**
+ * @brief checks the size of the data of a read or write
+ * @return bool - true if it isn't empty and fits in the largest file
+*/
+static bool validLength(size_t length) {
+    return length > 0 && length <= MAX_BUFFER_BLOCKS * BLOCK_SIZE;
+}
+
+/**
+ * @brief the number of blocks some data covers
+*/
+static int blocksFor(size_t length) {
+    return (length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+/**
+ * @brief read blocks of a file, reads run at the same time as other sessions' reads
+ * a span bigger than a block reads the blocks after the first one too, all in one read
+ * @param name - the name of the file in the session's working directory
+ * @param block - the index of the first block within the file
+ * @param data - where the blocks go, every block it covers has to be in the file
+ * @return FsError - FS_NOT_FOUND, FS_NO_SUCH_BLOCK or FS_IO_ERROR
+*/
+FsError FileSystem::read(Session &session, const string &name, int block, span<uint8_t> data) {
+    if (!validName(name) || block < 0 || (size_t)block > MAX_BLOCK_NUM || !validLength(data.size())) {
+        return FS_INVALID_ARGUMENT;
+    }
+    shared_lock<shared_mutex> guard(diskLock);
+    FsError error = attach(session);
+    if (error == FS_OK) {
+        error = fs_read(session, name, block, data.data(), data.size());
+    }
+    return error;
+}
+
+/**
+ * @brief write blocks of a file
+ * a span bigger than a block writes the blocks after the first one too, all in one write
+ * @param name - the name of the file in the session's working directory
+ * @param block - the index of the first block within the file
+ * @param data - the contents of the blocks, if it ends part way through a block the rest of it is zeroed
+ * @return FsError - FS_NOT_FOUND, FS_NO_SUCH_BLOCK or FS_IO_ERROR
+*/
+FsError FileSystem::write(Session &session, const string &name, int block, span<const uint8_t> data) {
+    if (!validName(name) || block < 0 || (size_t)block > MAX_BLOCK_NUM || !validLength(data.size())) {
+        return FS_INVALID_ARGUMENT;
+    }
+    unique_lock<shared_mutex> guard(diskLock);
+    FsError error = attach(session);
+    if (error == FS_OK) {
+        superBlock.setErrorStream(*session.err);
+        error = fs_write(session, name, block, data.data(), data.size());
+        flushDisk();
+    }
+    return error;
+}
+
+/**
+ * @brief check that a write would succeed without writing anything
+ * @param name - the name of the file in the session's working directory
+ * @param block - the index of the first block within the file
+ * @param blocks - the number of blocks the write covers
+ * @return FsError - the error the write would return
+*/
+FsError FileSystem::checkWrite(Session &session, const string &name, int block, int blocks) {
+    if (!validName(name) || block < 0 || (size_t)block > MAX_BLOCK_NUM || blocks < 1 || (size_t)blocks > MAX_BUFFER_BLOCKS) {
+        return FS_INVALID_ARGUMENT;
+    }
+    shared_lock<shared_mutex> guard(diskLock);
+    FsError error = attach(session);
+    if (error == FS_OK) {
+        uint8_t index;
+        vector<BlockRun> ranges;
+        error = findBlock(session, name, block, blocks, index, ranges);
+    }
+    return error;
+}
+
+/**
+ * @brief change the number of blocks of a file, moving it if it can't grow where it is
+ * @param name - the name of the file in the session's working directory
+ * @param size - the new number of blocks
+ * @return FsError - FS_NOT_FOUND, or FS_NO_SPACE if it can't be made that big
+*/
+FsError FileSystem::resize(Session &session, const string &name, int size) {
+    if (!validName(name) || size < (int)MIN_BLOCK_NUM || (size_t)size > MAX_BLOCK_NUM) {
+        return FS_INVALID_ARGUMENT;
+    }
+    unique_lock<shared_mutex> guard(diskLock);
+    FsError error = attach(session);
+    if (error == FS_OK) {
+        superBlock.setErrorStream(*session.err);
+        error = fs_resize(session, name, size);
+        flushDisk();
+    }
+    return error;
+}
+
+/**
+ * @brief move every file down to the lowest free block it can start at
+ * @return FsError - FS_NOT_MOUNTED if there is no disk
+*/
+FsError FileSystem::defrag(Session &session) {
+    unique_lock<shared_mutex> guard(diskLock);
+    FsError error = attach(session);
+    if (error == FS_OK) {
+        superBlock.setErrorStream(*session.err);
+        error = fs_defrag();
+        flushDisk();
+    }
+    return error;
+}
+
+/**
+ * @brief pack the files so each directory's files are next to each other
+ * @param seekBefore - set to the average seek distance of a directory scan before the defrag
+ * @param seekAfter - set to the average seek distance of a directory scan after the defrag
+ * @return FsError - FS_NOT_MOUNTED if there is no disk
+*/
+FsError FileSystem::defragLocality(Session &session, double &seekBefore, double &seekAfter) {
+    unique_lock<shared_mutex> guard(diskLock);
+    FsError error = attach(session);
+    if (error == FS_OK) {
+        superBlock.setErrorStream(*session.err);
+        error = fs_defragLocality(seekBefore, seekAfter);
+        flushDisk();
+    }
+    return error;
+}
+
+/**
+ * @brief change the session's working directory
+ * @param name - a directory in the working directory, "." or ".."
+ * @return FsError - FS_NOT_FOUND if there is no such directory
+*/
+FsError FileSystem::changeDirectory(Session &session, const string &name) {
+    if (!validName(name)) {
+        return FS_INVALID_ARGUMENT;
+    }
+    shared_lock<shared_mutex> guard(diskLock);
+    FsError error = attach(session);
+    if (error == FS_OK) {
+        error = fs_cd(session, name);
+    }
+    return error;
+}
+
+/**
+ * @brief list the session's working directory
+ * this only needs the shared lock unless the directory map has to be rebuilt first
+ * @param entries - filled with ".", ".." and then every file and directory in listing order
+ * @return FsError - FS_NOT_MOUNTED if there is no disk
+*/
+FsError FileSystem::list(Session &session, vector<DirEntry> &entries) {
+    {
+        shared_lock<shared_mutex> guard(diskLock);
+        if (!superBlock.directoryMapOutOfDate()) {
+            FsError error = attach(session);
+            return error == FS_OK ? fs_ls(session, entries) : error;
+        }
+    }
+    unique_lock<shared_mutex> guard(diskLock);
+    FsError error = attach(session);
+    return error == FS_OK ? fs_ls(session, entries) : error;
+}
+
+/**
+ * @brief map which file owns each block of the disk, a mark is left in the trace so the map can be lined up with it
+ * @param map - set to one character per block, MAP_SUPER_BLOCK, MAP_FREE, MAP_ORPHAN for a block that is
+ * marked used but isn't in any file, MAP_EXTENT_BLOCK for the extent block of a file, MAP_RESERVED for a block
+ * reserved for a file to grow into, or the symbol of the file that has it
+ * @param extents - set to the runs of the files in the order they start on the disk, with their symbols
+ * @return FsError - FS_NOT_MOUNTED if there is no disk
+*/
+FsError FileSystem::blockMap(Session &session, string &map, vector<Extent> &extents) {
+    shared_lock<shared_mutex> guard(diskLock);
+    FsError error = attach(session);
+    if (error != FS_OK) {
+        return error;
+    }
+    map.assign(NUM_BLOCKS, MAP_FREE);
+    map[0] = MAP_SUPER_BLOCK;
+    for (int i = MIN_BLOCK_NUM; i < NUM_BLOCKS; i++) {
+        if (!superBlock.isFreeRange(i, i)) {
+            map[i] = MAP_ORPHAN;
+        }
+    }
+    // a file with an extent block has an entry for each of its runs, all with the same symbol
+    vector<pair<int, Extent>> owned;
+    for (int i = 0; i < NUM_NODES; i++) {
+        Inode node = superBlock.getNode(i);
+        if (node.nodeInUse() && node.isAFile()) {
+            for (BlockRun run : superBlock.getRuns(i)) {
+                owned.push_back({i, {0, node.getName(), run.start, run.length}});
+            }
+            if (node.hasExtentBlock()) {
+                map[node.getExtentBlock()] = MAP_EXTENT_BLOCK;
+            }
+        }
+        for (int b = reservedTail[i].start; b < reservedTail[i].start + reservedTail[i].length; b++) {
+            map[b] = MAP_RESERVED;
+        }
+    }
+    stable_sort(owned.begin(), owned.end(), [](const pair<int, Extent> &a, const pair<int, Extent> &b) {
+        return a.second.start < b.second.start;
+    });
+    int symbolOf[NUM_NODES];
+    fill(symbolOf, symbolOf + NUM_NODES, -1);
+    int files = 0;
+    extents.clear();
+    for (auto &[index, extent] : owned) {
+        if (symbolOf[index] == -1) {
+            symbolOf[index] = files++;
+        }
+        extent.symbol = MAP_SYMBOLS[symbolOf[index] % MAP_SYMBOLS.size()];
+        for (int b = extent.start; b < extent.start + extent.blocks && b < NUM_BLOCKS; b++) {
+            map[b] = extent.symbol;
+        }
+        extents.push_back(extent);
+    }
+    traceIo(TRACE_MARK, 0, 0);
+    return FS_OK;
+}
+
+/**
+ * @brief take a snapshot of the mounted disk, later writes go to an overlay until the disk is rolled back to it
+ * or another disk is mounted, which writes them to the disk and removes every snapshot
+ * @return FsError - FS_NOT_MOUNTED, or FS_SNAPSHOT_FAILED if the overlay file can't be made
+*/
+FsError FileSystem::snapshot(Session &session) {
+    unique_lock<shared_mutex> guard(diskLock);
+    FsError error = attach(session);
+    if (error == FS_OK && !snapshots.take(currentDiskName)) {
+        error = FS_SNAPSHOT_FAILED;
+    }
+    return error;
+}
+
+/**
+ * @brief put the mounted disk back the way it was when the latest snapshot was taken and remove that snapshot
+ * the super block is read back through the overlay so it is the one the snapshot has, and like a mount every
+ * session goes back to the root directory since its working directory might not exist anymore
+ * @return FsError - FS_NOT_MOUNTED, FS_NO_SNAPSHOT if the disk has no snapshot, or FS_IO_ERROR if the overlay
+ * file can't be cut back to it
+*/
+FsError FileSystem::rollback(Session &session) {
+    unique_lock<shared_mutex> guard(diskLock);
+    FsError error = attach(session);
+    if (error != FS_OK) {
+        return error;
+    }
+    if (snapshots.count() == 0) {
+        return FS_NO_SNAPSHOT;
+    }
+    if (!snapshots.rollback()) {
+        return FS_IO_ERROR;
+    }
+    char block[BLOCK_SIZE];
+    if (!readDisk(0, reinterpret_cast<uint8_t*>(block), BLOCK_SIZE)) {
+        return FS_IO_ERROR;
+    }
+    superBlock.load(block);
+    superBlock.fixFreeBlockList();
+    loadExtents();
+    superBlock.buildDirectoryMap();
+    // the blocks that changed back aren't known, so no block is known to be unwritten until it is written again
+    unwritten.reset();
+    forgetReadAhead();
+    defragInProgress = false;
+    fill(accessCount, accessCount + NUM_NODES, 0);
+    forgetTails();
+    mountCount++;
+    attach(session);
+    return FS_OK;
+}
+
+/**
+ * @brief checks if a disk is mounted
+ * @return bool - true once any disk has been mounted
+*/
+bool FileSystem::isMounted() {
+    return diskIsMounted;
+}
+
+/**
+ * @brief bring a session up to date with the mounted disk, called with the disk locked
+ * after a disk is mounted every session goes back to the root directory
+ * @return FsError - FS_NOT_MOUNTED if there is no disk
+*/
+FsError FileSystem::attach(Session &session) {
+    tracedSession = &session;
+    if (session.mountCount != mountCount) {
+        session.mountCount = mountCount;
+        session.currentDirectory = ROOT_DIR;
+        session.diskName = currentDiskName;
+        session.closeDisk();
+    }
+    return diskIsMounted ? FS_OK : FS_NOT_MOUNTED;
 }
 
 
@@ -25,237 +414,666 @@ FileSystem::FileSystem() {
 // Main File System Commands
 ///////////////////////////////////////////////////
 
+/**
+ * @brief read from a disk file stream, the part of a read past the end of the file was never written and reads
+ * as zeros. the stream is always left usable, a failure would otherwise make every later read and write fail too
+ * @param disk - the disk file
+ * @param pos - the byte offset in the file
+ * @param data - where the bytes are read to
+ * @param length - the number of bytes to read
+ * @return bool - false if the file can't be read
+*/
+static bool readStream(fstream &disk, long pos, uint8_t *data, size_t length) {
+    disk.seekg(pos);
+    disk.read(reinterpret_cast<char*>(data), length);
+    bool read = !disk.bad();
+    if (disk.fail()) {
+        size_t got = disk.gcount();
+        memset(data + got, 0, length - got);
+    }
+    disk.clear();
+    return read;
+}
+
+/**
+ * @brief write to a disk file stream, the stream is always left usable
+ * @param disk - the disk file
+ * @param pos - the byte offset in the file
+ * @param data - the bytes to write
+ * @param length - the number of bytes to write
+ * @return bool - false if the file can't be written
+*/
+static bool writeStream(fstream &disk, long pos, const uint8_t *data, size_t length) {
+    disk.seekg(pos);
+    disk.write(reinterpret_cast<const char*>(data), length);
+    bool written = !disk.fail();
+    disk.clear();
+    return written;
+}
+
+/**
+ * @brief read the slot of each block of a disk that is being mounted from its dedup table
+ * @param disk - the disk file
+ * @param slots - set to the slot of each block, its own if the disk has no dedup table
+*/
+static void readDedupSlots(fstream &disk, int slots[NUM_BLOCKS]) {
+    char block[BLOCK_SIZE] = {0};
+    disk.seekg((long)DEDUP_MAP_BLOCK * BLOCK_SIZE);
+    disk.read(block, BLOCK_SIZE);
+    disk.clear();
+    if (!BlockDedup::readSlots(block, slots)) {
+        for (int i = 0; i < NUM_BLOCKS; i++) {
+            slots[i] = i;
+        }
+    }
+}
+
+/**
+ * @brief read the extent blocks of a disk that is being mounted into its super block, the runs they list
+ * are part of the consistency check
+ * @param newSB - the super block of the disk
+ * @param disk - the disk file
+ * @param newImage - the image of the disk if it is compressed
+*/
+static void readExtentBlocks(SuperBlock &newSB, fstream &disk, CompressedImage &newImage) {
+    int slots[NUM_BLOCKS];
+    if (!newImage.isOpen()) {
+        readDedupSlots(disk, slots);
+    }
+    char block[BLOCK_SIZE];
+    for (int i = 0; i < NUM_NODES; i++) {
+        Inode node = newSB.getNode(i);
+        if (!node.hasExtentBlock()) {
+            continue;
+        }
+        memset(block, 0, BLOCK_SIZE);
+        if (newImage.isOpen()) {
+            // an extent block that can't be read lists no runs, which the consistency check finds
+            if (newImage.read(-1, node.getExtentBlock(), reinterpret_cast<uint8_t*>(block)) == -1) {
+                memset(block, 0, BLOCK_SIZE);
+            }
+        } else {
+            disk.seekg(slots[node.getExtentBlock()] * BLOCK_SIZE);
+            disk.read(block, BLOCK_SIZE);
+            disk.clear();
+        }
+        newSB.loadExtentBlock(i, block);
+    }
+}
+
 /**
  * @brief Mounts a disk into the file system
+ * disks that were mounted recently are still open in the mount table, if they haven't changed since
+ * they were switched away from they are mounted again without reading or checking the super block
  * @param new_disk_name - the name of the disk to be mounted
+ * @return FsError - FS_DISK_NOT_FOUND, FS_IO_ERROR or one of the inconsistent disk errors, the old disk stays mounted
+ * with its snapshots
 */
-void FileSystem::fs_mount(const string &new_disk_name) {
+FsError FileSystem::fs_mount(Session &session, const string &new_disk_name) {
+    std::list<MountedDisk>::iterator cached = findMountedDisk(new_disk_name);
+    if (cached != mountTable.end()) {
+        // the super block has been written since it was checked so it has to be checked again
+        if (!cached->verified) {
+            SuperBlock newSB = SuperBlock();
+            newSB.load(cached->superBlock);
+            newSB.fixFreeBlockList();
+            readExtentBlocks(newSB, cached->disk, cached->image);
+            int consistencyErrCode = newSB.checkConsistency();
+            if (consistencyErrCode != 0) {
+                return consistencyError(consistencyErrCode);
+            }
+            cached->verified = true;
+        }
+        // snapshots only last while their disk is mounted, the disk gets what was written since the first one
+        commitSnapshots();
+        MountedDisk mounted = move(*cached);
+        mountTable.erase(cached);
+        saveMountedDisk();
+        finishMount(new_disk_name, mounted.superBlock);
+        diskFile = move(mounted.disk);
+        image = move(mounted.image);
+        loadDedup();
+        loadExtents();
+        loadUnwritten();
+        return FS_OK;
+    }
 
     fstream newDisk;
     SuperBlock newSB = SuperBlock();
+    // mounting the same disk again reads it from the disk file, which has to have what was written since its snapshots
+    bool remount = diskIsMounted && new_disk_name == currentDiskName;
+    if (remount) {
+        commitSnapshots();
+    }
 
     newDisk.open(new_disk_name, ios::in | ios::out | ios::binary);
     if (!newDisk.is_open()) {
-        cerr << "Error: Cannot find disk: " << new_disk_name << endl;
-        return;
+        return FS_DISK_NOT_FOUND;
     }
     // read the first 1024 bytes into the super block
+    char block[BLOCK_SIZE] = {0};
     newDisk.seekg(0);
-    newDisk.read(reinterpret_cast<char*>(&newSB), sizeof(SuperBlock));
+    newDisk.read(block, BLOCK_SIZE);
+    CompressedImage newImage;
+    if (CompressedImage::isCompressed(block)) {
+        // the first block of a compressed image is its header, the super block is the first block stored in it
+        if (!newImage.open(new_disk_name)) {
+            return FS_DISK_NOT_FOUND;
+        }
+        if (newImage.read(-1, 0, reinterpret_cast<uint8_t*>(block)) == -1) {
+            return FS_IO_ERROR;
+        }
+    } else {
+        // with dedup the super block can share the slot of another block
+        int slots[NUM_BLOCKS];
+        readDedupSlots(newDisk, slots);
+        if (slots[0] != 0) {
+            newDisk.seekg((long)slots[0] * BLOCK_SIZE);
+            newDisk.read(block, BLOCK_SIZE);
+            newDisk.clear();
+        }
+    }
+    traceIo(TRACE_READ, 0, BLOCK_SIZE);
+    stats.count(STAT_SEEKS);
+    stats.count(STAT_BYTES_READ, BLOCK_SIZE);
+    newSB.load(block);
 
     newSB.fixFreeBlockList();
+    readExtentBlocks(newSB, newDisk, newImage);
     // check the consitency of the super block
     int consistencyErrCode = newSB.checkConsistency();
 
     if (consistencyErrCode != 0) {
-        cout << "Error: File system in " << new_disk_name << " is inconsistent (error code: " << consistencyErrCode << ")" << endl;
-        return;
-    } else {
-        diskIsMounted = true;
-        currentDiskName = new_disk_name;
-        currentDirectory = ROOT_DIR;
-        superBlock.buildDirectoryMap();
+        return consistencyError(consistencyErrCode);
     }
-    newDisk.seekg(0);
-    newDisk.read(reinterpret_cast<char*>(&superBlock), sizeof(SuperBlock));
-    superBlock.fixFreeBlockList();
+    if (!remount) {
+        commitSnapshots();
+        saveMountedDisk();
+    }
+    finishMount(new_disk_name, block);
     diskFile.close();
-    diskFile.open(new_disk_name, ios::in | ios::out | ios::binary);
+    newDisk.clear();
+    diskFile = move(newDisk);
+    image = move(newImage);
+    loadDedup();
+    loadExtents();
+    loadUnwritten();
+    // a snapshot overlay a crash left behind has writes that had returned, they are kept the way closing would have
+    if (snapshots.recover(new_disk_name)) {
+        commitSnapshots();
+        readDisk(0, reinterpret_cast<uint8_t*>(block), BLOCK_SIZE);
+        superBlock.load(block);
+        superBlock.fixFreeBlockList();
+        loadExtents();
+        loadUnwritten();
+    }
+    return FS_OK;
+}
+
+/**
+ * @brief reset the file system state for a newly mounted disk
+ * @param name - the name of the disk
+ * @param block - the first block of the disk, it has already passed the consistency check
+*/
+void FileSystem::finishMount(const string &name, const char block[BLOCK_SIZE]) {
+    diskIsMounted = true;
+    defragInProgress = false;
+    fill(accessCount, accessCount + NUM_NODES, 0);
+    forgetTails();
+    forgetReadAhead();
+    currentDiskName = name;
+    // sessions go back to the root directory before their next command
+    mountCount++;
+    superBlock.buildDirectoryMap();
+    memcpy(verifiedBlock, block, BLOCK_SIZE);
+    superBlock.load(block);
+    superBlock.fixFreeBlockList();
+}
+
+/**
+ * @brief move the mounted disk into the mount table so it can be mounted again quickly,
+ * the least recently mounted disk is closed if the table is full
+*/
+void FileSystem::saveMountedDisk() {
+    if (!diskIsMounted || !diskFile.is_open()) {
+        return;
+    }
+    MountedDisk mounted;
+    mounted.name = currentDiskName;
+    // keep the super block as it is on the disk, which is what mounting it again would read
+    flushDisk();
+    readDisk(0, reinterpret_cast<uint8_t*>(mounted.superBlock), BLOCK_SIZE);
+    traceIo(TRACE_READ, 0, BLOCK_SIZE);
+    stats.count(STAT_SEEKS);
+    stats.count(STAT_BYTES_READ, BLOCK_SIZE);
+    struct stat info;
+    if (!diskFile || stat(currentDiskName.c_str(), &info) != 0) {
+        diskFile.close();
+        return;
+    }
+    mounted.verified = memcmp(mounted.superBlock, verifiedBlock, BLOCK_SIZE) == 0;
+    mounted.device = info.st_dev;
+    mounted.inode = info.st_ino;
+    mounted.modified = info.st_mtim;
+    mounted.size = info.st_size;
+    mounted.disk = move(diskFile);
+    mounted.image = move(image);
+
+    // an older entry for the same file is out of date now
+    for (std::list<MountedDisk>::iterator it = mountTable.begin(); it != mountTable.end();) {
+        if (it->name == mounted.name || (it->device == mounted.device && it->inode == mounted.inode)) {
+            it = mountTable.erase(it);
+        } else {
+            it++;
+        }
+    }
+    mountTable.push_front(move(mounted));
+    if (mountTable.size() > MOUNT_TABLE_SIZE) {
+        mountTable.pop_back();
+    }
+}
+
+/**
+ * @brief find a disk in the mount table, entries for disks that changed since they were saved are removed
+ * @param name - the name of the disk
+ * @return list<MountedDisk>::iterator - the disk, or the end of the table if it isn't there
+*/
+std::list<MountedDisk>::iterator FileSystem::findMountedDisk(const string &name) {
+    for (std::list<MountedDisk>::iterator it = mountTable.begin(); it != mountTable.end(); it++) {
+        if (it->name != name) {
+            continue;
+        }
+        struct stat info;
+        struct stat current;
+        bool unchanged = stat(name.c_str(), &info) == 0
+            && info.st_dev == it->device && info.st_ino == it->inode && info.st_size == it->size
+            && info.st_mtim.tv_sec == it->modified.tv_sec && info.st_mtim.tv_nsec == it->modified.tv_nsec;
+        // the mounted disk might be the same file under another name, and has been written since
+        bool aliased = diskIsMounted && stat(currentDiskName.c_str(), &current) == 0
+            && current.st_dev == info.st_dev && current.st_ino == info.st_ino;
+        if (unchanged && !aliased) {
+            return it;
+        }
+        mountTable.erase(it);
+        break;
+    }
+    return mountTable.end();
 }
 
 /**
  * @brief Create a new file or directory on the disk
  * @param name - the name of the new file/dir
  * @param size - if creating a file size is the number of block that the file has reserved
+ * @return FsError - FS_NO_FREE_NODE, FS_NAME_EXISTS or FS_NO_SPACE
 */
-void FileSystem::fs_create(const string &name, int size) {
+FsError FileSystem::fs_create(Session &session, const string &name, int size) {
     // find the index of the first free inode
     int freeIndex = superBlock.findFreeNode();
     if (freeIndex == -1) {
-        cerr << "Error: Superblock in disk " << currentDiskName << " is full, cannot create " << name << endl;
-        return;
+        return FS_NO_FREE_NODE;
     }
-    if (!superBlock.validNewName(name, currentDirectory)) {
-        cerr << "Error: File or directory " << name << " already exists" << endl;
-        return;
+    if (!superBlock.validNewName(name, session.currentDirectory)) {
+        return FS_NAME_EXISTS;
     }
     int startBlock = 0;
     if (size != 0) {
         startBlock = superBlock.findContigBlock(size);
+        // blocks reserved for other files to grow into are given back before a create fails
+        if (startBlock == -1 && reclaimTails()) {
+            startBlock = superBlock.findContigBlock(size);
+        }
         if (startBlock == -1) {
-            cerr << "Error: cannot allocate " << size << " on " <<currentDiskName << endl;
-            return;
+            return FS_NO_SPACE;
         }
     }
-    Inode newNode = Inode(name, size, startBlock, currentDirectory);
+    Inode newNode = Inode(name, size, startBlock, session.currentDirectory);
     superBlock.setNode(newNode, freeIndex);
+    accessCount[freeIndex] = 0;
+    growCount[freeIndex] = 0;
     superBlock.setBlock(startBlock, startBlock + (size - 1));
     // rebuild the directory map
     superBlock.buildDirectoryMap();
     writeSB();
+    return FS_OK;
 }
 
 /**
  * @brief delete a node or dir from the disk
  * @param name - the name of the node to be deleted
+ * @return FsError - FS_NOT_FOUND if there is no node with the name
 */
-void FileSystem::fs_delete(const string &name) {
-    uint8_t buf[BLOCK_SIZE];
-    // making sure everything is zeroed out
-    for (size_t i = 0; i < BLOCK_SIZE; i++) {
-        buf[i] = 0;
+FsError FileSystem::fs_delete(Session &session, const string &name) {
+    int index = superBlock.getInodeIndex(name, session.currentDirectory);
+    if (index == INVALID_NODE_NUM) {
+        // the directory map is still rebuilt and written like any other delete
+        superBlock.buildDirectoryMap();
+        writeSB();
+        return FS_NOT_FOUND;
     }
-    int index = superBlock.getInodeIndex(name, currentDirectory);
-    Inode node = superBlock.getNode(index);
-    int pos = node.getStartBlock() * BLOCK_SIZE;
+    releaseTail(index);
     // zero out the data blocks
-    for (int i = 0; i < node.getUsedSize(); i++) {
-        diskFile.seekg(pos);
-        diskFile.write(reinterpret_cast<char*>(&buf), BLOCK_SIZE);
-        pos += BLOCK_SIZE;
-    }
-    superBlock.deleteNode(name, currentDirectory);
+    int zeroed = zeroFile(index);
+    stats.count(STAT_SEEKS, zeroed);
+    stats.count(STAT_BYTES_WRITTEN, zeroed * BLOCK_SIZE);
+    superBlock.deleteNode(name, session.currentDirectory);
     superBlock.buildDirectoryMap();
     writeSB();
+    return FS_OK;
 }
 
 /**
- * @brief read the block_num'th block of the given file into the global buffer
+ * @brief read the block_num'th block of the given file, and the blocks after it if length covers them
  * @param name - the name of the file to read from
  * @param block_num - the index of the block to read from w.r.t the first block of the file
+ * @param data - where the blocks are read to
+ * @param length - the number of bytes to read
+ * @return FsError - FS_NOT_FOUND, FS_NO_SUCH_BLOCK, or FS_IO_ERROR if the disk file can't be read
 */
-void FileSystem::fs_read(const string &name, int block_num) {
-    uint8_t index = superBlock.getInodeIndex(name, currentDirectory);
-    Inode node = superBlock.getNode(index);
-    if (index == INVALID_NODE_NUM || !node.isAFile()) {
-        cerr << "Error: File" << name << " does not exist" << endl;
-        return;
+FsError FileSystem::fs_read(Session &session, const string &name, int block_num, uint8_t *data, size_t length) {
+    uint8_t index;
+    vector<BlockRun> ranges;
+    FsError error = findBlock(session, name, block_num, blocksFor(length), index, ranges);
+    if (error != FS_OK) {
+        return error;
     }
-    int size = node.getUsedSize();
-    if (block_num < 0 || block_num > size - 1) {
-        cerr << "Error: " << name << " does not have block " << block_num << endl;
-        return;
+    // each session reads with its own descriptor so reads don't share a file position and can run at the same time
+    if (session.diskFd == -1) {
+        session.diskFd = open(currentDiskName.c_str(), O_RDONLY);
+        if (session.diskFd == -1) {
+            return FS_IO_ERROR;
+        }
     }
-    int start = node.getStartBlock();
-    int blockToRead = (start+block_num) * BLOCK_SIZE;
-    diskFile.seekg(blockToRead);
-    diskFile.read(reinterpret_cast<char*>(buffer), MAX_BUFF_LEN);
+    // a read in one run is copied from the blocks read ahead if they have it, a sequential one reads ahead itself
+    int ahead = 0;
+    if (ranges.size() == 1 && readAheadHit(index, block_num, ranges[0], data, length, ahead)) {
+        accessCount[index]++;
+        return FS_OK;
+    }
+    stats.count(STAT_READAHEAD_MISSES, blocksFor(length));
+    if (ahead > 0) {
+        vector<uint8_t> blocks((blocksFor(length) + ahead) * BLOCK_SIZE);
+        if (!readRun(session.diskFd, ranges[0].start, blocks.data(), blocks.size())) {
+            return FS_IO_ERROR;
+        }
+        memcpy(data, blocks.data(), length);
+        stats.count(STAT_READAHEAD_BLOCKS, ahead);
+        fillReadAhead(index, ranges[0].start, blocks);
+        accessCount[index]++;
+        return FS_OK;
+    }
+    // one read for each run of the disk the blocks are in
+    size_t done = 0;
+    for (BlockRun range : ranges) {
+        size_t part = min(length - done, range.length * BLOCK_SIZE);
+        if (!readRun(session.diskFd, range.start, data + done, part)) {
+            return FS_IO_ERROR;
+        }
+        done += part;
+    }
+    accessCount[index]++;
+    return FS_OK;
 }
 
 /**
- * @brief writes the contents of the global buffer to the block_num'th block of the given file
- * @param name - the name of the file to write to
- * @param block_num - the index of the block to write to w.r.t to the first block of the file
+ * @brief read from a run of blocks of the disk in one access, the blocks never written at either end of it
+ * are left out and read as zeros
+ * @param fd - a read only descriptor of the disk file
+ * @param start - the first block of the run
+ * @param data - where the blocks are read to
+ * @param length - the number of bytes to read, the last block can be part of a block
+ * @return bool - false if the disk file can't be read
 */
-void FileSystem::fs_write(const string &name, int block_num) {
-    uint8_t index = superBlock.getInodeIndex(name, currentDirectory);
-    Inode node = superBlock.getNode(index);
-    if (index == INVALID_NODE_NUM || !node.isAFile()) {
-        cerr << "Error: " << name << " does not exist" << endl;
-        return;
+bool FileSystem::readRun(int fd, int start, uint8_t *data, size_t length) {
+    int first = start;
+    int count = blocksFor(length);
+    trimUnwritten(first, count);
+    stats.count(STAT_UNWRITTEN_READS, blocksFor(length) - count);
+    size_t skipped = (first - start) * BLOCK_SIZE;
+    size_t toRead = min(length - min(skipped, length), (size_t)count * BLOCK_SIZE);
+    if (toRead < length) {
+        memset(data, 0, length);
     }
-    int size = node.getUsedSize();
-    if (block_num < 0 || block_num > size - 1) {
-        cerr << "Error: " << name << " does not have block " << block_num << endl;
-        return;
+    if (count == 0) {
+        return true;
     }
-    int start = node.getStartBlock();
-    int blockToRead = (start+block_num) * BLOCK_SIZE;
-    diskFile.seekg(blockToRead);
-    diskFile.write(reinterpret_cast<char*>(buffer), MAX_BUFF_LEN);
-    superBlock.buildDirectoryMap();
-    writeSB();
+    long blockToRead = first * BLOCK_SIZE;
+    if (!readDiskAt(fd, blockToRead, data + skipped, toRead)) {
+        return false;
+    }
+    traceIo(TRACE_READ, blockToRead, toRead);
+    stats.count(STAT_SEEKS);
+    stats.count(STAT_BYTES_READ, toRead);
+    return true;
 }
 
 /**
- * @brief copies the contents of the passed buffer to the global buffer
- * @param buff - an int array holding the data to be written to the global buffer
+ * @brief copy a read from the blocks read ahead for the file if they have all of it, otherwise work out how
+ * far to read ahead. a read that starts where the last one of the file ended is sequential, each sequential
+ * read that misses doubles the window up to READ_AHEAD_MAX_BLOCKS and any other read that misses turns it off,
+ * it never reaches past the run of the file the read is in
+ * @param index - the index of the inode for this file
+ * @param block_num - the block of the file the read starts at
+ * @param range - the run of the disk the blocks of the read are in
+ * @param data - where the blocks are copied to
+ * @param length - the number of bytes to read
+ * @param ahead - set to the blocks to read after the blocks of the read when it misses
+ * @return bool - true if the read was copied
 */
-void FileSystem::fs_buff(uint8_t buff[MAX_BUFF_LEN]) {
-    // clear the buffer to ensure no garbage values exist
-    clearBuffer();
-    for (size_t i = 0; i < MAX_BUFF_LEN; i++) {
-        buffer[i] = buff[i];
+bool FileSystem::readAheadHit(uint8_t index, int block_num, BlockRun range, uint8_t *data, size_t length, int &ahead) {
+    lock_guard<mutex> guard(readAheadLock);
+    ReadAhead &state = readAhead[index];
+    int blocks = blocksFor(length);
+    bool sequential = block_num == state.next;
+    state.next = block_num + blocks;
+    if (state.blocks > 0 && range.start >= state.start && range.start + blocks <= state.start + state.blocks) {
+        memcpy(data, state.data.data() + (range.start - state.start) * BLOCK_SIZE, length);
+        stats.count(STAT_READAHEAD_HITS, blocks);
+        return true;
+    }
+    if (!sequential) {
+        state.window = 0;
+    } else {
+        state.window = state.window == 0 ? READ_AHEAD_MIN_BLOCKS : min(state.window * 2, READ_AHEAD_MAX_BLOCKS);
     }
+    int end = range.start + blocks;
+    for (BlockRun run : superBlock.getRuns(index)) {
+        if (run.start < end && end <= run.start + run.length) {
+            ahead = max(min(state.window, min(run.start + run.length, NUM_BLOCKS) - end), 0);
+        }
+    }
+    return false;
 }
 
+/**
+ * @brief keep the blocks of a read that read ahead as the blocks read ahead for the file
+ * @param index - the index of the inode for this file
+ * @param start - the block of the disk the blocks start at
+ * @param data - the contents of the blocks, moved into the cache
+*/
+void FileSystem::fillReadAhead(uint8_t index, int start, vector<uint8_t> &data) {
+    lock_guard<mutex> guard(readAheadLock);
+    ReadAhead &state = readAhead[index];
+    state.start = start;
+    state.blocks = data.size() / BLOCK_SIZE;
+    state.data = move(data);
+}
 
-// just sneaking these in here
-
-void printDir(const char* name, const int numChildren) {
-    // using printf so its easier to get the formating right
-    printf("%-5s %3d\n",name, numChildren);
+/**
+ * @brief drop the blocks read ahead for any file that a write changes, writes only happen while the disk is locked
+ * so no read is using them
+ * @param pos - the byte offset on the disk the write starts at
+ * @param length - the number of bytes written
+*/
+void FileSystem::dropReadAhead(long pos, size_t length) {
+    long first = pos / BLOCK_SIZE;
+    long last = (pos + length - 1) / BLOCK_SIZE;
+    for (ReadAhead &state : readAhead) {
+        if (state.blocks > 0 && state.start <= last && first < state.start + state.blocks) {
+            state.blocks = 0;
+            state.data.clear();
+        }
+    }
 }
 
-void printFile(const char* name, const int size) {
-    printf("%-5s %3d KB\n", name, size);
+/**
+ * @brief drop every block read ahead and forget how each file was being read, after the disk changed under them
+*/
+void FileSystem::forgetReadAhead() {
+    for (ReadAhead &state : readAhead) {
+        state = ReadAhead{-1, 0, 0, 0, {}};
+    }
 }
 
 /**
- * @brief prints the contents of the current working directory
+ * @brief writes to the block_num'th block of the given file, and the blocks after it if length covers them
+ * the whole blocks in each run of the file are written with one write
+ * @param name - the name of the file to write to
+ * @param block_num - the index of the block to write to w.r.t to the first block of the file
+ * @param data - the data to write
+ * @param length - the number of bytes to write, a partial last block is padded with zeros
+ * @return FsError - FS_NOT_FOUND, FS_NO_SUCH_BLOCK, or FS_IO_ERROR if a block can't be written
 */
-void FileSystem::fs_ls(void) {
+FsError FileSystem::fs_write(Session &session, const string &name, int block_num, const uint8_t *data, size_t length) {
+    uint8_t index;
+    vector<BlockRun> ranges;
+    FsError error = findBlock(session, name, block_num, blocksFor(length), index, ranges);
+    if (error != FS_OK) {
+        return error;
+    }
+    // one write for each run of the disk the blocks are in
+    size_t done = 0;
+    for (BlockRun range : ranges) {
+        long pos = range.start * BLOCK_SIZE;
+        size_t part = min(length - done, range.length * BLOCK_SIZE);
+        size_t whole = part / BLOCK_SIZE * BLOCK_SIZE;
+        bool written = writeDisk(pos, data + done, whole);
+        if (whole < part) {
+            uint8_t last[BLOCK_SIZE] = {0};
+            memcpy(last, data + done + whole, part - whole);
+            written = writeDisk(pos + whole, last, BLOCK_SIZE) && written;
+        }
+        if (!written) {
+            return FS_IO_ERROR;
+        }
+        traceIo(TRACE_WRITE, pos, blocksFor(part) * BLOCK_SIZE);
+        stats.count(STAT_SEEKS);
+        stats.count(STAT_BYTES_WRITTEN, blocksFor(part) * BLOCK_SIZE);
+        done += part;
+    }
+    accessCount[index]++;
     superBlock.buildDirectoryMap();
+    writeSB();
+    return FS_OK;
+}
+
+/**
+ * @brief find where on the disk blocks of a file are
+ * @param name - the name of the file
+ * @param block_num - the index of the block w.r.t to the first block of the file
+ * @param blocks - the number of blocks from block_num on that have to be in the file
+ * @param index - set to the index of the file's inode
+ * @param ranges - set to the runs of the disk the blocks are in, one unless the file has an extent block
+ * @return FsError - FS_NOT_FOUND or FS_NO_SUCH_BLOCK
+*/
+FsError FileSystem::findBlock(Session &session, const string &name, int block_num, int blocks, uint8_t &index, vector<BlockRun> &ranges) {
+    index = superBlock.getInodeIndex(name, session.currentDirectory);
+    if (index == INVALID_NODE_NUM) {
+        return FS_NOT_FOUND;
+    }
+    Inode node = superBlock.getNode(index);
+    if (!node.isAFile()) {
+        return FS_NOT_FOUND;
+    }
+    int size = node.getUsedSize();
+    if (block_num < 0 || block_num + blocks > size) {
+        return FS_NO_SUCH_BLOCK;
+    }
+    ranges.clear();
+    int logical = 0;
+    vector<BlockRun> runs = superBlock.getRuns(index);
+    for (BlockRun run : runs) {
+        int from = max(block_num, logical);
+        int to = min(block_num + blocks, logical + run.length);
+        if (from < to) {
+            ranges.push_back({run.start + from - logical, to - from});
+        }
+        logical += run.length;
+    }
+    // no blocks still has a position, where block_num would be if the file was one run
+    if (ranges.empty()) {
+        ranges.push_back({runs[0].start + block_num, 0});
+    }
+    return FS_OK;
+}
+
+/**
+ * @brief list the contents of the current working directory
+ * @param entries - filled with the entries of the cwd, starting with "." and ".."
+ * @return FsError - always FS_OK
+*/
+FsError FileSystem::fs_ls(Session &session, vector<DirEntry> &entries) {
+    if (superBlock.directoryMapOutOfDate()) {
+        superBlock.buildDirectoryMap();
+    }
+    entries.clear();
     // get the directory hierarchy of the disk
     map<uint8_t, vector<uint8_t>> directoryStructure = superBlock.getDirectoryMap();
-    vector<uint8_t> dirContents = directoryStructure[currentDirectory];
+    vector<uint8_t> dirContents = directoryStructure[session.currentDirectory];
     // size is always +2 due to "." and ".."
     int size = dirContents.size() + 2;
-    // print cwd
-    printDir(CUR_DIR_STRING.c_str(), size);
-    if (currentDirectory == ROOT_DIR) {
+    entries.push_back({CUR_DIR_STRING, true, size});
+    if (session.currentDirectory == ROOT_DIR) {
         // if in root directory "." == ".."
-        printDir(PARENT_DIR_STRING.c_str(), size);
+        entries.push_back({PARENT_DIR_STRING, true, size});
     } else {
-        // print parent directory if not in root
-        Inode node = superBlock.getNode(currentDirectory);
+        Inode node = superBlock.getNode(session.currentDirectory);
         uint8_t parent = node.getParent();
         vector<uint8_t> parentContents = directoryStructure[parent];
         int parentSize = parentContents.size() + 2;
-        printDir(PARENT_DIR_STRING.c_str(), parentSize);
+        entries.push_back({PARENT_DIR_STRING, true, parentSize});
     }
 
-    // print all files/dirs within the current working directory
+    // all files/dirs within the current working directory
     for (auto index : dirContents) {
         Inode node = superBlock.getNode(index);
         if (node.isAFile()) {
-            printFile(node.getName().c_str(), node.getUsedSize());
+            entries.push_back({node.getName(), false, node.getUsedSize()});
         } else {
             vector<uint8_t> childContents = directoryStructure[index];
             int childSize = childContents.size() + 2;
-            printDir(node.getName().c_str(), childSize);
+            entries.push_back({node.getName(), true, childSize});
         }
     }
+    return FS_OK;
 }
 
 /**
  * @brief resizes a file in on the disk
  * @param name - the name of the file to be resized
  * @param new_size - the new size of the file, can be smaller or bigger than original size
+ * @return FsError - FS_NOT_FOUND, or FS_NO_SPACE if the file can't grow
 */
-void FileSystem::fs_resize(const string &name, int new_size) {
-    uint8_t index = superBlock.getInodeIndex(name, currentDirectory);
-    Inode node = superBlock.getNode(index);
-    if ((size_t)new_size > MAX_BLOCK_NUM) {
-        cerr << "Error: File " << node.getName() << " cannot be expanded to size " << new_size << endl;
-        return;
+FsError FileSystem::fs_resize(Session &session, const string &name, int new_size) {
+    uint8_t index = superBlock.getInodeIndex(name, session.currentDirectory);
+    if (index == INVALID_NODE_NUM) {
+        return FS_NOT_FOUND;
     }
-    if (new_size == node.getUsedSize()) return;
-    if (index == INVALID_NODE_NUM || !node.isAFile()) {
-        cerr << "Error: " << name << " does not exist" << endl;
-        return;
-    }
-
+    Inode node = superBlock.getNode(index);
     if (new_size == node.getUsedSize()) {
-        return;
+        return FS_OK;
+    }
+    if (!node.isAFile()) {
+        return FS_NOT_FOUND;
     }
 
+    FsError error = FS_OK;
     if (new_size < node.getUsedSize()) {
         shrinkBlock(index, node, new_size);
     } else {
-        growBlock(index, node, new_size);
+        error = growBlock(index, node, new_size);
     }
     writeSB();
+    return error;
 }
 
 /**
@@ -267,48 +1085,93 @@ void FileSystem::fs_resize(const string &name, int new_size) {
  * @param newSize - the new size of the file
 */
 void FileSystem::shrinkBlock(uint8_t index, Inode &node, int newSize) {
+    releaseTail(index);
+    if (node.hasExtentBlock()) {
+        shrinkExtents(index, node, newSize);
+        return;
+    }
     int oldEnd = node.getEndIndex();
     node.setUsedSize(newSize);
     int newEnd = node.getEndIndex();
     superBlock.clearBlock(newEnd + 1, oldEnd);
 
-    uint8_t buf[BLOCK_SIZE];
-    // making sure everything is zeroed out
-    for (size_t i = 0; i < BLOCK_SIZE; i++) {
-        buf[i] = 0;
-    }
-
     // zero out unused blocks
-    int start = oldEnd * BLOCK_SIZE;
+    int zeroed = 0;
     for (int i = oldEnd; i >= newEnd + 1; i--) {
-        diskFile.seekg(start);
-        diskFile.write(reinterpret_cast<char*>(buf), BLOCK_SIZE);
+        zeroed += zeroBlock(i);
     }
+    stats.count(STAT_SEEKS, zeroed);
+    stats.count(STAT_BYTES_WRITTEN, zeroed * BLOCK_SIZE);
     superBlock.setNode(node, index);
 }
 
 
 /**
  * @brief increase the number of blocks allocated to given file
- * if not possible to grow the block from its current start, find a new 
- * contiguous block to put the file
+ * with preallocation on, the blocks reserved after the file are given back first so the grow can take them,
+ * the blocks reserved for every other file are given back if there is no room otherwise, and a file that has
+ * grown more than once gets blocks reserved after its new end
+ * @param index - the index of the inode for this file
+ * @param node - the node to be altered
+ * @param newSize - the new size of the file
+ * @return FsError - FS_NO_SPACE if there is no room for the bigger file
+*/
+FsError FileSystem::growBlock(uint8_t index, Inode &node, int newSize) {
+    if (preallocBlocks == 0) {
+        return extendBlock(index, node, newSize);
+    }
+    int start = node.getStartBlock();
+    int reachable = node.getUsedSize() + reservedTail[index].length;
+    releaseTail(index);
+    FsError error = extendBlock(index, node, newSize);
+    if (error == FS_NO_SPACE && reclaimTails()) {
+        error = extendBlock(index, node, newSize);
+    }
+    if (error != FS_OK) {
+        return error;
+    }
+    if (node.getStartBlock() == start && newSize <= reachable) {
+        stats.count(STAT_PREALLOC_HITS);
+    }
+    growCount[index]++;
+    if (growCount[index] > 1) {
+        reserveTail(index);
+    }
+    return FS_OK;
+}
+
+/**
+ * @brief grow a file where it is if the blocks after it are free, otherwise into the free blocks before it
+ * if that is on, give it more runs if extent files are on, or else move it to a free run big enough
  * @param index - the index of the inode for this file
  * @param node - the node to be altered
  * @param newSize - the new size of the file
+ * @return FsError - FS_NO_SPACE if there is no room for the bigger file, the node is left as it was
 */
-void FileSystem::growBlock(uint8_t index, Inode &node, int newSize) {
+FsError FileSystem::extendBlock(uint8_t index, Inode &node, int newSize) {
+    if (node.hasExtentBlock()) {
+        return growExtents(index, node, newSize);
+    }
 
     int oldEnd = node.getEndIndex();
+    int oldSize = node.getUsedSize();
     node.setUsedSize(newSize);
     Inode newNode = node;
     int newEnd = node.getEndIndex();
-    if (superBlock.isFreeBlock(oldEnd + 1, newEnd)) {
+    // the growth options check every block the file grows into, without them the first one past the end is skipped as it always was
+    bool checkNext = extentFiles || backwardGrowth || preallocBlocks > 0;
+    if (checkNext ? superBlock.isFreeRange(oldEnd + 1, newEnd) : superBlock.isFreeBlock(oldEnd + 1, newEnd)) {
         superBlock.setBlock(oldEnd + 1, newEnd);
+    } else if (backwardGrowth && growBackward(index, node, oldSize)) {
+        return FS_OK;
+    } else if (extentFiles) {
+        node.setUsedSize(oldSize);
+        return growExtents(index, node, newSize);
     } else {
         int newStart = superBlock.findContigBlock(newSize);
         if (newStart == -1) {
-            cerr << "Error: File " << node.getName() << " cannot be expanded to size " << newSize << endl;
-            return;
+            node.setUsedSize(oldSize);
+            return FS_NO_SPACE;
         }
         superBlock.clearBlock(node.getStartBlock(), oldEnd);
         newNode.setStartBlock(newStart);
@@ -316,39 +1179,501 @@ void FileSystem::growBlock(uint8_t index, Inode &node, int newSize) {
         copyBlocks(node, newNode);
         superBlock.setNode(newNode, index);
     }
-    superBlock.setNode(newNode, index);
+    superBlock.setNode(newNode, index);
+    return FS_OK;
+}
+
+/**
+ * @brief grow a file into the free blocks right before it, along with any free blocks right after it
+ * the file only moves back as far as the blocks after it fall short, in one read and one write. if that
+ * overlaps its old blocks it is copied to a free run first, see stageFile, and it isn't grown backward if there
+ * is none. the super block is written once the file is in its new blocks, before the old ones are zeroed
+ * @param index - the index of the inode for this file
+ * @param node - the node to be altered, it already has the new size
+ * @param oldSize - the size of the file before it grows
+ * @return bool - false if the free blocks on both sides of the file aren't enough, or it overlaps its old
+ * blocks and there is no free run to copy it to first, nothing is changed
+*/
+bool FileSystem::growBackward(uint8_t index, Inode &node, int oldSize) {
+    int start = node.getStartBlock();
+    int oldEnd = start + oldSize - 1;
+    int newSize = node.getUsedSize();
+    int needed = newSize - oldSize;
+    int after = 0;
+    while (after < needed && superBlock.isFreeRange(oldEnd + after + 1, oldEnd + after + 1)) {
+        after++;
+    }
+    int before = 0;
+    while (after + before < needed && start - before - 1 >= (int)MIN_BLOCK_NUM
+           && superBlock.isFreeRange(start - before - 1, start - before - 1)) {
+        before++;
+    }
+    if (after + before < needed) {
+        return false;
+    }
+    int newStart = start - before;
+    superBlock.setBlock(newStart, start - 1);
+    if (after > 0) {
+        superBlock.setBlock(oldEnd + 1, oldEnd + after);
+    }
+    int from = start;
+    if (newStart + oldSize > start) {
+        Inode old = node;
+        old.setUsedSize(oldSize);
+        from = stageFile(index, old, newStart, oldEnd + after);
+        if (from == -1) {
+            superBlock.clearBlock(newStart, start - 1);
+            if (after > 0) {
+                superBlock.clearBlock(oldEnd + 1, oldEnd + after);
+            }
+            return false;
+        }
+    }
+    vector<uint8_t> data(oldSize * BLOCK_SIZE);
+    readDisk(from * BLOCK_SIZE, data.data(), data.size());
+    writeDisk(newStart * BLOCK_SIZE, data.data(), data.size());
+    traceIo(TRACE_READ, from * BLOCK_SIZE, data.size());
+    traceIo(TRACE_WRITE, newStart * BLOCK_SIZE, data.size());
+    stats.count(STAT_BACKWARD_GROWS);
+    stats.count(STAT_SEEKS, 2);
+    stats.count(STAT_BYTES_READ, data.size());
+    stats.count(STAT_BYTES_WRITTEN, data.size());
+    node.setStartBlock(newStart);
+    if (from != start) {
+        superBlock.clearBlock(from, from + oldSize - 1);
+    }
+    superBlock.setNode(node, index);
+    writeSB();
+    // the end of the old blocks is past the end of the moved data, it becomes part of the file's new blocks
+    int stale = max(start, newStart + oldSize);
+    int staleCount = oldEnd - stale + 1;
+    trimUnwritten(stale, staleCount);
+    if (staleCount > 0) {
+        vector<uint8_t> zeros(staleCount * BLOCK_SIZE, 0);
+        writeDisk(stale * BLOCK_SIZE, zeros.data(), zeros.size());
+        traceIo(TRACE_WRITE, stale * BLOCK_SIZE, zeros.size());
+        stats.count(STAT_SEEKS);
+        stats.count(STAT_BYTES_WRITTEN, zeros.size());
+    }
+    int zeroed = 0;
+    for (int i = from; from != start && i < from + oldSize; i++) {
+        zeroed += zeroBlock(i);
+    }
+    stats.count(STAT_SEEKS, zeroed);
+    stats.count(STAT_BYTES_WRITTEN, zeroed * BLOCK_SIZE);
+    return true;
+}
+
+/**
+ * @brief reserve blocks after a file for it to grow into, as many of the free blocks right after it as the
+ * preallocation allows, up to the size of the file. they are only marked used in memory, the super block on the
+ * disk has them free
+ * @param index - the index of the inode for this file, it has no blocks reserved
+*/
+void FileSystem::reserveTail(uint8_t index) {
+    Inode node = superBlock.getNode(index);
+    if (node.hasExtentBlock()) {
+        return;
+    }
+    int end = node.getEndIndex();
+    int want = min(preallocBlocks, (int)node.getUsedSize());
+    int length = 0;
+    while (length < want && superBlock.isFreeRange(end + length + 1, end + length + 1)) {
+        length++;
+    }
+    if (length > 0) {
+        superBlock.setBlock(end + 1, end + length);
+        reservedTail[index] = {end + 1, length};
+    }
+}
+
+/**
+ * @brief give back the blocks reserved after a file
+ * @param index - the index of the inode for this file
+*/
+void FileSystem::releaseTail(uint8_t index) {
+    BlockRun &tail = reservedTail[index];
+    if (tail.length > 0) {
+        superBlock.clearBlock(tail.start, tail.start + tail.length - 1);
+    }
+    tail = {0, 0};
+}
+
+/**
+ * @brief give back the blocks reserved after every file, when there is no room for an allocation otherwise
+ * @return bool - true if any blocks were reserved
+*/
+bool FileSystem::reclaimTails() {
+    bool reclaimed = false;
+    for (int i = 0; i < NUM_NODES; i++) {
+        if (reservedTail[i].length > 0) {
+            releaseTail(i);
+            reclaimed = true;
+        }
+    }
+    if (reclaimed) {
+        stats.count(STAT_PREALLOC_RECLAIMS);
+    }
+    return reclaimed;
+}
+
+/**
+ * @brief forget every reservation without touching the free block list, after a super block was read from the disk
+*/
+void FileSystem::forgetTails() {
+    fill(reservedTail, reservedTail + NUM_NODES, BlockRun{0, 0});
+    fill(growCount, growCount + NUM_NODES, 0);
+}
+
+/**
+ * @brief find the blocks of the mounted disk that were never written, the holes of a sparse disk file like the
+ * ones mkfs makes, or the blocks a compressed image stores as zeros. holes only come in whole pages of the file
+ * system the disk file is on, and nothing else is known about a disk when it is mounted, the rest of its blocks
+ * are learned as they are written
+*/
+void FileSystem::loadUnwritten() {
+    unwritten.reset();
+    if (image.isOpen()) {
+        for (int i = 0; i < NUM_BLOCKS; i++) {
+            unwritten[i] = image.storesZeros(i);
+        }
+        return;
+    }
+    int fd = open(currentDiskName.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+    // a block past the end of a short disk file isn't zeros, reading it fails
+    off_t limit = min(lseek(fd, 0, SEEK_END), (off_t)(NUM_BLOCKS * BLOCK_SIZE));
+    off_t data = 0;
+    for (off_t hole = lseek(fd, 0, SEEK_HOLE); hole != -1 && hole < limit; hole = lseek(fd, data, SEEK_HOLE)) {
+        data = lseek(fd, hole, SEEK_DATA);
+        if (data == -1 || data > limit) {
+            data = limit;
+        }
+        for (off_t block = (hole + BLOCK_SIZE - 1) / BLOCK_SIZE; (block + 1) * (off_t)BLOCK_SIZE <= data; block++) {
+            unwritten[block] = true;
+        }
+    }
+    ::close(fd);
+    // a block that shares another block's slot has whatever that slot has
+    bitset<NUM_BLOCKS> holes = unwritten;
+    for (int i = 0; dedup.isEnabled() && i < NUM_BLOCKS; i++) {
+        unwritten[i] = holes[dedup.slotOf(i)];
+    }
+}
+
+/**
+ * @brief check if a block is known to hold only zeros, either it was never written or it was written with zeros
+ * @param block - the block of the disk, blocks past the end of the disk are never known
+ * @return bool - true if the block can be read as zeros without touching the disk
+*/
+bool FileSystem::isUnwritten(int block) {
+    return block >= 0 && block < NUM_BLOCKS && unwritten[block];
+}
+
+/**
+ * @brief shorten a run of blocks to the part from its first to its last block that isn't unwritten,
+ * the unwritten blocks in between are left in so the run is still one access
+ * @param start - the first block of the run, moved past the unwritten blocks at the front
+ * @param count - the blocks in the run, 0 if they are all unwritten
+*/
+void FileSystem::trimUnwritten(int &start, int &count) {
+    while (count > 0 && isUnwritten(start)) {
+        start++;
+        count--;
+    }
+    while (count > 0 && isUnwritten(start + count - 1)) {
+        count--;
+    }
+}
+
+/**
+ * @brief zero a block that is being freed or no longer has a file's data, a block that was never written
+ * already reads as zeros and isn't written again
+ * @param block - the block of the disk
+ * @return bool - true if the block had to be written
+*/
+bool FileSystem::zeroBlock(int block) {
+    if (isUnwritten(block)) {
+        stats.count(STAT_ZEROING_SKIPPED);
+        return false;
+    }
+    uint8_t zeros[BLOCK_SIZE] = {0};
+    writeDisk((long)block * BLOCK_SIZE, zeros, BLOCK_SIZE);
+    traceIo(TRACE_WRITE, (long)block * BLOCK_SIZE, BLOCK_SIZE);
+    return true;
+}
+
+/**
+ * @brief copies the contents of a file from one set of blocks to another
+ * @param oldNode - the node for the old file posistion
+ * @param newNode - the node for the new file posistion
+*/
+void FileSystem::copyBlocks(Inode oldNode, Inode newNode) {
+    // use a new buffer in case the global buffer still has something we need
+    uint8_t buf[BLOCK_SIZE];
+    int oldNodePos = oldNode.getStartBlock() * BLOCK_SIZE;
+    int newNodePos = newNode.getStartBlock() * BLOCK_SIZE;
+    int copied = 0;
+    int zeroed = 0;
+    for (int i = 0; i < oldNode.getUsedSize(); i++) {
+        // a block that was never written isn't read, its copy only has to be zeroed
+        if (isUnwritten(oldNodePos / BLOCK_SIZE)) {
+            zeroed += zeroBlock(newNodePos / BLOCK_SIZE);
+        } else {
+            readDisk(oldNodePos, buf, BLOCK_SIZE);
+            writeDisk(newNodePos, buf, BLOCK_SIZE);
+            traceIo(TRACE_READ, oldNodePos, BLOCK_SIZE);
+            traceIo(TRACE_WRITE, newNodePos, BLOCK_SIZE);
+            copied++;
+        }
+
+        oldNodePos += BLOCK_SIZE;
+        newNodePos += BLOCK_SIZE;
+    }
+    stats.count(STAT_RELOCATIONS);
+    stats.count(STAT_SEEKS, 2 * copied + zeroed);
+    stats.count(STAT_BYTES_READ, copied * BLOCK_SIZE);
+    stats.count(STAT_BYTES_WRITTEN, (copied + zeroed) * BLOCK_SIZE);
+}
+
+/**
+ * @brief copy a file to a free run before it is moved to blocks that overlap its own, and write the super block
+ * with the file in the copy. the move then reads from the copy, so a crash part way through it leaves the super
+ * block on the disk pointing at a whole copy of the file rather than at blocks it is overwriting
+ * @param index - the index of the inode for this file
+ * @param node - the node of the file where it is now
+ * @param first - the first of the blocks the file is moving within, its own and the ones it moves to
+ * @param last - the last of them, they are all marked used and the copy is put outside them
+ * @return int - the first block of the copy, -1 if there is no free run for it and nothing was changed
+*/
+int FileSystem::stageFile(uint8_t index, Inode node, int first, int last) {
+    int size = node.getUsedSize();
+    int staging = superBlock.findContigBlock(size);
+    if (staging == -1 || staging + size > NUM_BLOCKS) {
+        return -1;
+    }
+    Inode staged = node;
+    staged.setStartBlock(staging);
+    superBlock.setBlock(staging, staged.getEndIndex());
+    copyBlocks(node, staged);
+    // the super block on the disk only has the copy, the blocks the file is moving within are free until it is moved
+    superBlock.clearBlock(first, last);
+    superBlock.setNode(staged, index);
+    writeSB();
+    superBlock.setBlock(first, last);
+    return staging;
+}
+
+/**
+ * @brief grow a file by adding runs instead of moving it, the last run is extended as far as the blocks after it
+ * are free and the rest goes in the first free run big enough, or in the free blocks from the start of the disk.
+ * a file that was one run gets an extent block, no data is copied either way
+ * @param index - the index of the inode for this file
+ * @param node - the node to be altered
+ * @param newSize - the new size of the file
+ * @return FsError - FS_NO_SPACE if there aren't enough free blocks
+*/
+FsError FileSystem::growExtents(uint8_t index, Inode &node, int newSize) {
+    int needed = newSize - node.getUsedSize();
+    if (superBlock.freeBlockCount() < needed + (node.hasExtentBlock() ? 0 : 1)) {
+        return FS_NO_SPACE;
+    }
+    vector<BlockRun> runs = superBlock.getRuns(index);
+    allocateRuns(needed, runs);
+    node.setUsedSize(newSize);
+    if (runs.size() == 1 && !node.hasExtentBlock()) {
+        superBlock.setNode(node, index);
+        return FS_OK;
+    }
+    if (!node.hasExtentBlock()) {
+        int block = superBlock.findContigBlock(1);
+        superBlock.setBlock(block, block);
+        node.setExtentBlock(block);
+    }
+    superBlock.setNode(node, index);
+    superBlock.setRuns(index, runs);
+    writeExtentBlock(index);
+    return FS_OK;
+}
+
+/**
+ * @brief mark free blocks used and add them to the end of a list of runs
+ * @param blocks - the number of blocks to add, there have to be that many free
+ * @param runs - the runs of a file, the last one is extended if the blocks after it are free
+*/
+void FileSystem::allocateRuns(int blocks, vector<BlockRun> &runs) {
+    while (blocks > 0 && !runs.empty()
+           && superBlock.isFreeRange(runs.back().start + runs.back().length, runs.back().start + runs.back().length)) {
+        int block = runs.back().start + runs.back().length;
+        superBlock.setBlock(block, block);
+        runs.back().length++;
+        blocks--;
+    }
+    // the first free run that holds the rest keeps it to one more run
+    int free = 0;
+    for (int i = MIN_BLOCK_NUM; blocks > 0 && i < NUM_BLOCKS; i++) {
+        free = superBlock.isFreeRange(i, i) ? free + 1 : 0;
+        if (free == blocks) {
+            runs.push_back({i - blocks + 1, blocks});
+            superBlock.setBlock(i - blocks + 1, i);
+            blocks = 0;
+        }
+    }
+    for (int i = MIN_BLOCK_NUM; blocks > 0 && i < NUM_BLOCKS; i++) {
+        if (!superBlock.isFreeRange(i, i)) {
+            continue;
+        }
+        if (!runs.empty() && runs.back().start + runs.back().length == i) {
+            runs.back().length++;
+        } else {
+            runs.push_back({i, 1});
+        }
+        superBlock.setBlock(i, i);
+        blocks--;
+    }
+}
+
+/**
+ * @brief shrink a file with an extent block, the runs past the new size are zeroed and freed,
+ * and a file left with one run goes back to having no extent block
+ * @param index - the index of the inode for this file
+ * @param node - the node to be altered
+ * @param newSize - the new size of the file
+*/
+void FileSystem::shrinkExtents(uint8_t index, Inode &node, int newSize) {
+    vector<BlockRun> kept;
+    int logical = 0;
+    int zeroed = 0;
+    for (BlockRun run : superBlock.getRuns(index)) {
+        int keep = min(max(newSize - logical, 0), run.length);
+        if (keep > 0) {
+            kept.push_back({run.start, keep});
+        }
+        for (int i = run.start + keep; i < run.start + run.length; i++) {
+            zeroed += zeroBlock(i);
+        }
+        if (keep < run.length) {
+            superBlock.clearBlock(run.start + keep, run.start + run.length - 1);
+        }
+        logical += run.length;
+    }
+    node.setUsedSize(newSize);
+    if (kept.size() == 1) {
+        int block = node.getExtentBlock();
+        zeroed += zeroBlock(block);
+        superBlock.clearBlock(block, block);
+        node.setStartBlock(kept[0].start);
+        superBlock.setRuns(index, {});
+        superBlock.setNode(node, index);
+    } else {
+        superBlock.setNode(node, index);
+        superBlock.setRuns(index, kept);
+        writeExtentBlock(index);
+    }
+    stats.count(STAT_SEEKS, zeroed);
+    stats.count(STAT_BYTES_WRITTEN, zeroed * BLOCK_SIZE);
+}
+
+/**
+ * @brief write the runs of a file to its extent block
+ * @param index - the index of the inode for this file
+*/
+void FileSystem::writeExtentBlock(uint8_t index) {
+    char block[BLOCK_SIZE];
+    superBlock.storeExtentBlock(index, block);
+    int pos = superBlock.getNode(index).getExtentBlock() * BLOCK_SIZE;
+    writeDisk(pos, reinterpret_cast<uint8_t*>(block), BLOCK_SIZE);
+    traceIo(TRACE_WRITE, pos, BLOCK_SIZE);
+    stats.count(STAT_SEEKS);
+    stats.count(STAT_BYTES_WRITTEN, BLOCK_SIZE);
+}
+
+/**
+ * @brief read the runs of every file with an extent block on the mounted disk
+*/
+void FileSystem::loadExtents() {
+    char block[BLOCK_SIZE];
+    for (int i = 0; i < NUM_NODES; i++) {
+        Inode node = superBlock.getNode(i);
+        if (node.hasExtentBlock()) {
+            readDisk(node.getExtentBlock() * BLOCK_SIZE, reinterpret_cast<uint8_t*>(block), BLOCK_SIZE);
+            traceIo(TRACE_READ, node.getExtentBlock() * BLOCK_SIZE, BLOCK_SIZE);
+            stats.count(STAT_SEEKS);
+            stats.count(STAT_BYTES_READ, BLOCK_SIZE);
+            superBlock.loadExtentBlock(i, block);
+        }
+    }
+}
+
+/**
+ * @brief read every block of a file, a run at a time, the blocks never written at either end of a run are left as zeros
+ * @param index - the index of the inode for this file
+ * @param data - set to the contents of the file
+*/
+void FileSystem::readFile(uint8_t index, vector<uint8_t> &data) {
+    data.resize(superBlock.getNode(index).getUsedSize() * BLOCK_SIZE);
+    size_t done = 0;
+    for (BlockRun run : superBlock.getRuns(index)) {
+        int start = run.start;
+        int count = run.length;
+        trimUnwritten(start, count);
+        if (count > 0) {
+            uint8_t *to = data.data() + done + (start - run.start) * BLOCK_SIZE;
+            readDisk(start * BLOCK_SIZE, to, count * BLOCK_SIZE);
+            traceIo(TRACE_READ, start * BLOCK_SIZE, count * BLOCK_SIZE);
+            stats.count(STAT_SEEKS);
+            stats.count(STAT_BYTES_READ, count * BLOCK_SIZE);
+        }
+        stats.count(STAT_UNWRITTEN_READS, run.length - count);
+        done += run.length * BLOCK_SIZE;
+    }
 }
 
 /**
- * @brief copies the contents of a file from one set of blocks to another
- * @param oldNode - the node for the old file posistion
- * @param newNode - the node for the new file posistion
+ * @brief zero every block of a file, its extent block too if it has one, blocks never written are left alone
+ * @param index - the index of the inode for this file
+ * @return int - the number of blocks zeroed
 */
-void FileSystem::copyBlocks(Inode oldNode, Inode newNode) {
-    // use a new buffer in case the global buffer still has something we need
-    uint8_t buf[BLOCK_SIZE];
-    int oldNodePos = oldNode.getStartBlock() * BLOCK_SIZE;
-    int newNodePos = newNode.getStartBlock() * BLOCK_SIZE;
-    for (int i = 0; i < oldNode.getUsedSize(); i++) {
-        diskFile.seekg(oldNodePos);
-        diskFile.read(reinterpret_cast<char*>(buf), BLOCK_SIZE);
-        diskFile.seekg(newNodePos);
-        diskFile.write(reinterpret_cast<char*>(buf), BLOCK_SIZE);
-
-        oldNodePos += BLOCK_SIZE;
-        newNodePos += BLOCK_SIZE;
+int FileSystem::zeroFile(uint8_t index) {
+    int zeroed = 0;
+    for (BlockRun run : superBlock.getRuns(index)) {
+        for (int i = 0; i < run.length; i++) {
+            zeroed += zeroBlock(run.start + i);
+        }
     }
+    Inode node = superBlock.getNode(index);
+    if (node.hasExtentBlock()) {
+        zeroed += zeroBlock(node.getExtentBlock());
+    }
+    return zeroed;
 }
 
 /**
- * @brief defragment the disk to optimize space usage
+ * @brief defragment the disk to optimize space usage, files with an extent block are taken off the disk
+ * while the rest are packed and put back as one run each in the free space left after them
+ * @return FsError - always FS_OK
 */
-void FileSystem::fs_defrag(void) {
+FsError FileSystem::fs_defrag(void) {
+    // the files are moved, so the blocks reserved after them go back to being free
+    reclaimTails();
+    vector<pair<uint8_t, vector<uint8_t>>> spread;
+    for (int i = 0; i < NUM_NODES; i++) {
+        if (superBlock.getNode(i).hasExtentBlock()) {
+            spread.push_back({(uint8_t)i, {}});
+            readFile(i, spread.back().second);
+            int zeroed = zeroFile(i);
+            stats.count(STAT_SEEKS, zeroed);
+            stats.count(STAT_BYTES_WRITTEN, zeroed * BLOCK_SIZE);
+            superBlock.clearFileBlocks(i);
+        }
+    }
     vector<Inode> nodeList;
     for (size_t i = 0; i < NUM_NODES; i++) {
         Inode node = superBlock.getNode(i);
         // get all active files in the system
-        if (node.nodeInUse() && node.isAFile()) {
+        if (node.nodeInUse() && node.isAFile() && !node.hasExtentBlock()) {
             nodeList.push_back(node);
         }
     }
@@ -362,7 +1687,44 @@ void FileSystem::fs_defrag(void) {
             superBlock.setNode(newNode, index);
         }
     }
+    for (auto &[index, data] : spread) {
+        placeFile(index, data);
+    }
     writeSB();
+    return FS_OK;
+}
+
+/**
+ * @brief put a file that was taken off the disk back as one run, or as several with an extent block
+ * if no free run is big enough
+ * @param index - the index of the inode for this file, its blocks are all free
+ * @param data - the contents of the file
+*/
+void FileSystem::placeFile(uint8_t index, const vector<uint8_t> &data) {
+    Inode node = superBlock.getNode(index);
+    vector<BlockRun> runs;
+    allocateRuns(node.getUsedSize(), runs);
+    if (runs.size() == 1) {
+        node.setStartBlock(runs[0].start);
+    } else {
+        int block = superBlock.findContigBlock(1);
+        superBlock.setBlock(block, block);
+        node.setExtentBlock(block);
+        superBlock.setRuns(index, runs);
+    }
+    stats.count(STAT_RELOCATIONS);
+    superBlock.setNode(node, index);
+    size_t done = 0;
+    for (BlockRun run : runs) {
+        writeDisk(run.start * BLOCK_SIZE, data.data() + done, run.length * BLOCK_SIZE);
+        traceIo(TRACE_WRITE, run.start * BLOCK_SIZE, run.length * BLOCK_SIZE);
+        stats.count(STAT_SEEKS);
+        stats.count(STAT_BYTES_WRITTEN, run.length * BLOCK_SIZE);
+        done += run.length * BLOCK_SIZE;
+    }
+    if (node.hasExtentBlock()) {
+        writeExtentBlock(index);
+    }
 }
 
 /**
@@ -394,43 +1756,369 @@ Inode FileSystem::optimizeBlockLocation(Inode node) {
     int newPos = newNode.getStartBlock() * BLOCK_SIZE;
     // copy file data from old block to new block
     for (int i = oldStart; i < node.getEndIndex(); i++) {
-        diskFile.seekg(pos);
-        diskFile.read(reinterpret_cast<char*>(readBuf), BLOCK_SIZE);
-        diskFile.write(reinterpret_cast<char*>(zeroBuf), BLOCK_SIZE);
+        readDisk(pos, readBuf, BLOCK_SIZE);
+        // the zeros have always gone where the read left the stream, the block after the one read
+        writeDisk(pos + BLOCK_SIZE, zeroBuf, BLOCK_SIZE);
 
-        diskFile.seekg(newPos);
-        diskFile.write(reinterpret_cast<char*>(readBuf), BLOCK_SIZE);
+        writeDisk(newPos, readBuf, BLOCK_SIZE);
+        traceIo(TRACE_READ, pos, BLOCK_SIZE);
+        traceIo(TRACE_WRITE, pos + BLOCK_SIZE, BLOCK_SIZE);
+        traceIo(TRACE_WRITE, newPos, BLOCK_SIZE);
 
         pos += BLOCK_SIZE;
         newPos += BLOCK_SIZE;
     }
+    int copied = max(node.getEndIndex() - oldStart, 0);
+    stats.count(STAT_RELOCATIONS);
+    stats.count(STAT_SEEKS, 2 * copied);
+    stats.count(STAT_BYTES_READ, copied * BLOCK_SIZE);
+    stats.count(STAT_BYTES_WRITTEN, 2 * copied * BLOCK_SIZE);
     return newNode;
 }
 
+/**
+ * @brief defragment the disk a few blocks at a time until the time budget runs out
+ * every step leaves the disk consistent so the work can be spread out between commands
+ * @param stepBlocks - the max number of blocks moved by a single step
+ * @param budgetMicros - how long to keep taking steps for
+ * @return bool - true if the disk is fully defragmented
+*/
+bool FileSystem::fs_defragIncremental(int stepBlocks, int budgetMicros) {
+    auto deadline = chrono::steady_clock::now() + chrono::microseconds(budgetMicros);
+    do {
+        if (!defragStep(stepBlocks)) {
+            return true;
+        }
+    } while (chrono::steady_clock::now() < deadline);
+    return false;
+}
+
+/**
+ * @brief move the lowest files that have free space before them down until maxBlocks have been moved
+ * a single file larger than maxBlocks is still moved so that every step makes progress
+ * @param maxBlocks - the number of blocks the step may move
+ * @return bool - true if there are still files that can be moved
+*/
+bool FileSystem::defragStep(int maxBlocks) {
+    reclaimTails();
+    int moved = 0;
+    // files that overlap where they would move to and have no free run to be copied to first stay where they are
+    vector<bool> stuck(NUM_NODES, false);
+    while (true) {
+        // find the first file on the disk that has free space right before it
+        int candidate = -1;
+        for (int i = 0; i < NUM_NODES; i++) {
+            Inode node = superBlock.getNode(i);
+            // files with an extent block are left where they are, only a full defrag puts them back together
+            if (!node.isAFile() || node.hasExtentBlock() || stuck[i] || superBlock.findNewStartBlock(node.getStartBlock()) == -1) {
+                continue;
+            }
+            if (candidate == -1 || node.getStartBlock() < superBlock.getNode(candidate).getStartBlock()) {
+                candidate = i;
+            }
+        }
+        if (candidate == -1) {
+            return false;
+        }
+        Inode node = superBlock.getNode(candidate);
+        if (moved > 0 && moved + node.getUsedSize() > maxBlocks) {
+            return true;
+        }
+        if (!moveFileDown(candidate, node)) {
+            stuck[candidate] = true;
+            continue;
+        }
+        moved += node.getUsedSize();
+    }
+}
+
+/**
+ * @brief move a file to start at the beginning of the free section directly before it
+ * the super block is written as soon as the file is copied and only then are the blocks it left zeroed,
+ * so the super block on the disk never points at zeroed blocks. a file that would overlap its old blocks
+ * is copied to a free run first, see stageFile
+ * @param index - the index of the inode for this file
+ * @param node - the node of the file to be moved
+ * @return bool - false if it overlaps its old blocks and there is no free run to copy it to, it isn't moved
+*/
+bool FileSystem::moveFileDown(uint8_t index, Inode node) {
+    Inode newNode = node;
+    newNode.setStartBlock(superBlock.findNewStartBlock(node.getStartBlock()));
+
+    Inode from = node;
+    if (newNode.getEndIndex() >= node.getStartBlock()) {
+        superBlock.setBlock(newNode.getStartBlock(), node.getStartBlock() - 1);
+        int staging = stageFile(index, node, newNode.getStartBlock(), node.getEndIndex());
+        superBlock.clearBlock(newNode.getStartBlock(), node.getStartBlock() - 1);
+        if (staging == -1) {
+            return false;
+        }
+        from.setStartBlock(staging);
+    }
+
+    uint8_t buf[BLOCK_SIZE];
+    // the copy being read from doesn't overlap the new location
+    int oldPos = from.getStartBlock() * BLOCK_SIZE;
+    int newPos = newNode.getStartBlock() * BLOCK_SIZE;
+    int copied = 0;
+    int zeroed = 0;
+    for (int i = 0; i < node.getUsedSize(); i++) {
+        // a block that was never written isn't read, its copy only has to be zeroed
+        if (isUnwritten(oldPos / BLOCK_SIZE)) {
+            zeroed += zeroBlock(newPos / BLOCK_SIZE);
+        } else {
+            readDisk(oldPos, buf, BLOCK_SIZE);
+            writeDisk(newPos, buf, BLOCK_SIZE);
+            traceIo(TRACE_READ, oldPos, BLOCK_SIZE);
+            traceIo(TRACE_WRITE, newPos, BLOCK_SIZE);
+            copied++;
+        }
+        oldPos += BLOCK_SIZE;
+        newPos += BLOCK_SIZE;
+    }
+
+    // the super block points at the copy before the old blocks are zeroed, so they are never zeroed while in use
+    superBlock.clearBlock(node.getStartBlock(), node.getEndIndex());
+    if (from.getStartBlock() != node.getStartBlock()) {
+        superBlock.clearBlock(from.getStartBlock(), from.getEndIndex());
+    }
+    superBlock.setBlock(newNode.getStartBlock(), newNode.getEndIndex());
+    superBlock.setNode(newNode, index);
+    writeSB();
+
+    // zero out the old blocks that the file no longer covers, and the copy it was moved from
+    for (int i = max(newNode.getEndIndex() + 1, (int)node.getStartBlock()); i <= node.getEndIndex(); i++) {
+        zeroed += zeroBlock(i);
+    }
+    for (int i = from.getStartBlock(); from.getStartBlock() != node.getStartBlock() && i <= from.getEndIndex(); i++) {
+        zeroed += zeroBlock(i);
+    }
+    stats.count(STAT_RELOCATIONS);
+    stats.count(STAT_SEEKS, 2 * copied + zeroed);
+    stats.count(STAT_BYTES_READ, copied * BLOCK_SIZE);
+    stats.count(STAT_BYTES_WRITTEN, (copied + zeroed) * BLOCK_SIZE);
+    return true;
+}
+
+/**
+ * @brief defragment the disk so the files of each directory sit next to each other
+ * files are packed from the first data block in directory order
+ * @param seekBefore - set to the average seek distance of a directory scan before the defrag
+ * @param seekAfter - set to the average seek distance of a directory scan after the defrag
+ * @return FsError - always FS_OK
+*/
+FsError FileSystem::fs_defragLocality(double &seekBefore, double &seekAfter) {
+    reclaimTails();
+    superBlock.buildDirectoryMap();
+    seekBefore = superBlock.averageDirectorySeek();
+
+    vector<uint8_t> order;
+    collectDirectoryFiles(ROOT_DIR, order);
+
+    // the whole disk is only 128KB so read every file in before writing anything back,
+    // that way files can be placed anywhere without worrying about overlapping moves
+    // files with an extent block are read a run at a time and packed as one run like the rest
+    vector<vector<uint8_t>> contents;
+    int lastUsed = 0;
+    for (auto index : order) {
+        Inode node = superBlock.getNode(index);
+        vector<uint8_t> data;
+        readFile(index, data);
+        contents.push_back(data);
+        for (BlockRun run : superBlock.getRuns(index)) {
+            lastUsed = max(lastUsed, run.start + run.length - 1);
+        }
+        if (node.hasExtentBlock()) {
+            lastUsed = max(lastUsed, (int)node.getExtentBlock());
+        }
+        superBlock.clearFileBlocks(index);
+    }
+
+    int nextBlock = MIN_BLOCK_NUM;
+    for (size_t i = 0; i < order.size(); i++) {
+        Inode node = superBlock.getNode(order[i]);
+        if (node.getStartBlock() != nextBlock) {
+            stats.count(STAT_RELOCATIONS);
+        }
+        node.setStartBlock(nextBlock);
+        superBlock.setBlock(node.getStartBlock(), node.getEndIndex());
+        superBlock.setNode(node, order[i]);
+        writeDisk(nextBlock * BLOCK_SIZE, contents[i].data(), contents[i].size());
+        traceIo(TRACE_WRITE, nextBlock * BLOCK_SIZE, contents[i].size());
+        stats.count(STAT_SEEKS);
+        stats.count(STAT_BYTES_WRITTEN, contents[i].size());
+        nextBlock += node.getUsedSize();
+    }
+
+    // zero out the blocks past the packed files that used to hold data
+    for (int i = nextBlock; i <= lastUsed; i++) {
+        if (zeroBlock(i)) {
+            stats.count(STAT_SEEKS);
+            stats.count(STAT_BYTES_WRITTEN, BLOCK_SIZE);
+        }
+    }
+    writeSB();
+    seekAfter = superBlock.averageDirectorySeek();
+    return FS_OK;
+}
+
+/**
+ * @brief add the files of a directory to the layout order, followed by its sub directories
+ * files keep their listing order so a directory scan reads forward, and sub directories
+ * whose files are accessed most are placed closest to their parent
+ * @param dir - the index of the directory
+ * @param order - the list the file indexes are added to
+*/
+void FileSystem::collectDirectoryFiles(uint8_t dir, vector<uint8_t> &order) {
+    map<uint8_t, vector<uint8_t>> directoryStructure = superBlock.getDirectoryMap();
+    vector<pair<int, uint8_t>> subDirs;
+    for (auto index : directoryStructure[dir]) {
+        Inode node = superBlock.getNode(index);
+        if (!node.nodeInUse() || index == dir) {
+            continue;
+        }
+        if (node.isAFile()) {
+            order.push_back(index);
+        } else {
+            subDirs.push_back({subtreeAccessCount(index), index});
+        }
+    }
+    stable_sort(subDirs.begin(), subDirs.end(), [](const pair<int, uint8_t> &a, const pair<int, uint8_t> &b) {
+        return a.first > b.first;
+    });
+    for (auto &sub : subDirs) {
+        collectDirectoryFiles(sub.second, order);
+    }
+}
+
+/**
+ * @brief total number of reads/writes of the files within a directory tree
+ * @param dir - the index of the directory
+ * @return int - the number of accesses
+*/
+int FileSystem::subtreeAccessCount(uint8_t dir) {
+    map<uint8_t, vector<uint8_t>> directoryStructure = superBlock.getDirectoryMap();
+    int count = 0;
+    for (auto index : directoryStructure[dir]) {
+        Inode node = superBlock.getNode(index);
+        if (!node.nodeInUse() || index == dir) {
+            continue;
+        }
+        count += node.isAFile() ? accessCount[index].load() : subtreeAccessCount(index);
+    }
+    return count;
+}
+
+/**
+ * @brief make the defrag command group files by directory instead of only compacting them
+ * @param enable - true to use the directory aware defrag
+*/
+void FileSystem::useLocalityDefrag(bool enable) {
+    localityDefrag = enable;
+}
+
+/**
+ * @brief start recording counters and latencies, this has to be done before the file system is shared between threads
+ * @param dumpPath - the file the stats are appended to as json when the file system is closed, empty for none
+*/
+void FileSystem::enableStats(const string &dumpPath) {
+    stats.enable(dumpPath);
+}
+
+/**
+ * @brief start tracing every disk access, this has to be done before the file system is shared between threads
+ * @param path - the trace file, it is replaced if it exists
+ * @return bool - false if the trace file can't be created
+*/
+bool FileSystem::enableTrace(const string &path) {
+    return trace.open(path);
+}
+
+/**
+ * @brief add a disk access to the trace if tracing is on, with the command and line of the session that made it
+ * @param op - TRACE_READ, TRACE_WRITE or TRACE_MARK
+ * @param pos - the byte offset of the access on the disk
+ * @param length - the number of bytes accessed
+*/
+void FileSystem::traceIo(char op, long pos, size_t length) {
+    if (trace.isEnabled()) {
+        Session *session = tracedSession;
+        trace.record(op, pos / BLOCK_SIZE, blocksFor(length), session ? session->command : NO_COMMAND, session ? session->line : 0);
+    }
+}
+
+/**
+ * @brief stop writing blocks with the contents they already have, this has to be done before a disk is mounted
+*/
+void FileSystem::enableDedup() {
+    dedup.enable();
+}
+
+/**
+ * @brief let files that can't grow where they are take more runs of free blocks, listed in an extent block,
+ * instead of being moved to a free run big enough for the whole file
+*/
+void FileSystem::enableExtents() {
+    extentFiles = true;
+}
+
+/**
+ * @brief let files that can't grow where they are move back into the free blocks before them
+ * instead of being moved to a free run big enough for the whole file
+*/
+void FileSystem::enableBackwardGrowth() {
+    backwardGrowth = true;
+}
+
+/**
+ * @brief reserve blocks after files that grow more than once, so they can keep growing where they are
+ * @param maxBlocks - the most blocks reserved after a file
+*/
+void FileSystem::enablePrealloc(int maxBlocks) {
+    preallocBlocks = maxBlocks;
+}
+
+/**
+ * @brief get the counters and latencies of the file system
+ * @return Stats& - the stats, they record nothing unless they were enabled
+*/
+Stats &FileSystem::getStats() {
+    return stats;
+}
+
+/**
+ * @brief checks which defrag the defrag command uses
+ * @return bool - true if it groups files by directory
+*/
+bool FileSystem::usesLocalityDefrag() {
+    return localityDefrag;
+}
+
 /**
  * @brief change the current working directory of the file system
  * @param name - the name of the directory to swtich to
+ * @return FsError - FS_NOT_FOUND if the directory doesn't exist
 */
-void FileSystem::fs_cd(string &name) {
+FsError FileSystem::fs_cd(Session &session, const string &name) {
     // if name is "." do nothing
     if (name == CUR_DIR_STRING) {
-        return;
+        return FS_OK;
     }
     // if name is ".." got to parent
     else if (name == PARENT_DIR_STRING) {
-        if (currentDirectory == ROOT_DIR) {
-            return;
+        if (session.currentDirectory == ROOT_DIR) {
+            return FS_OK;
         }
-        currentDirectory = superBlock.getNode(currentDirectory).getParent();
+        session.currentDirectory = superBlock.getNode(session.currentDirectory).getParent();
     } else {
         // change to child dir
-        int index = superBlock.getInodeIndex(name, currentDirectory);
+        int index = superBlock.getInodeIndex(name, session.currentDirectory);
         if (index == INVALID_NODE_NUM) {
-            cerr << "Error: Directory " << name << " does not exist" << endl;
-            return; 
+            return FS_NOT_FOUND;
         }
-        currentDirectory = index;
+        session.currentDirectory = index;
     }
+    return FS_OK;
 }
 
 
@@ -439,121 +2127,338 @@ void FileSystem::fs_cd(string &name) {
 ///////////////////////////////////////////////////
 
 /**
- * @brief open the file that contains the list of commands to be executed
- * @param filename - the name of the input file
- * @return bool - if opening the file was successful
+ * @brief turn on incremental defragmentation between commands
+ * @param threshold - the fragmentation percentage that starts a defrag
+ * @param stepBlocks - the max number of blocks moved by a single step
+ * @param budgetMicros - how long defrag may run between two commands
 */
-bool FileSystem::openInputFile(const string &filename) {
-    inputFile.open(filename, ios::in);
-    if (!inputFile.is_open()) {
-        cerr << "Error: input file does not exist: "  << filename << endl;
-        return false;
-    }
-    return true;
+void FileSystem::enableAutoDefrag(int threshold, int stepBlocks, int budgetMicros) {
+    autoDefrag = true;
+    defragThreshold = threshold;
+    defragStepBlocks = stepBlocks;
+    defragBudget = budgetMicros;
 }
 
 /**
- * @brief read the commands from the input file into a queue for execution
- * @return queue<string> - a queue of command strings
+ * @brief run any work that is deferred until between commands
+ * once fragmentation crosses the threshold the defrag keeps going on later calls until it finishes
 */
-queue<string> FileSystem::readCommands() {
-    queue<string> commandQueue;
-    string s;
-    while (getline(inputFile, s)) {
-        commandQueue.push(s);
+void FileSystem::runBackgroundTasks() {
+    if (!autoDefrag) {
+        return;
+    }
+    unique_lock<shared_mutex> guard(diskLock);
+    if (!diskIsMounted) {
+        return;
+    }
+    // the defrag isn't part of any session's command
+    tracedSession = nullptr;
+    if (!defragInProgress && superBlock.fragmentationLevel() >= defragThreshold) {
+        defragInProgress = true;
+    }
+    if (defragInProgress) {
+        defragInProgress = !fs_defragIncremental(defragStepBlocks, defragBudget);
+        flushDisk();
     }
-    return commandQueue;
 }
 
 /**
- * @brief parse and run a command
- * @param tokens - a tokenized version of the command string
+ * @brief close the disk and every disk in the mount table
 */
-void FileSystem::runCommand(vector<string> tokens) {
+void FileSystem::close() {
+    commitSnapshots();
+    diskFile.close();
+    image.close();
+    mountTable.clear();
+    stats.dump();
+    trace.close();
+}
 
-    string command = tokens[0];
 
-    if (!diskIsMounted && command != MOUNT) {
-        cerr << "Error: No file system is mounted" << endl;
-        return;
+/**
+ * @brief write the super block back to the file
+*/
+void FileSystem::writeSB() {
+    /**
+     * I was already 1200 lines deep into this project when I realized that reordering the free block list would ruin
+     * everything when I write it back to the disk. I realize switching it back the original ordering and back again 
+     * everytime I write back to the disk is awful please have mercy on my soul
+    */
+    char block[BLOCK_SIZE];
+    // blocks reserved for files to grow into are free on the disk
+    for (BlockRun tail : reservedTail) {
+        if (tail.length > 0) {
+            superBlock.clearBlock(tail.start, tail.start + tail.length - 1);
+        }
     }
-    
-    // cant do a switch on a string I guess so here we are
+    superBlock.fixFreeBlockList();
+    superBlock.store(block);
+    superBlock.fixFreeBlockList();
+    for (BlockRun tail : reservedTail) {
+        if (tail.length > 0) {
+            superBlock.setBlock(tail.start, tail.start + tail.length - 1);
+        }
+    }
+    writeDisk(0, reinterpret_cast<uint8_t*>(block), BLOCK_SIZE);
+    traceIo(TRACE_WRITE, 0, BLOCK_SIZE);
+    stats.count(STAT_SUPERBLOCK_FLUSHES);
+    stats.count(STAT_SEEKS);
+    stats.count(STAT_BYTES_WRITTEN, BLOCK_SIZE);
+}
+
+/**
+ * @brief read from the mounted disk, blocks written since the first snapshot are read from the snapshot overlay
+ * @param pos - the byte offset on the disk, the start of a block
+ * @param data - where the blocks are read to
+ * @param length - the number of bytes to read
+ * @return bool - false if the disk can't be read
+*/
+bool FileSystem::readDisk(long pos, uint8_t *data, size_t length) {
+    if (!snapshots.isActive() && !image.isOpen() && !dedup.isEnabled()) {
+        return readStream(diskFile, pos, data, length);
+    }
+    return readBlocks(-1, pos, data, length);
+}
 
-    if (command == MOUNT) {
-        fs_mount(tokens[1]);
+/**
+ * @brief read from the mounted disk with a descriptor of the disk file, so reads can run at the same time
+ * @param fd - a read only descriptor of the disk file
+ * @param pos - the byte offset on the disk, the start of a block
+ * @param data - where the blocks are read to
+ * @param length - the number of bytes to read
+ * @return bool - false if the disk file can't be read
+*/
+bool FileSystem::readDiskAt(int fd, long pos, uint8_t *data, size_t length) {
+    if (!snapshots.isActive() && !image.isOpen() && !dedup.isEnabled()) {
+        return pread(fd, data, length, pos) != -1;
     }
-    else if (command == CREATE) {
-        int size = stoi(tokens[2]);
-        fs_create(tokens[1], size);
+    return readBlocks(fd, pos, data, length);
+}
+
+/**
+ * @brief read a block at a time through the snapshot overlay, the dedup index and the compressed image,
+ * a part of a block at the end is read whole and only the part is copied out
+ * @param fd - a read only descriptor of the disk file, -1 to read with the disk stream
+ * @return bool - false if the disk file can't be read
+*/
+bool FileSystem::readBlocks(int fd, long pos, uint8_t *data, size_t length) {
+    uint8_t last[BLOCK_SIZE];
+    for (size_t done = 0; done < length; done += BLOCK_SIZE) {
+        size_t part = min(BLOCK_SIZE, length - done);
+        uint8_t *to = part == BLOCK_SIZE ? data + done : last;
+        int block = (pos + done) / BLOCK_SIZE;
+        // a block past the end of the disk is only ever in the disk file
+        bool read;
+        if (block >= NUM_BLOCKS) {
+            read = readSlot(fd, block, to);
+        } else {
+            read = snapshots.holds(block) ? snapshots.readBlock(block, to) : readBaseBlock(fd, block, to);
+        }
+        if (!read) {
+            return false;
+        }
+        if (to == last) {
+            memcpy(data + done, last, part);
+        }
     }
-    else if (command == DELETE) {
-        fs_delete(tokens[1]);
+    return true;
+}
+
+/**
+ * @brief read a block from the slot of the disk file it is stored in, its own unless dedup shares it,
+ * reads made with the disk stream only happen while the disk is locked so they add the slot to the dedup index
+ * @param fd - a read only descriptor of the disk file, -1 to read with the disk stream
+ * @return bool - false if the disk file can't be read
+*/
+bool FileSystem::readBaseBlock(int fd, int block, uint8_t *data) {
+    if (!dedup.isEnabled()) {
+        return readSlot(fd, block, data);
     }
-    else if (command == READ) {
-        int blockNum = stoi(tokens[2]);
-        fs_read(tokens[1], blockNum);
+    int slot = dedup.slotOf(block);
+    if (!readSlot(fd, slot, data)) {
+        return false;
     }
-    else if (command == WRITE) {
-        int blockNum = stoi(tokens[2]);
-        fs_write(tokens[1], blockNum);
+    if (fd == -1) {
+        dedup.learn(slot, BlockDedup::hash(data));
     }
-    else if (command == BUFFER) {
-        fs_buff((uint8_t*)tokens[1].c_str());
+    return true;
+}
+
+/**
+ * @brief read a slot of the disk file, decompressing it if the disk is a compressed image
+ * @param fd - a read only descriptor of the disk file, -1 to read with the disk stream
+ * @param slot - the block of the disk file
+ * @return bool - false if the disk file can't be read
+*/
+bool FileSystem::readSlot(int fd, int slot, uint8_t *data) {
+    if (image.isOpen()) {
+        long bytes = image.read(fd, slot, data);
+        if (bytes == -1) {
+            return false;
+        }
+        stats.count(STAT_UNCOMPRESSED_BYTES, BLOCK_SIZE);
+        stats.count(STAT_COMPRESSED_BYTES, bytes);
+        return true;
     }
-    else if (command == LS) {
-        fs_ls();
+    if (fd != -1) {
+        return pread(fd, data, BLOCK_SIZE, (long)slot * BLOCK_SIZE) != -1;
     }
-    else if (command == RESIZE) {
-        int newSize = stoi(tokens[2]);
-        fs_resize(tokens[1], newSize);
+    return readStream(diskFile, (long)slot * BLOCK_SIZE, data, BLOCK_SIZE);
+}
+
+/**
+ * @brief write whole blocks to the mounted disk, while the disk has a snapshot they go to the snapshot overlay
+ * @param pos - the byte offset on the disk, the start of a block
+ * @param data - the contents of the blocks
+ * @param length - the number of bytes to write, a multiple of the block size
+ * @return bool - false if a block couldn't be written
+*/
+bool FileSystem::writeDisk(long pos, const uint8_t *data, size_t length) {
+    dropReadAhead(pos, length);
+    // a block written with nothing but zeros reads the same as one that was never written
+    for (size_t done = 0; done < length; done += BLOCK_SIZE) {
+        int block = (pos + done) / BLOCK_SIZE;
+        if (block < NUM_BLOCKS) {
+            unwritten[block] = data[done] == 0 && memcmp(data + done, data + done + 1, BLOCK_SIZE - 1) == 0;
+        }
     }
-    else if (command == DEFRAG) {
-        fs_defrag();
+    if (!snapshots.isActive() && !image.isOpen() && !dedup.isEnabled()) {
+        return writeStream(diskFile, pos, data, length);
     }
-    else if (command == CD) {
-        fs_cd(tokens[1]);
+    bool written = true;
+    for (size_t done = 0; done < length; done += BLOCK_SIZE) {
+        int block = (pos + done) / BLOCK_SIZE;
+        if (block >= NUM_BLOCKS) {
+            written = writeSlot(block, data + done) && written;
+        } else if (snapshots.isActive()) {
+            written = snapshots.writeBlock(block, data + done) && written;
+        } else {
+            written = writeBaseBlock(block, data + done) && written;
+        }
     }
+    return written;
 }
 
 /**
- * @brief close the two file streams that we use
+ * @brief write a block to the disk file, with dedup on a block with the same contents as a slot already stored
+ * shares that slot instead and nothing is written. a slot other blocks share is copied to one of them first and
+ * the table is written before the slot is overwritten, so the disk file never has a table pointing at contents
+ * that are gone. this is how sharing is broken by an overwrite, the zeros of a delete or shrink, or a defrag
+ * @return bool - false if the disk file can't be written
 */
-void FileSystem::close() {
-    diskFile.close();
-    inputFile.close();
+bool FileSystem::writeBaseBlock(int block, const uint8_t *data) {
+    if (!dedup.isEnabled()) {
+        return writeSlot(block, data);
+    }
+    uint32_t hash = BlockDedup::hash(data);
+    uint8_t stored[BLOCK_SIZE];
+    // the block already has these contents
+    int slot = dedup.slotOf(block);
+    if (dedup.holds(slot, hash) && readSlot(-1, slot, stored) && memcmp(stored, data, BLOCK_SIZE) == 0) {
+        stats.count(STAT_DEDUP_HITS);
+        return true;
+    }
+    int sharer = dedup.sharer(block);
+    if (sharer != -1) {
+        // the other blocks keep the slot if it can't be copied out
+        if (!readSlot(-1, block, stored) || !writeSlot(sharer, stored)) {
+            return false;
+        }
+        dedup.moveSlot(block, sharer);
+        saveDedup();
+        stats.count(STAT_DEDUP_BREAKS);
+    }
+    dedup.release(block);
+    // a slot in use with the same contents, or the block's own slot if it still has them from before it was shared
+    int match = dedup.find(hash);
+    if (match == -1 && dedup.holds(block, hash)) {
+        match = block;
+    }
+    if (match != -1 && readSlot(-1, match, stored) && memcmp(stored, data, BLOCK_SIZE) == 0) {
+        if (match == block) {
+            dedup.store(block, hash);
+        } else {
+            dedup.share(block, match);
+        }
+        stats.count(STAT_DEDUP_HITS);
+        return true;
+    }
+    // the hash is only a hint checked against the contents, so it is kept even if the slot wasn't all written
+    bool written = writeSlot(block, data);
+    dedup.store(block, hash);
+    return written;
 }
 
-
 /**
- * @brief zero out the global buffer
+ * @brief write a slot of the disk file, compressing it if the disk is a compressed image
+ * @param slot - the block of the disk file
+ * @return bool - false if the disk file can't be written
 */
-void FileSystem::clearBuffer() {
-    for (size_t i = 0; i < MAX_BUFF_LEN; i++) {
-        buffer[i] = 0;
+bool FileSystem::writeSlot(int slot, const uint8_t *data) {
+    if (image.isOpen()) {
+        long bytes = image.write(slot, data);
+        if (bytes == -1) {
+            return false;
+        }
+        stats.count(STAT_UNCOMPRESSED_BYTES, BLOCK_SIZE);
+        stats.count(STAT_COMPRESSED_BYTES, bytes);
+        return true;
     }
+    return writeStream(diskFile, (long)slot * BLOCK_SIZE, data, BLOCK_SIZE);
 }
 
-
 /**
- * @brief write the super block back to the file
+ * @brief write the blocks in the snapshot overlay to the disk file and remove every snapshot, the overlay file
+ * is only removed once the disk file has every block, if one can't be read it is kept for the next mount
 */
-void FileSystem::writeSB() {
-    /**
-     * I was already 1200 lines deep into this project when I realized that reordering the free block list would ruin
-     * everything when I write it back to the disk. I realize switching it back the original ordering and back again 
-     * everytime I write back to the disk is awful please have mercy on my soul
-    */
-    superBlock.fixFreeBlockList();
-    diskFile.seekg(0);
-    diskFile.write(reinterpret_cast<char*>(&superBlock), sizeof(SuperBlock));
-    superBlock.fixFreeBlockList();
+void FileSystem::commitSnapshots() {
+    uint8_t data[BLOCK_SIZE];
+    for (int i = 0; snapshots.isActive() && i < NUM_BLOCKS; i++) {
+        if (!snapshots.holds(i)) {
+            continue;
+        }
+        if (!snapshots.readBlock(i, data)) {
+            snapshots.detach();
+            break;
+        }
+        writeBaseBlock(i, data);
+    }
+    flushDisk();
+    snapshots.drop();
 }
 
+/**
+ * @brief read the dedup table of the disk that was just mounted, a disk without one only gets one if dedup is on
+ * and it isn't a compressed image
+*/
+void FileSystem::loadDedup() {
+    char block[BLOCK_SIZE] = {0};
+    if (!image.isOpen()) {
+        diskFile.seekg((long)DEDUP_MAP_BLOCK * BLOCK_SIZE);
+        diskFile.read(block, BLOCK_SIZE);
+        diskFile.clear();
+    }
+    dedup.load(block, !image.isOpen());
+}
 
+/**
+ * @brief write the dedup table to the disk file
+*/
+void FileSystem::saveDedup() {
+    char block[BLOCK_SIZE];
+    dedup.save(block);
+    writeSlot(DEDUP_MAP_BLOCK, reinterpret_cast<uint8_t*>(block));
+    traceIo(TRACE_WRITE, (long)DEDUP_MAP_BLOCK * BLOCK_SIZE, BLOCK_SIZE);
+    stats.count(STAT_SEEKS);
+    stats.count(STAT_BYTES_WRITTEN, BLOCK_SIZE);
+}
 
-
-
-
-
-
+/**
+ * @brief write anything the disk stream is holding on to, and the dedup table if it changed
+*/
+void FileSystem::flushDisk() {
+    if (dedup.isDirty()) {
+        saveDedup();
+    }
+    diskFile.flush();
+}
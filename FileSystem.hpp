@@ -4,43 +4,191 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <bitset>
 #include <string>
 #include <fstream>
-#include <queue>
 #include <vector>
+#include <list>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
 #include "SuperBlock.hpp"
+#include "FsError.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
+#include "Snapshot.hpp"
+#include "Compression.hpp"
+#include "Dedup.hpp"
+#include "Session.hpp"
 using namespace std;
 
+/**
+ * a disk that was mounted recently, it is kept open so mounting it again doesn't need to read or check it
+*/
+struct MountedDisk {
+	string name;												// the name the disk was mounted with
+	fstream disk;												// the open disk file
+	char superBlock[BLOCK_SIZE];								// the super block as it is on the disk
+	bool verified;												// if the super block passed the consistency check
+	dev_t device;												// device the disk file is on
+	ino_t inode;												// inode number of the disk file
+	timespec modified;											// last modification time of the disk file
+	off_t size;													// size of the disk file
+	CompressedImage image;										// the block lengths of the disk if it is a compressed image
+};
+
+/**
+ * an entry of a directory listing
+*/
+struct DirEntry {
+	string name;												// the name of the file or directory, "." and ".." come first
+	bool isDirectory;											// true for a directory
+	int size;													// blocks for a file, entries including "." and ".." for a directory
+};
+
+/**
+ * the blocks of one file in a block map
+*/
+struct Extent {
+	char symbol;													// the character the file has in the map
+	string name;													// the name of the file
+	int start;														// the first block of the file
+	int blocks;														// the number of blocks of the file
+};
+
+/**
+ * the blocks read ahead for one file, kept by where they are on the disk so a write to any of them drops them
+*/
+struct ReadAhead {
+	int next;														// the block of the file a sequential read would start at, -1 before the first read
+	int window;														// the blocks the next sequential read past the cache reads ahead, 0 while reads are random
+	int start;														// the block of the disk the cache starts at
+	int blocks;														// the blocks in the cache, 0 if it is empty
+	vector<uint8_t> data;											// the contents of the blocks
+};
+
 class FileSystem {
 	private:
-		fstream inputFile;											// the file stream for command inputs
 		fstream diskFile;											// file stream for the disk
-		uint8_t currentDirectory;									// the index of the cwd in the inode array
-		bool diskIsMounted;											// if there is a disk mounted
+		atomic<bool> diskIsMounted;									// if there is a disk mounted
 		string currentDiskName;										// the name of the disk that mounted										
-		uint8_t buffer[1024];										// the global buffer
-		void clearBuffer();											// zero out global buffer
+		shared_mutex diskLock;										// shared by calls that only read, exclusive for calls that change the disk
+		unsigned long mountCount;									// the number of disks mounted so far
+		bool autoDefrag;											// if incremental defrag runs between commands
+		bool defragInProgress;										// if an incremental defrag has started but not finished
+		int defragThreshold;										// fragmentation percentage that starts an incremental defrag
+		int defragStepBlocks;										// max blocks moved per defrag step
+		int defragBudget;											// microseconds of defrag work allowed between commands
+		bool localityDefrag;										// if defrag groups files by directory
+		bool extentFiles;											// if files that can't grow in place get more runs instead of moving
+		bool backwardGrowth;										// if files that can't grow in place move back into the free blocks before them
+		int preallocBlocks;											// the most blocks reserved after a file that grows, 0 if off
+		BlockRun reservedTail[NUM_NODES];							// the blocks reserved after each file, only marked used in memory
+		int growCount[NUM_NODES];									// the times each file grew since it was created or the disk was mounted
+		bitset<NUM_BLOCKS> unwritten;								// blocks known to hold only zeros, they are read without touching the disk
+		ReadAhead readAhead[NUM_NODES];								// the blocks read ahead for each file
+		mutex readAheadLock;										// taken for the read ahead state, reads of the disk can run at the same time
+		atomic<int> accessCount[NUM_NODES];							// number of reads/writes of each inode since mount
+		char verifiedBlock[BLOCK_SIZE];								// the super block of the mounted disk when it was checked
+		std::list<MountedDisk> mountTable;							// recently mounted disks, most recent first
+		Stats stats;												// counters and command latencies
+		Trace trace;												// the disk accesses, if tracing is on
+		Snapshots snapshots;										// the copy on write overlay of the mounted disk while it has snapshots
+		CompressedImage image;										// the block lengths of the mounted disk if it is a compressed image
+		BlockDedup dedup;											// the blocks of the mounted disk that share a slot with another block
+		friend struct TestAccess;									// lets the tests look at the dedup slots
 		void shrinkBlock(uint8_t index, Inode &node, int newSize);	// reducde the size of a file
-		void growBlock(uint8_t index, Inode &node, int newSize);	// grow the size of a file
+		FsError growBlock(uint8_t index, Inode &node, int newSize);	// grow the size of a file
+		FsError extendBlock(uint8_t index, Inode &node, int newSize);	// find room for a file to grow
+		bool growBackward(uint8_t index, Inode &node, int oldSize);	// grow a file into the free blocks before it
+		void reserveTail(uint8_t index);							// reserve free blocks after a file for it to grow into
+		void releaseTail(uint8_t index);							// give back the blocks reserved after a file
+		bool reclaimTails();										// give back the blocks reserved after every file
+		void forgetTails();											// forget the reservations of a super block that was replaced
+		void loadUnwritten();										// find the blocks of the mounted disk that were never written
+		bool isUnwritten(int block);								// if a block is known to hold only zeros
+		void trimUnwritten(int &start, int &count);					// leave out the unwritten blocks at both ends of a run
+		bool zeroBlock(int block);									// zero a block unless it was never written, returns true if it wrote
+		bool readRun(int fd, int start, uint8_t *data, size_t length);	// read from a run of the disk, false if it fails
+		bool readAheadHit(uint8_t index, int block_num, BlockRun range, uint8_t *data, size_t length, int &ahead);	// copy a read from the blocks read ahead, or find how many to read ahead
+		void fillReadAhead(uint8_t index, int start, vector<uint8_t> &data);	// keep blocks read ahead for a file
+		void dropReadAhead(long pos, size_t length);				// drop the blocks read ahead that a write changes
+		void forgetReadAhead();										// drop every block read ahead and the read pattern of every file
 		void copyBlocks(Inode oldNode, Inode newNode);				// copy the contents of a file to a new location
+		int stageFile(uint8_t index, Inode node, int first, int last);	// copy a file out of the way of a move over itself
+		FsError growExtents(uint8_t index, Inode &node, int newSize);	// grow a file by giving it more runs
+		void allocateRuns(int blocks, vector<BlockRun> &runs);		// add free blocks to the end of a list of runs
+		void shrinkExtents(uint8_t index, Inode &node, int newSize);	// shrink a file that has an extent block
+		void writeExtentBlock(uint8_t index);						// write the runs of a file to its extent block
+		void loadExtents();											// read the extent blocks of the mounted disk
+		void readFile(uint8_t index, vector<uint8_t> &data);		// read every block of a file
+		int zeroFile(uint8_t index);								// zero the blocks of a file, returns how many
+		void placeFile(uint8_t index, const vector<uint8_t> &data);	// put a file back on the disk in free blocks
 		Inode optimizeBlockLocation(Inode node);						// optimize the start block of a file
+		bool moveFileDown(uint8_t index, Inode node);				// move a file into the free section right before it
+		bool defragStep(int maxBlocks);								// move up to maxBlocks blocks, returns true if more work remains
+		void collectDirectoryFiles(uint8_t dir, vector<uint8_t> &order);	// list files of a directory tree in locality order
+		int subtreeAccessCount(uint8_t dir);						// number of reads/writes of files under a directory
+		void traceIo(char op, long pos, size_t length);				// add a disk access at a byte offset to the trace
 		void writeSB();												// write super block to disk
+		bool readDisk(long pos, uint8_t *data, size_t length);		// read from the disk, or the snapshot overlay, false if it fails
+		bool readDiskAt(int fd, long pos, uint8_t *data, size_t length);	// read with a descriptor of the disk file, false if it fails
+		bool writeDisk(long pos, const uint8_t *data, size_t length);	// write whole blocks to the disk, or the snapshot overlay
+		bool readBlocks(int fd, long pos, uint8_t *data, size_t length);	// read a block at a time through the overlay and the image
+		bool readBaseBlock(int fd, int block, uint8_t *data);		// read a block from the slot it is stored in
+		bool readSlot(int fd, int slot, uint8_t *data);				// read a slot of the disk file, decompressing it
+		bool writeBaseBlock(int block, const uint8_t *data);		// write a block, or share the slot of a block with the same contents
+		bool writeSlot(int slot, const uint8_t *data);				// write a slot of the disk file, compressing it, false if it fails
+		void commitSnapshots();										// write the snapshot overlay to the disk file and remove every snapshot
+		void flushDisk();											// write anything the disk stream holds and the dedup table
+		void loadDedup();											// read the dedup table of the mounted disk
+		void saveDedup();											// write the dedup table to the disk file
+		void saveMountedDisk();										// move the mounted disk into the mount table
+		std::list<MountedDisk>::iterator findMountedDisk(const string &name);	// find a disk in the mount table that hasn't changed
+		void finishMount(const string &name, const char block[BLOCK_SIZE]);	// make a checked super block the mounted one
+		FsError attach(Session &session);							// bring a session up to date with the mounted disk
+		FsError findBlock(Session &session, const string &name, int block_num, int blocks, uint8_t &index, vector<BlockRun> &ranges);	// runs of the disk the blocks of a file are in
+		FsError fs_mount(Session &session, const string &new_disk_name);	// mount a new disk
+		FsError fs_create(Session &session, const string &name, int size);	// create a file or dir
+		FsError fs_delete(Session &session, const string &name);	// delete a file of dir
+		FsError fs_read(Session &session, const string &name, int block_num, uint8_t *data, size_t length);	// read from a file
+		FsError fs_write(Session &session, const string &name, int block_num, const uint8_t *data, size_t length);	// write to a file
+		FsError fs_ls(Session &session, vector<DirEntry> &entries);	// list the cwd
+		FsError fs_resize(Session &session, const string &name, int new_size);	// resize a file
+		FsError fs_defrag(void);									// defragment the disk
+		FsError fs_cd(Session &session, const string &name);		// change cwd
+		bool fs_defragIncremental(int stepBlocks, int budgetMicros);	// defrag in bounded steps, returns true when finished
+		FsError fs_defragLocality(double &seekBefore, double &seekAfter);	// defrag so files in the same directory are contiguous
 	public:
 		SuperBlock superBlock;										// the super block of the disk
 		FileSystem();												// default constructor
-		void fs_mount(const string &new_disk_name);					// mount a new disk
-		void fs_create(const string &name, int size);				// create a file or dir
-		void fs_delete(const string &name);							// delete a file of dir
-		void fs_read(const string &name, int block_num);			// read from a file
-		void fs_write(const string &name, int block_num);			// write to a file
-		void fs_buff(uint8_t buff[MAX_BUFF_LEN]);					// put something in the global buffer
-		void fs_ls(void);											// print directory structure
-		void fs_resize(const string &name, int new_size);			// resize a file
-		void fs_defrag(void);										// defragment the disk
-		void fs_cd(string &name);									// change cwd
-		bool openInputFile(const string &filename);					// open the command input file
-		queue<string> readCommands();								// read all commands from input file
-		void runCommand(vector<string> tokens);						// run a command
-		void close();												// close file streams
-};
\ No newline at end of file
+		FsError mount(Session &session, const string &diskName);	// mount a disk, or switch back to a recently mounted one
+		FsError create(Session &session, const string &name, int size);	// create a file, or a directory if size is 0
+		FsError remove(Session &session, const string &name);		// delete a file or a directory and everything in it
+		FsError read(Session &session, const string &name, int block, span<uint8_t> data);	// read blocks of a file into data
+		FsError write(Session &session, const string &name, int block, span<const uint8_t> data);	// write data to blocks of a file
+		FsError checkWrite(Session &session, const string &name, int block, int blocks);	// check a write could be done without doing it
+		FsError resize(Session &session, const string &name, int size);	// change the number of blocks of a file
+		FsError defrag(Session &session);							// move every file as low on the disk as it goes
+		FsError defragLocality(Session &session, double &seekBefore, double &seekAfter);	// defrag grouping files by directory
+		FsError changeDirectory(Session &session, const string &name);	// change the session's working directory
+		FsError list(Session &session, vector<DirEntry> &entries);	// list the session's working directory
+		bool isMounted();											// if a disk is mounted
+		void useLocalityDefrag(bool enable);						// make the defrag command group files by directory
+		bool usesLocalityDefrag();									// if the defrag command groups files by directory
+		void enableStats(const string &dumpPath);					// record counters and latencies, dumped to the file at close
+		Stats &getStats();											// the counters and latencies
+		bool enableTrace(const string &path);						// trace every disk access to a file, false if it can't be created
+		void enableDedup();											// share the slot of blocks written with the same contents
+		void enableExtents();										// grow files with more runs instead of moving them
+		void enableBackwardGrowth();								// grow files back into the free blocks before them
+		void enablePrealloc(int maxBlocks);							// reserve blocks after files that keep growing
+		FsError blockMap(Session &session, string &map, vector<Extent> &extents);	// which file owns each block
+		FsError snapshot(Session &session);							// snapshot the disk, later writes go to an overlay
+		FsError rollback(Session &session);							// go back to the latest snapshot and remove it
+		void enableAutoDefrag(int threshold, int stepBlocks, int budgetMicros);	// run incremental defrag between commands
+		void runBackgroundTasks();									// do deferred work between two commands
+		void close();												// close file streams and dump the stats
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+using namespace std;
+
+/**
+ * the result of a file system call, nothing is printed by the file system itself
+*/
+enum FsError {
+    FS_OK,                  // the call succeeded
+    FS_NOT_MOUNTED,         // no disk is mounted
+    FS_INVALID_ARGUMENT,    // a name, size, block number or span that is never valid
+    FS_DISK_NOT_FOUND,      // the disk file can't be opened
+    FS_BAD_FREE_LIST,       // inconsistent disk: free block list doesn't match the inodes (error code 1)
+    FS_DUPLICATE_NAME,      // inconsistent disk: two entries of a directory share a name (error code 2)
+    FS_DIRTY_FREE_NODE,     // inconsistent disk: a free inode isn't zeroed (error code 3)
+    FS_BAD_FILE_START,      // inconsistent disk: a file starts outside the data blocks (error code 4)
+    FS_BAD_DIRECTORY,       // inconsistent disk: a directory has a size or start block (error code 5)
+    FS_BAD_PARENT,          // inconsistent disk: a node's parent isn't a directory (error code 6)
+    FS_NO_FREE_NODE,        // every inode is in use
+    FS_NAME_EXISTS,         // the name is already used in the directory
+    FS_NO_SPACE,            // there is no run of free blocks big enough
+    FS_NOT_FOUND,           // the file or directory doesn't exist
+    FS_NO_SUCH_BLOCK,       // the file doesn't have the block
+    FS_NO_SNAPSHOT,         // the disk has no snapshot to roll back to
+    FS_SNAPSHOT_FAILED,     // the snapshot overlay file can't be made
+    FS_IO_ERROR             // the disk file or its snapshot overlay can't be opened, read or written
+};
+
+/**
+ * @brief turn the code returned by the consistency check into an error
+ * @param code - the consistency check code, 1 to 6
+ * @return FsError - the matching error
+*/
+inline FsError consistencyError(int code) {
+    return (FsError)(FS_BAD_FREE_LIST + code - 1);
+}
+
+/**
+ * @brief turn an inconsistent disk error back into the code the consistency check returned
+ * @param error - one of the inconsistent disk errors
+ * @return int - the consistency check code, 1 to 6
+*/
+inline int consistencyCode(FsError error) {
+    return error - FS_BAD_FREE_LIST + 1;
+}
+
+/**
+ * @brief checks if an error means the disk failed the consistency check
+ * @return bool - true if the error is one of the inconsistent disk errors
+*/
+inline bool isConsistencyError(FsError error) {
+    return error >= FS_BAD_FREE_LIST && error <= FS_BAD_PARENT;
+}
@@ -65,6 +65,30 @@ int Inode::getEndIndex() {
     return (startBlock + getUsedSize()) - 1;
 }
 
+/**
+ * @brief returns true if the file isn't one run and has an extent block, the high bit of the start block is set
+ * @return bool - if the start block is an extent block
+*/
+bool Inode::hasExtentBlock() {
+    return isAFile() && (startBlock & EXTENT_BLOCK_FLAG) != 0;
+}
+
+/**
+ * @brief returns the block that lists the runs of a file that has an extent block
+ * @return uint8_t - the index of the block
+*/
+uint8_t Inode::getExtentBlock() {
+    return startBlock & ALL_BUT_LAST_MASK;
+}
+
+/**
+ * @brief make the file list its runs in an extent block, setting the start block back makes it one run again
+ * @param block - the index of the extent block
+*/
+void Inode::setExtentBlock(uint8_t block) {
+    startBlock = block | EXTENT_BLOCK_FLAG;
+}
+
 /**
  * @brief returns true if every bit in this node is zero
  * @return bool - true if the node is clean
@@ -96,11 +120,12 @@ bool Inode::isAFile() {
 }
 
 /**
- * @brief returns true if this node has a valid start block
+ * @brief returns true if this node has a valid start block, or a valid extent block if it has one
  * @return bool
 */
 bool Inode::checkStartBlock() {
-    return startBlock >= MIN_BLOCK_NUM && startBlock <= MAX_BLOCK_NUM;
+    int block = hasExtentBlock() ? getExtentBlock() : startBlock;
+    return block >= (int)MIN_BLOCK_NUM && block <= (int)MAX_BLOCK_NUM;
 }
 
 /**
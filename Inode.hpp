@@ -4,6 +4,13 @@
 #include <stdint.h>
 using namespace std;
 
+/**
+ * a run of contiguous blocks of a file, a file is one run unless it has an extent block listing several
+*/
+struct BlockRun {
+	int start;		// the first block of the run
+	int length;		// the number of blocks in the run
+};
 
 class Inode {
 	private:
@@ -25,6 +32,9 @@ class Inode {
 		void setInUse(bool inUse);											// sets if the inode is currently in use
 		void setIsFile(bool isFile);										// sets of the inode is assigned to a file
 		int getEndIndex();													// returns the index of the last block assigned to the file
+		bool hasExtentBlock();												// returns true if the file's runs are listed in an extent block
+		uint8_t getExtentBlock();											// returns the block that lists the file's runs
+		void setExtentBlock(uint8_t block);									// list the file's runs in a block instead of having one run
 
 		bool nodeInUse();													// returns true if the node is currently in use
 		bool blockInNodeRange(int index);									// returns true if index is within the block range of the file
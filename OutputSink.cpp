@@ -0,0 +1,105 @@
+#include "OutputSink.hpp"
+#include "Constants.hpp"
+#include <iostream>
+#include <unistd.h>
+using namespace std;
+
+/**
+ * @brief constructor
+ * @param fd - the file descriptor to write to
+ * @param policy - when the buffer is written out
+ * @param flushBytes - the number of buffered bytes that triggers a write when using FLUSH_BYTES
+ * @param capacity - the size of the buffer
+*/
+OutputSink::OutputSink(int fd, FlushPolicy policy, size_t flushBytes, size_t capacity) {
+    this->fd = fd;
+    this->policy = policy;
+    this->flushBytes = flushBytes;
+    data.resize(capacity);
+    setp(data.data(), data.data() + data.size());
+}
+
+/**
+ * @brief write everything that is buffered to the file descriptor
+*/
+void OutputSink::flush() {
+    char *pos = pbase();
+    while (pos < pptr()) {
+        ssize_t written = write(fd, pos, pptr() - pos);
+        if (written <= 0) {
+            break;
+        }
+        pos += written;
+    }
+    setp(data.data(), data.data() + data.size());
+}
+
+/**
+ * @brief the buffer is full, write it out and keep going
+ * @param c - the character that didn't fit
+ * @return int - the character, or eof if it can't be written
+*/
+int OutputSink::overflow(int c) {
+    flush();
+    if (c != traits_type::eof()) {
+        *pptr() = c;
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+/**
+ * @brief called whenever the stream is flushed, which happens on every endl
+ * only the strict policy writes here, the others wait until the policy says to
+ * @return int - always 0
+*/
+int OutputSink::sync() {
+    if (policy == FLUSH_STRICT || (policy == FLUSH_BYTES && (size_t)(pptr() - pbase()) >= flushBytes)) {
+        flush();
+    }
+    return 0;
+}
+
+/**
+ * @brief called after every command
+*/
+void OutputSink::endCommand() {
+    if (policy == FLUSH_PER_COMMAND) {
+        flush();
+    } else {
+        sync();
+    }
+}
+
+/**
+ * @brief swap the buffers of cout and cerr for output sinks
+ * @param policy - when the sinks write out their contents
+ * @param flushBytes - the number of buffered bytes that triggers a write when using FLUSH_BYTES
+*/
+OutputRedirect::OutputRedirect(FlushPolicy policy, size_t flushBytes)
+    : outSink(STDOUT_FILENO, policy, flushBytes, OUTPUT_BUFFER_SIZE),
+      errSink(STDERR_FILENO, policy, flushBytes, OUTPUT_BUFFER_SIZE) {
+    // anything already printed has to come out before the sinks start writing
+    cout.flush();
+    cerr.flush();
+    oldOut = cout.rdbuf(&outSink);
+    oldErr = cerr.rdbuf(&errSink);
+}
+
+/**
+ * @brief write out anything left in the sinks and put the original buffers back
+*/
+OutputRedirect::~OutputRedirect() {
+    outSink.flush();
+    errSink.flush();
+    cout.rdbuf(oldOut);
+    cerr.rdbuf(oldErr);
+}
+
+/**
+ * @brief called after every command
+*/
+void OutputRedirect::endCommand() {
+    outSink.endCommand();
+    errSink.endCommand();
+}
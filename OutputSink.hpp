@@ -0,0 +1,50 @@
+#pragma once
+
+#include <streambuf>
+#include <ostream>
+#include <vector>
+using namespace std;
+
+/**
+ * when a buffered output sink writes its contents out
+*/
+enum FlushPolicy {
+    FLUSH_STRICT,           // every flush of the stream is written right away, same as an unbuffered stream
+    FLUSH_PER_COMMAND,      // written after every command
+    FLUSH_BYTES,            // written once a set number of bytes are buffered
+    FLUSH_AT_EXIT           // only written when the buffer is full or at exit
+};
+
+/**
+ * a large stream buffer that writes to a file descriptor according to a flush policy,
+ * so printing lots of lines doesn't mean a system call for every endl
+*/
+class OutputSink : public streambuf {
+    private:
+        int fd;                                 // the file descriptor the output goes to
+        vector<char> data;                      // the buffered output
+        FlushPolicy policy;                     // when the buffer is written out
+        size_t flushBytes;                      // the number of bytes that triggers a write for FLUSH_BYTES
+    protected:
+        int overflow(int c) override;           // called when the buffer is full
+        int sync() override;                    // called on endl or flush
+    public:
+        OutputSink(int fd, FlushPolicy policy, size_t flushBytes, size_t capacity);
+        void flush();                           // write everything that is buffered
+        void endCommand();                      // called after every command
+};
+
+/**
+ * replaces the buffers of cout and cerr with output sinks until it is destroyed
+*/
+class OutputRedirect {
+    private:
+        OutputSink outSink;                     // sink for cout
+        OutputSink errSink;                     // sink for cerr
+        streambuf *oldOut;                      // the original buffer of cout
+        streambuf *oldErr;                      // the original buffer of cerr
+    public:
+        OutputRedirect(FlushPolicy policy, size_t flushBytes);
+        ~OutputRedirect();
+        void endCommand();                      // called after every command
+};
@@ -0,0 +1,148 @@
+#include "ScriptCompiler.hpp"
+using namespace std;
+
+/**
+ * @brief default constructor
+*/
+ScriptCompiler::ScriptCompiler() {
+    // the lines are reused for every window so their storage is only allocated once
+    lines.resize(COMPILE_WINDOW);
+    ops.reserve(COMPILE_WINDOW);
+    lineNumber = 0;
+    totalOps = 0;
+    elidedOps = 0;
+}
+
+/**
+ * @brief read the next window of commands from the input file and compile them
+ * only commands within the same window are compared, so memory use stays bounded and
+ * anything that crosses a window boundary is just run as is
+ * @param input - the script being compiled
+ * @return bool - false once there are no commands left
+*/
+bool ScriptCompiler::compileWindow(istream &input) {
+    ops.clear();
+    size_t n = 0;
+    while (n < COMPILE_WINDOW && getline(input, lines[n])) {
+        CompiledOp op;
+        const Command &command = parser.parse(lines[n]);
+        op.valid = parser.validate();
+        op.command = command;
+        op.line = ++lineNumber;
+        if (op.valid) {
+            totalOps++;
+        }
+        ops.push_back(op);
+        n++;
+    }
+    if (n == 0) {
+        return false;
+    }
+    elideDeadBuffers();
+    elideRepeats();
+    return true;
+}
+
+/**
+ * @brief replace buffer commands whose contents are replaced by another buffer command before any read or write
+ * the replaced command still gives the "no file system" error if nothing is mounted
+ * loading from a host file always replaces the buffer, but it is never replaced itself since it can fail
+*/
+void ScriptCompiler::elideDeadBuffers() {
+    // walk backwards remembering the next command that uses or replaces the buffer
+    char nextBufferOp = NO_COMMAND;
+    for (size_t i = ops.size(); i-- > 0;) {
+        if (!ops[i].valid) {
+            continue;
+        }
+        char op = ops[i].command.op;
+        if (op == BUFFER || op == BUFFER_DATA) {
+            if (nextBufferOp == BUFFER) {
+                elide(ops[i], NOP);
+            }
+            nextBufferOp = BUFFER;
+        } else if (op == BUFFER_FILE) {
+            nextBufferOp = BUFFER;
+        } else if (op == READ || op == WRITE) {
+            nextBufferOp = op;
+        }
+    }
+}
+
+/**
+ * @brief replace commands that can't have a different effect than an earlier one
+ * - "Y ." never changes anything
+ * - an ls with only reads, writes and buffer commands since the last ls prints the same listing
+ * - a write of the same block with nothing in between that could change the buffer or the file only repeats its checks
+*/
+void ScriptCompiler::elideRepeats() {
+    bool listingUnchanged = false;
+    int lastWrite = -1;
+    for (size_t i = 0; i < ops.size(); i++) {
+        CompiledOp &op = ops[i];
+        if (!op.valid) {
+            continue;
+        }
+        switch (op.command.op) {
+            case CD:
+                if (op.command.name == CUR_DIR_STRING) {
+                    elide(op, NOP);
+                } else {
+                    listingUnchanged = false;
+                    lastWrite = -1;
+                }
+                break;
+            case LS:
+                if (listingUnchanged) {
+                    elide(op, LS_REPEAT);
+                }
+                listingUnchanged = true;
+                break;
+            case WRITE:
+                if (lastWrite != -1 && ops[lastWrite].command.name == op.command.name
+                        && ops[lastWrite].command.number == op.command.number) {
+                    elide(op, WRITE_REPEAT);
+                }
+                lastWrite = i;
+                break;
+            case READ:
+            case BUFFER:
+            case BUFFER_FILE:
+            case BUFFER_DATA:
+            case NOP:
+                // these change the buffer but not the directory listing, a NOP here is a replaced buffer command
+                lastWrite = -1;
+                break;
+            default:
+                listingUnchanged = false;
+                lastWrite = -1;
+                break;
+        }
+    }
+}
+
+/**
+ * @brief replace a redundant command
+ * @param op - the command to replace
+ * @param replacement - the operation to run instead
+*/
+void ScriptCompiler::elide(CompiledOp &op, char replacement) {
+    op.command.op = replacement;
+    elidedOps++;
+}
+
+/**
+ * @brief get the compiled commands of the current window
+ * @return vector<CompiledOp> - the commands in the order they are in the script
+*/
+const vector<CompiledOp> &ScriptCompiler::getOps() {
+    return ops;
+}
+
+long ScriptCompiler::getTotalOps() {
+    return totalOps;
+}
+
+long ScriptCompiler::getElidedOps() {
+    return elidedOps;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <istream>
+#include <string>
+#include <vector>
+#include "CommandParser.hpp"
+using namespace std;
+
+/**
+ * a command of the script after compiling, the command views point into the compiler's line storage
+*/
+struct CompiledOp {
+    Command command;        // the command to run, redundant commands are replaced with NOP, LS_REPEAT or WRITE_REPEAT
+    int line;               // the line number of the command in the script
+    bool valid;             // false if the line is not a valid command
+};
+
+class ScriptCompiler {
+    private:
+        CommandParser parser;                       // parser used for every line
+        vector<string> lines;                       // the text of the commands in the current window
+        vector<CompiledOp> ops;                     // the compiled commands of the current window
+        int lineNumber;                             // the line number of the last line read
+        long totalOps;                              // the number of valid commands compiled
+        long elidedOps;                             // the number of commands that were replaced
+        void elide(CompiledOp &op, char replacement);   // replace a redundant command
+        void elideDeadBuffers();                    // replace buffer commands that are overwritten before being used
+        void elideRepeats();                        // replace commands that repeat the one before them
+    public:
+        ScriptCompiler();                           // default constructor
+        bool compileWindow(istream &input);         // read and compile the next window of commands
+        const vector<CompiledOp> &getOps();         // the compiled commands of the current window
+        long getTotalOps();                         // the number of valid commands compiled
+        long getElidedOps();                        // the number of commands that were replaced
+};
@@ -0,0 +1,271 @@
+#include "ScriptRunner.hpp"
+#include "CommandParser.hpp"
+#include "CommandRunner.hpp"
+#include "ScriptCompiler.hpp"
+#include "ThreadPool.hpp"
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+using namespace std;
+
+/**
+ * @brief default constructor
+*/
+RunOptions::RunOptions() {
+    autoDefrag = false;
+    localityDefrag = false;
+    compile = false;
+    compileReport = false;
+    defragThreshold = DEFRAG_THRESHOLD;
+    defragStep = DEFRAG_STEP_BLOCKS;
+    defragBudget = DEFRAG_TIME_BUDGET_US;
+    flushPolicy = FLUSH_STRICT;
+    flushBytes = 0;
+    jobs = 1;
+    sharedDisk = false;
+    stats = false;
+    dedup = false;
+    extents = false;
+    growBackward = false;
+    prealloc = 0;
+}
+
+/**
+ * @brief open a script with a large buffer so long scripts are read in big chunks
+ * @param input - the stream to open
+ * @param buffer - the buffer of the stream, it has to live as long as the stream is used
+ * @param filename - the script to open
+ * @param err - where the error goes if the script can't be opened
+ * @return bool - if opening the script was successful
+*/
+static bool openScript(ifstream &input, vector<char> &buffer, const string &filename, ostream &err) {
+    buffer.resize(INPUT_BUFFER_SIZE);
+    // the buffer has to be set before the file is opened to take effect
+    input.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    input.open(filename, ios::in);
+    if (!input.is_open()) {
+        err << "Error: input file does not exist: "  << filename << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief run the commands of a script one line at a time
+ * commands are read one at a time as they are run, so memory use doesn't depend on the script length
+ * @param session - the session the commands run in, its streams get the output
+ * @param input - the script
+ * @param output - the buffered output, null if printing straight to the session's streams
+*/
+void runScript(FileSystem &fs, Session &session, istream &input, const string &filename, OutputRedirect *output) {
+    CommandParser parser = CommandParser();
+    string command;
+    int i = 1;
+    while (getline(input, command)) {
+        const Command &parsed = parser.parse(command);
+        if (parser.validate()) {
+            session.line = i;
+            runCommand(fs, session, parsed);
+        } else {
+            *session.err << "Command Error: " << filename << ", " << i << endl;
+        }
+        fs.runBackgroundTasks();
+        if (output) {
+            output->endCommand();
+        }
+        i++;
+    }
+}
+
+/**
+ * @brief compile the commands of a script a window at a time and run them,
+ * the output is the same as runScript but redundant commands are skipped
+ * @param session - the session the commands run in, its streams get the output
+ * @param input - the script
+ * @param output - the buffered output, null if printing straight to the session's streams
+ * @param report - if true print how many commands were skipped at the end
+*/
+void runCompiledScript(FileSystem &fs, Session &session, istream &input, const string &filename, OutputRedirect *output, bool report) {
+    ScriptCompiler compiler = ScriptCompiler();
+    while (compiler.compileWindow(input)) {
+        for (const CompiledOp &op : compiler.getOps()) {
+            if (op.valid) {
+                session.line = op.line;
+                runCommand(fs, session, op.command);
+            } else {
+                *session.err << "Command Error: " << filename << ", " << op.line << endl;
+            }
+            fs.runBackgroundTasks();
+            if (output) {
+                output->endCommand();
+            }
+        }
+    }
+    if (report) {
+        *session.err << "Compiler: elided " << compiler.getElidedOps() << " of " << compiler.getTotalOps() << " operations" << endl;
+    }
+}
+
+/**
+ * @brief run one script on its own file system
+ * @param filename - the script to run
+ * @param options - how to run the script
+ * @param out - where the output of the script goes
+ * @param err - where the errors of the script go
+ * @param output - the buffered output, null if not buffering
+ * @return bool - false if the script couldn't be opened
+*/
+bool runScriptFile(const string &filename, const RunOptions &options, ostream &out, ostream &err, OutputRedirect *output) {
+    FileSystem fs = FileSystem();
+    fs.useLocalityDefrag(options.localityDefrag);
+    if (options.dedup) {
+        fs.enableDedup();
+    }
+    if (options.extents) {
+        fs.enableExtents();
+    }
+    if (options.growBackward) {
+        fs.enableBackwardGrowth();
+    }
+    if (options.prealloc > 0) {
+        fs.enablePrealloc(options.prealloc);
+    }
+    if (options.autoDefrag) {
+        fs.enableAutoDefrag(options.defragThreshold, options.defragStep, options.defragBudget);
+    }
+    if (options.stats) {
+        fs.enableStats(options.statsFile);
+    }
+    vector<char> inputBuffer;
+    ifstream input;
+    if (!openScript(input, inputBuffer, filename, err)) {
+        return false;
+    }
+    if (!options.traceFile.empty() && !fs.enableTrace(options.traceFile)) {
+        err << "Error: Cannot write trace: " << options.traceFile << endl;
+    }
+    Session session(out, err);
+    if (options.compile) {
+        runCompiledScript(fs, session, input, filename, output, options.compileReport);
+    } else {
+        runScript(fs, session, input, filename, output);
+    }
+    fs.close();
+    return true;
+}
+
+/**
+ * @brief run one script as a session of a file system that other scripts are using at the same time
+ * @param fs - the shared file system
+ * @param filename - the script to run
+ * @param out - where the output of the script goes
+ * @param err - where the errors of the script go
+ * @return bool - false if the script couldn't be opened
+*/
+bool runSessionScript(FileSystem &fs, const string &filename, ostream &out, ostream &err) {
+    vector<char> inputBuffer;
+    ifstream input;
+    if (!openScript(input, inputBuffer, filename, err)) {
+        return false;
+    }
+    Session session(out, err);
+    runScript(fs, session, input, filename, nullptr);
+    return true;
+}
+
+/**
+ * @brief run many scripts at once, each with its own file system, on a work stealing thread pool
+ * with the shared disk option the scripts are sessions of one file system instead, so they see each other's changes
+ * the output of each script is kept separate, either written to its own files in the output
+ * directory, or printed to stdout/stderr one whole script at a time in the order the scripts were given
+ * @param filenames - the scripts to run
+ * @param options - how to run the scripts
+ * @return bool - false if any script couldn't be opened
+*/
+bool runScriptFiles(const vector<string> &filenames, const RunOptions &options) {
+    size_t count = filenames.size();
+    vector<ostringstream> outs(count);
+    vector<ostringstream> errs(count);
+    vector<bool> done(count, false);
+    vector<bool> opened(count, false);
+    mutex doneLock;
+    condition_variable doneSignal;
+
+    FileSystem shared = FileSystem();
+    shared.useLocalityDefrag(options.localityDefrag);
+    if (options.dedup) {
+        shared.enableDedup();
+    }
+    if (options.extents) {
+        shared.enableExtents();
+    }
+    if (options.growBackward) {
+        shared.enableBackwardGrowth();
+    }
+    if (options.prealloc > 0) {
+        shared.enablePrealloc(options.prealloc);
+    }
+    if (options.autoDefrag) {
+        shared.enableAutoDefrag(options.defragThreshold, options.defragStep, options.defragBudget);
+    }
+    if (options.stats && options.sharedDisk) {
+        shared.enableStats(options.statsFile);
+    }
+    if (!options.traceFile.empty() && options.sharedDisk && !shared.enableTrace(options.traceFile)) {
+        cerr << "Error: Cannot write trace: " << options.traceFile << endl;
+    }
+    auto run = [&](size_t i, ostream &out, ostream &err) {
+        if (options.sharedDisk) {
+            return runSessionScript(shared, filenames[i], out, err);
+        }
+        // every file system gets its own trace, numbered by the position of its script
+        RunOptions scriptOptions = options;
+        if (!scriptOptions.traceFile.empty()) {
+            scriptOptions.traceFile += '.';
+            scriptOptions.traceFile += to_string(i);
+        }
+        return runScriptFile(filenames[i], scriptOptions, out, err, nullptr);
+    };
+
+    vector<function<void()>> tasks;
+    for (size_t i = 0; i < count; i++) {
+        tasks.push_back([&, i]() {
+            bool ok;
+            if (options.outputDir.empty()) {
+                ok = run(i, outs[i], errs[i]);
+            } else {
+                // name the files by position too so scripts with the same name don't clash
+                string base = filenames[i].substr(filenames[i].find_last_of('/') + 1);
+                string prefix = options.outputDir + "/" + to_string(i) + "-" + base;
+                ofstream out(prefix + ".stdout");
+                ofstream err(prefix + ".stderr");
+                ok = run(i, out, err);
+            }
+            lock_guard<mutex> guard(doneLock);
+            opened[i] = ok;
+            done[i] = true;
+            doneSignal.notify_all();
+        });
+    }
+    ThreadPool pool(options.jobs);
+    pool.start(tasks);
+
+    // print each script's output as soon as it and every script before it are done
+    bool allOpened = true;
+    for (size_t i = 0; i < count; i++) {
+        unique_lock<mutex> guard(doneLock);
+        doneSignal.wait(guard, [&]() { return (bool)done[i]; });
+        allOpened = allOpened && opened[i];
+        guard.unlock();
+        cout << outs[i].str();
+        cerr << errs[i].str();
+        outs[i] = ostringstream();
+        errs[i] = ostringstream();
+    }
+    pool.wait();
+    shared.close();
+    return allOpened;
+}
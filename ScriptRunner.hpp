@@ -0,0 +1,42 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "FileSystem.hpp"
+#include "OutputSink.hpp"
+#include "Session.hpp"
+using namespace std;
+
+/**
+ * the command line options that change how a script is run
+*/
+struct RunOptions {
+    bool autoDefrag;                // run incremental defrag between commands
+    bool localityDefrag;            // make the defrag command group files by directory
+    bool compile;                   // run the script through the script compiler
+    bool compileReport;             // print how many commands the compiler skipped
+    int defragThreshold;            // fragmentation percentage that starts an incremental defrag
+    int defragStep;                 // max blocks moved per defrag step
+    int defragBudget;               // microseconds of defrag work allowed between commands
+    FlushPolicy flushPolicy;        // when buffered output is written
+    int flushBytes;                 // bytes buffered before writing for FLUSH_BYTES
+    int jobs;                       // number of threads used to run several scripts
+    string outputDir;               // if set, each script's output goes to its own files in this directory
+    bool sharedDisk;                // run the scripts as sessions of one file system
+    bool stats;                     // record counters and command latencies
+    string statsFile;               // if set, the stats are appended to this file as json when a file system closes
+    string traceFile;               // if set, every disk access is traced to this file
+    bool dedup;                     // share the blocks written with the same contents
+    bool extents;                   // grow files with more runs of blocks instead of moving them
+    bool growBackward;              // grow files back into the free blocks before them instead of moving them
+    int prealloc;                   // the most blocks reserved after a file that keeps growing, 0 if off
+    RunOptions();                   // default constructor
+};
+
+void runScript(FileSystem &fs, Session &session, istream &input, const string &filename, OutputRedirect *output);   // run a script a line at a time
+void runCompiledScript(FileSystem &fs, Session &session, istream &input, const string &filename, OutputRedirect *output, bool report);   // run a script through the compiler
+bool runScriptFile(const string &filename, const RunOptions &options, ostream &out, ostream &err, OutputRedirect *output);  // run one script on a new file system
+bool runSessionScript(FileSystem &fs, const string &filename, ostream &out, ostream &err);      // run a script as a session of a shared file system
+bool runScriptFiles(const vector<string> &filenames, const RunOptions &options);                // run many scripts in parallel
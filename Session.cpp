@@ -0,0 +1,45 @@
+#include "Session.hpp"
+#include <unistd.h>
+#include <cstring>
+using namespace std;
+
+/**
+ * @brief constructor
+ * @param outStream - the stream for normal output
+ * @param errStream - the stream for errors
+*/
+Session::Session(ostream &outStream, ostream &errStream) {
+    clearBuffer();
+    currentDirectory = ROOT_DIR;
+    out = &outStream;
+    err = &errStream;
+    diskFd = -1;
+    mountCount = 0;
+    command = NO_COMMAND;
+    line = 0;
+}
+
+/**
+ * @brief destructor
+*/
+Session::~Session() {
+    closeDisk();
+}
+
+/**
+ * @brief make the buffer a single zeroed block
+*/
+void Session::clearBuffer() {
+    // shrinking keeps the capacity so a buffer that held many blocks isn't allocated again
+    buffer.assign(BLOCK_SIZE, 0);
+}
+
+/**
+ * @brief close the disk descriptor, the next read opens the mounted disk again
+*/
+void Session::closeDisk() {
+    if (diskFd != -1) {
+        ::close(diskFd);
+        diskFd = -1;
+    }
+}
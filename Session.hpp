@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <ostream>
+#include <vector>
+#include "Constants.hpp"
+using namespace std;
+
+/**
+ * the state of one client of a file system, every session has its own buffer, working directory
+ * and output streams so several sessions can share the mounted disk of one file system
+*/
+struct Session {
+    vector<uint8_t> buffer;                     // the session's buffer, one block unless loaded with more
+    uint8_t currentDirectory;                   // the index of the cwd in the inode array
+    string lastListing;                         // the output of the last ls command
+    ostream *out;                               // where command output is printed
+    ostream *err;                               // where errors are printed
+    int diskFd;                                 // read only descriptor of the mounted disk, -1 until the first read
+    unsigned long mountCount;                   // the mount the working directory and descriptor belong to
+    string diskName;                            // the name of the disk of that mount
+    char command;                               // the command being run, traced with the disk accesses it makes
+    long line;                                  // the line of the script or connection the command came from
+    Session(ostream &outStream, ostream &errStream);    // constructor
+    ~Session();                                 // closes the disk descriptor
+    Session(const Session&) = delete;
+    Session &operator=(const Session&) = delete;
+    void clearBuffer();                         // zero out the buffer
+    void closeDisk();                           // close the disk descriptor
+};
@@ -0,0 +1,159 @@
+#include "Snapshot.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+// a block of the overlay file is the number of the disk block followed by its contents
+const long RECORD_SIZE = sizeof(int32_t) + BLOCK_SIZE;
+
+/**
+ * @brief default constructor, there are no snapshots until one is taken
+*/
+Snapshots::Snapshots() {
+    fd = -1;
+    end = 0;
+    fill(location, location + NUM_BLOCKS, -1);
+}
+
+/**
+ * @brief destructor, the overlay file is left for the next mount of the disk to commit
+*/
+Snapshots::~Snapshots() {
+    detach();
+}
+
+/**
+ * @brief take a snapshot of the disk as it is now, the first one makes the overlay file next to the disk
+ * @param diskName - the disk the snapshot is of
+ * @return bool - false if the overlay file can't be made
+*/
+bool Snapshots::take(const string &diskName) {
+    if (fd == -1) {
+        name = diskName + ".snap";
+        fd = open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd == -1) {
+            return false;
+        }
+        end = 0;
+    }
+    saved.push_back(vector<long>(location, location + NUM_BLOCKS));
+    savedEnd.push_back(end);
+    return true;
+}
+
+/**
+ * @brief open the overlay file a crash left next to the disk, as one snapshot holding every block in it
+ * the blocks written since a snapshot are only ever rewritten in place, so the last copy of each block in
+ * the file is the one that was written last, a copy cut short by the crash at the end of the file is left out
+ * @param diskName - the disk being mounted
+ * @return bool - false if the disk has no overlay file
+*/
+bool Snapshots::recover(const string &diskName) {
+    detach();
+    name = diskName + ".snap";
+    fd = open(name.c_str(), O_RDWR);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat info;
+    long size = fstat(fd, &info) == 0 ? info.st_size : 0;
+    for (end = 0; end + RECORD_SIZE <= size; end += RECORD_SIZE) {
+        int32_t block;
+        if (pread(fd, &block, sizeof(block), end) != sizeof(block)) {
+            break;
+        }
+        if (block >= 0 && block < NUM_BLOCKS) {
+            location[block] = end;
+        }
+    }
+    saved.push_back(vector<long>(NUM_BLOCKS, -1));
+    savedEnd.push_back(0);
+    return true;
+}
+
+/**
+ * @brief put every block back where it was when the latest snapshot was taken, the blocks written since are
+ * thrown away by cutting them off the end of the overlay file, nothing changes if it can't be cut
+ * @return bool - false if there is no snapshot or the overlay file can't be cut back
+*/
+bool Snapshots::rollback() {
+    if (saved.empty()) {
+        return false;
+    }
+    if (saved.size() == 1) {
+        // the disk file is the first snapshot, the overlay isn't needed anymore
+        drop();
+        return true;
+    }
+    // a crash has to find the overlay as the snapshot left it
+    if (ftruncate(fd, savedEnd.back()) == -1) {
+        return false;
+    }
+    copy(saved.back().begin(), saved.back().end(), location);
+    end = savedEnd.back();
+    saved.pop_back();
+    savedEnd.pop_back();
+    return true;
+}
+
+/**
+ * @brief read a block from the overlay, holds has to be checked first
+ * @param block - the block of the disk
+ * @param data - where the block is read to
+ * @return bool - false if the overlay file can't be read
+*/
+bool Snapshots::readBlock(int block, uint8_t *data) {
+    return pread(fd, data, BLOCK_SIZE, location[block] + sizeof(int32_t)) == (ssize_t)BLOCK_SIZE;
+}
+
+/**
+ * @brief write a block to the overlay, it is written in place if it was already written since the latest snapshot,
+ * otherwise the copy the snapshot has is left alone and the block gets a fresh block at the end of the overlay
+ * @param block - the block of the disk
+ * @param data - the contents of the block
+ * @return bool - false if the overlay file can't be written, the block keeps its old contents
+*/
+bool Snapshots::writeBlock(int block, const uint8_t *data) {
+    long at = location[block] < savedEnd.back() ? end : location[block];
+    uint8_t record[RECORD_SIZE];
+    int32_t number = block;
+    memcpy(record, &number, sizeof(number));
+    memcpy(record + sizeof(number), data, BLOCK_SIZE);
+    if (pwrite(fd, record, RECORD_SIZE, at) != RECORD_SIZE) {
+        return false;
+    }
+    if (at == end) {
+        location[block] = end;
+        end += RECORD_SIZE;
+    }
+    return true;
+}
+
+/**
+ * @brief close the overlay file and forget every snapshot, the blocks in the overlay stay in the file
+ * so the next mount of the disk writes them to it
+*/
+void Snapshots::detach() {
+    if (fd != -1) {
+        close(fd);
+    }
+    fd = -1;
+    end = 0;
+    fill(location, location + NUM_BLOCKS, -1);
+    saved.clear();
+    savedEnd.clear();
+}
+
+/**
+ * @brief remove the overlay file and forget every snapshot, to keep the blocks in the overlay they have to be
+ * read out and written to the disk first
+*/
+void Snapshots::drop() {
+    if (fd != -1) {
+        unlink(name.c_str());
+    }
+    detach();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Constants.hpp"
+using namespace std;
+
+/**
+ * the copy on write overlay of a disk that has snapshots, the disk file keeps every block as it was when the
+ * first snapshot was taken and blocks written after that go to fresh blocks of an overlay file instead, so
+ * taking a snapshot only saves where each block is and rolling back only puts that back, no data is copied.
+ * each block in the overlay file is stored after the number of the disk block it is, so the overlay a crash
+ * leaves behind can be read back and committed by the next mount of the disk
+*/
+class Snapshots {
+    private:
+        int fd;                                         // the overlay file, -1 without snapshots
+        string name;                                    // the name of the overlay file, next to the disk
+        long location[NUM_BLOCKS];                      // where each block is in the overlay file, -1 if it is still on the disk
+        vector<vector<long>> saved;                     // the locations when each snapshot was taken, the latest last
+        vector<long> savedEnd;                          // the size of the overlay file when each snapshot was taken
+        long end;                                       // the size of the overlay file
+    public:
+        Snapshots();                                    // default constructor, there are no snapshots
+        ~Snapshots();                                   // closes the overlay file, it is kept for the next mount
+        Snapshots(const Snapshots&) = delete;
+        Snapshots &operator=(const Snapshots&) = delete;
+        bool take(const string &diskName);              // start a snapshot, false if the overlay file can't be made
+        bool recover(const string &diskName);           // open the overlay a crash left behind, false if there is none
+        bool rollback();                                // go back to the latest snapshot and remove it, false if the overlay can't be cut back
+        bool isActive() { return fd != -1; }
+        size_t count() { return saved.size(); }         // the number of snapshots
+        bool holds(int block) { return fd != -1 && location[block] != -1; }    // checks if a block is in the overlay
+        bool readBlock(int block, uint8_t *data);       // read a block that is in the overlay, false if it can't be read
+        bool writeBlock(int block, const uint8_t *data);    // write a block to the overlay, false if it can't be written
+        void detach();                                  // close the overlay file and forget every snapshot, the file is kept
+        void drop();                                    // remove the overlay file and forget every snapshot
+};
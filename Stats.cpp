@@ -0,0 +1,281 @@
+#include "Stats.hpp"
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+// the names of the counters in the table and the json, in StatCounter order
+static const char *COUNTER_NAMES[NUM_STAT_COUNTERS] = {
+    "bytes_read",
+    "bytes_written",
+    "seeks",
+    "superblock_flushes",
+    "map_rebuilds",
+    "allocator_scans",
+    "relocations",
+    "uncompressed_bytes",
+    "compressed_bytes",
+    "dedup_hits",
+    "dedup_breaks",
+    "backward_grows",
+    "prealloc_hits",
+    "prealloc_reclaims",
+    "unwritten_reads",
+    "zeroing_skipped",
+    "readahead_blocks",
+    "readahead_hits",
+    "readahead_misses"
+};
+
+// the bits of a value below its highest bit that pick one of the 8 buckets of its power of two
+const int SUB_BUCKET_BITS = 3;
+const uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+///////////////////////////////////////////////////
+// Latency Histogram
+///////////////////////////////////////////////////
+
+/**
+ * @brief default constructor
+*/
+LatencyHistogram::LatencyHistogram() {
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        buckets[i] = 0;
+    }
+    count = 0;
+    total = 0;
+    max = 0;
+}
+
+/**
+ * @brief find the bucket a value is counted in
+ * values below 8 get a bucket each, bigger values go by their highest bit and the 3 bits below it
+ * @return size_t - the index of the bucket
+*/
+size_t LatencyHistogram::bucketFor(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+        return value;
+    }
+    int exponent = bit_width(value) - 1;
+    uint64_t sub = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+/**
+ * @brief the largest value that is counted in a bucket
+*/
+uint64_t LatencyHistogram::bucketTop(size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    int exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    uint64_t sub = bucket % SUB_BUCKETS;
+    uint64_t bottom = (SUB_BUCKETS + sub) << (exponent - SUB_BUCKET_BITS);
+    return bottom + (1ULL << (exponent - SUB_BUCKET_BITS)) - 1;
+}
+
+/**
+ * @brief add a value to the histogram
+ * @param nanos - the latency in nanoseconds
+*/
+void LatencyHistogram::record(uint64_t nanos) {
+    buckets[bucketFor(nanos)].fetch_add(1, memory_order_relaxed);
+    count.fetch_add(1, memory_order_relaxed);
+    total.fetch_add(nanos, memory_order_relaxed);
+    uint64_t largest = max.load(memory_order_relaxed);
+    while (nanos > largest && !max.compare_exchange_weak(largest, nanos, memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::getCount() {
+    return count;
+}
+
+uint64_t LatencyHistogram::getMean() {
+    return count == 0 ? 0 : total / count;
+}
+
+uint64_t LatencyHistogram::getMax() {
+    return max;
+}
+
+/**
+ * @brief find the value that a percentage of the recorded values are at or below
+ * @param percent - the percentage, 0 to 100
+ * @return uint64_t - the top of the bucket the value is in, never more than the largest value
+*/
+uint64_t LatencyHistogram::percentile(double percent) {
+    uint64_t recorded = count;
+    if (recorded == 0) {
+        return 0;
+    }
+    uint64_t wanted = (uint64_t)ceil(percent / 100 * recorded);
+    if (wanted == 0) {
+        wanted = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= wanted) {
+            return min(bucketTop(i), getMax());
+        }
+    }
+    return getMax();
+}
+
+///////////////////////////////////////////////////
+// Stats
+///////////////////////////////////////////////////
+
+/**
+ * @brief add a "name":value pair to some json
+*/
+static void appendField(string &json, const char *name, uint64_t value) {
+    char field[64];
+    int len = snprintf(field, sizeof(field), "\"%s\":%llu", name, (unsigned long long)value);
+    json.append(field, len);
+}
+
+/**
+ * @brief default constructor, stats start disabled
+*/
+Stats::Stats() {
+    enabled = false;
+    for (size_t i = 0; i < NUM_STAT_COUNTERS; i++) {
+        counters[i] = 0;
+    }
+}
+
+/**
+ * @brief start recording, this has to happen before the file system is used by more than one thread
+ * @param path - the file the stats are appended to when the file system closes, empty for none
+*/
+void Stats::enable(const string &path) {
+    enabled = true;
+    dumpPath = path;
+}
+
+/**
+ * @brief add the latency of a command
+ * @param op - the command letter
+ * @param nanos - how long the command took
+*/
+void Stats::recordLatency(char op, uint64_t nanos) {
+    const char *found = (const char*)memchr(STAT_OPS, op, NUM_STAT_OPS);
+    if (enabled && found != nullptr) {
+        latency[found - STAT_OPS].record(nanos);
+    }
+}
+
+/**
+ * @brief print the counters and the latency of every command that has run
+ * @param out - where the table is printed
+*/
+void Stats::print(ostream &out) {
+    char line[128];
+    for (size_t i = 0; i < NUM_STAT_COUNTERS; i++) {
+        snprintf(line, sizeof(line), "%-20s %12llu\n", COUNTER_NAMES[i], (unsigned long long)counters[i].load());
+        out << line;
+    }
+    uint64_t uncompressed = counters[STAT_UNCOMPRESSED_BYTES].load();
+    uint64_t compressed = counters[STAT_COMPRESSED_BYTES].load();
+    if (uncompressed > 0) {
+        // a compressed image was used, how much smaller its block traffic was
+        if (compressed == 0) {
+            snprintf(line, sizeof(line), "%-20s %12s\n", "compression_ratio", "inf");
+        } else {
+            snprintf(line, sizeof(line), "%-20s %12.2f\n", "compression_ratio", (double)uncompressed / compressed);
+        }
+        out << line;
+        snprintf(line, sizeof(line), "%-20s %12lld\n", "io_saved_bytes", (long long)uncompressed - (long long)compressed);
+        out << line;
+    }
+    uint64_t hits = counters[STAT_READAHEAD_HITS].load();
+    uint64_t misses = counters[STAT_READAHEAD_MISSES].load();
+    if (counters[STAT_READAHEAD_BLOCKS].load() > 0) {
+        // reads went sequentially through a file, the share of the blocks read that were already read ahead
+        snprintf(line, sizeof(line), "%-20s %12.2f\n", "readahead_hit_rate", (double)hits / (hits + misses));
+        out << line;
+    }
+    snprintf(line, sizeof(line), "%-3s %10s %10s %10s %10s %10s %10s\n", "op", "count", "mean_ns", "p50_ns", "p99_ns", "p999_ns", "max_ns");
+    out << line;
+    for (size_t i = 0; i < NUM_STAT_OPS; i++) {
+        LatencyHistogram &histogram = latency[i];
+        if (histogram.getCount() == 0) {
+            continue;
+        }
+        snprintf(line, sizeof(line), "%-3c %10llu %10llu %10llu %10llu %10llu %10llu\n", STAT_OPS[i],
+                 (unsigned long long)histogram.getCount(), (unsigned long long)histogram.getMean(),
+                 (unsigned long long)histogram.percentile(50), (unsigned long long)histogram.percentile(99),
+                 (unsigned long long)histogram.percentile(99.9), (unsigned long long)histogram.getMax());
+        out << line;
+    }
+}
+
+/**
+ * @brief the stats as a single line of json, commands that haven't run are left out
+ * @return string - {"counters":{...},"latency_ns":{"R":{"count":..,"mean":..,"p50":..,"p90":..,"p99":..,"p999":..,"max":..},...}}
+*/
+string Stats::toJson() {
+    string json = "{\"counters\":{";
+    for (size_t i = 0; i < NUM_STAT_COUNTERS; i++) {
+        if (i > 0) {
+            json += ',';
+        }
+        appendField(json, COUNTER_NAMES[i], counters[i]);
+    }
+    json += "},\"latency_ns\":{";
+    bool first = true;
+    for (size_t i = 0; i < NUM_STAT_OPS; i++) {
+        LatencyHistogram &histogram = latency[i];
+        if (histogram.getCount() == 0) {
+            continue;
+        }
+        if (!first) {
+            json += ',';
+        }
+        first = false;
+        char op[2] = {STAT_OPS[i], 0};
+        json += '"';
+        json += op;
+        json += "\":{";
+        appendField(json, "count", histogram.getCount());
+        json += ',';
+        appendField(json, "mean", histogram.getMean());
+        json += ',';
+        appendField(json, "p50", histogram.percentile(50));
+        json += ',';
+        appendField(json, "p90", histogram.percentile(90));
+        json += ',';
+        appendField(json, "p99", histogram.percentile(99));
+        json += ',';
+        appendField(json, "p999", histogram.percentile(99.9));
+        json += ',';
+        appendField(json, "max", histogram.getMax());
+        json += '}';
+    }
+    json += "}}\n";
+    return json;
+}
+
+/**
+ * @brief append the stats to the dump file as one line of json
+ * the line goes out in a single append so file systems closing at the same time don't mix their lines
+*/
+void Stats::dump() {
+    if (!enabled || dumpPath.empty()) {
+        return;
+    }
+    int fd = open(dumpPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd == -1) {
+        return;
+    }
+    string json = toJson();
+    if (::write(fd, json.data(), json.size()) == -1) {
+        // nothing else can be done with the stats at close
+    }
+    ::close(fd);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include "Constants.hpp"
+using namespace std;
+
+/**
+ * the things the file system counts while stats are enabled
+*/
+enum StatCounter {
+    STAT_BYTES_READ,            // bytes read from the disk
+    STAT_BYTES_WRITTEN,         // bytes written to the disk
+    STAT_SEEKS,                 // reads and writes that start somewhere new on the disk
+    STAT_SUPERBLOCK_FLUSHES,    // times the super block was written to the disk
+    STAT_MAP_REBUILDS,          // times the directory map was rebuilt
+    STAT_ALLOCATOR_SCANS,       // searches for a free inode or a run of free blocks
+    STAT_RELOCATIONS,           // files moved to another place on the disk
+    STAT_UNCOMPRESSED_BYTES,    // bytes of blocks read from or written to a compressed image
+    STAT_COMPRESSED_BYTES,      // bytes those blocks took in the image, and bytes of its header written
+    STAT_DEDUP_HITS,            // block writes dedup turned into sharing a block already stored
+    STAT_DEDUP_BREAKS,          // shared blocks copied out so one of the blocks sharing them could change
+    STAT_BACKWARD_GROWS,        // grows that moved a file back into the free blocks before it
+    STAT_PREALLOC_HITS,         // grows that fit in the blocks reserved after the file
+    STAT_PREALLOC_RECLAIMS,     // times the blocks reserved after files were given back
+    STAT_UNWRITTEN_READS,       // blocks read as zeros without touching the disk since they were never written
+    STAT_ZEROING_SKIPPED,       // blocks a delete, shrink or move didn't zero since they were never written
+    STAT_READAHEAD_BLOCKS,      // blocks read past the end of a sequential read in case the next read wants them
+    STAT_READAHEAD_HITS,        // blocks of reads copied from what was read ahead
+    STAT_READAHEAD_MISSES,      // blocks of reads that had to come from the disk
+    NUM_STAT_COUNTERS
+};
+
+/**
+ * a latency histogram with HDR style buckets, every power of two is split into 8 buckets
+ * so any value is recorded to within 12.5%, recording is lock free so sessions can share one
+*/
+class LatencyHistogram {
+    private:
+        atomic<uint64_t> buckets[HISTOGRAM_BUCKETS];        // the number of values recorded in each bucket
+        atomic<uint64_t> count;                             // the number of values recorded
+        atomic<uint64_t> total;                             // the sum of the values recorded
+        atomic<uint64_t> max;                               // the largest value recorded
+        static size_t bucketFor(uint64_t value);            // the bucket a value goes in
+        static uint64_t bucketTop(size_t bucket);           // the largest value that goes in a bucket
+    public:
+        LatencyHistogram();                                 // default constructor
+        void record(uint64_t nanos);                        // add a value
+        uint64_t getCount();                                // the number of values recorded
+        uint64_t getMean();                                 // the average of the values recorded
+        uint64_t getMax();                                  // the largest value recorded
+        uint64_t percentile(double percent);                // the value that percent of the values are at or below
+};
+
+/**
+ * the counters and per command latencies of a file system, nothing is recorded until it is enabled
+*/
+class Stats {
+    private:
+        bool enabled;                                       // if anything is recorded
+        string dumpPath;                                    // where the stats are appended as json when the file system closes
+        atomic<uint64_t> counters[NUM_STAT_COUNTERS];       // the counters
+        LatencyHistogram latency[NUM_STAT_OPS];             // a histogram for each command letter in STAT_OPS
+    public:
+        Stats();                                            // default constructor
+        void enable(const string &path);                    // start recording, an empty path means no dump
+        bool isEnabled() { return enabled; }
+        /**
+         * @brief add to a counter, this is only a branch while stats are disabled
+        */
+        void count(StatCounter counter, uint64_t amount = 1) {
+            if (enabled) {
+                counters[counter].fetch_add(amount, memory_order_relaxed);
+            }
+        }
+        uint64_t get(StatCounter counter) { return counters[counter]; }  // the value of a counter
+        void recordLatency(char op, uint64_t nanos);        // add the latency of a command
+        void print(ostream &out);                           // print the stats as a table
+        string toJson();                                    // the stats as one line of json
+        void dump();                                        // append the json to the dump file
+};
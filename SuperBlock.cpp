@@ -1,10 +1,13 @@
 #include "SuperBlock.hpp"
 #include <iostream>
 #include <string>
+#include <algorithm>
+#include <cstring>
 using namespace std;
 
-// making a global because making it a member variable would mess with read/write from the disk
-map<uint8_t, vector<uint8_t>> directoryStructure;
+// the free block list and inodes have to add up to exactly one block on the disk
+static_assert(sizeof(bitset<NUM_BLOCKS>) == NUM_BLOCKS / BITS_IN_BYTE, "free block list must be 16 bytes");
+static_assert(sizeof(bitset<NUM_BLOCKS>) + sizeof(Inode) * NUM_NODES == BLOCK_SIZE, "super block must fill one block");
 
 /**
  * @brief default constructor
@@ -13,6 +16,135 @@ SuperBlock::SuperBlock() {
     for (int i = 0; i < NUM_NODES; i++) {
         inode[i] = Inode();
     }
+    mapOutOfDate = true;
+    err = &cerr;
+    stats = nullptr;
+}
+
+/**
+ * @brief read the free block list and inodes from the first block of a disk
+ * only the on disk fields are read, the directory map is left as it is
+ * @param disk - the disk to read from
+*/
+void SuperBlock::readFrom(fstream &disk) {
+    char block[BLOCK_SIZE] = {0};
+    disk.seekg(0);
+    disk.read(block, BLOCK_SIZE);
+    load(block);
+}
+
+/**
+ * @brief write the free block list and inodes to the first block of a disk
+ * this is done as one whole block write, which the file stream passes straight to the file
+ * instead of buffering, so the disk is up to date if it gets opened again by another stream
+ * @param disk - the disk to write to
+*/
+void SuperBlock::writeTo(fstream &disk) {
+    char block[BLOCK_SIZE];
+    store(block);
+    disk.seekg(0);
+    disk.write(block, BLOCK_SIZE);
+}
+
+/**
+ * @brief fill the free block list and inodes from a copy of the first block of a disk
+ * @param block - the block to copy from
+*/
+void SuperBlock::load(const char block[BLOCK_SIZE]) {
+    memcpy(&free_block_list, block, sizeof(free_block_list));
+    memcpy(inode, block + sizeof(free_block_list), sizeof(inode));
+    mapOutOfDate = true;
+}
+
+/**
+ * @brief copy the free block list and inodes into a block laid out like the start of a disk
+ * @param block - the block to copy into
+*/
+void SuperBlock::store(char block[BLOCK_SIZE]) {
+    memcpy(block, &free_block_list, sizeof(free_block_list));
+    memcpy(block + sizeof(free_block_list), inode, sizeof(inode));
+}
+
+/**
+ * @brief read the runs of a file from its extent block
+ * @param index - the index of the file's inode
+ * @param block - the contents of the extent block
+*/
+void SuperBlock::loadExtentBlock(uint8_t index, const char block[BLOCK_SIZE]) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t*>(block);
+    extents[index].clear();
+    for (int i = 0; i < bytes[0]; i++) {
+        extents[index].push_back({bytes[1 + 2 * i], bytes[2 + 2 * i]});
+    }
+}
+
+/**
+ * @brief copy the runs of a file into a block laid out like its extent block
+ * @param index - the index of the file's inode
+ * @param block - the block to copy into
+*/
+void SuperBlock::storeExtentBlock(uint8_t index, char block[BLOCK_SIZE]) {
+    memset(block, 0, BLOCK_SIZE);
+    block[0] = extents[index].size();
+    for (size_t i = 0; i < extents[index].size(); i++) {
+        block[1 + 2 * i] = extents[index][i].start;
+        block[2 + 2 * i] = extents[index][i].length;
+    }
+}
+
+/**
+ * @brief get the runs of blocks a file is stored in, a file without an extent block is one run
+ * @param index - the index of the file's inode
+ * @return vector<BlockRun> - the runs in the order of the file, empty for a directory
+*/
+vector<BlockRun> SuperBlock::getRuns(uint8_t index) {
+    Inode node = inode[index];
+    if (node.hasExtentBlock()) {
+        return extents[index];
+    }
+    if (!node.isAFile()) {
+        return {};
+    }
+    return {{node.getStartBlock(), node.getUsedSize()}};
+}
+
+/**
+ * @brief set the runs of a file that has an extent block, the free block list isn't changed
+ * @param index - the index of the file's inode
+ * @param runs - the runs in the order of the file
+*/
+void SuperBlock::setRuns(uint8_t index, const vector<BlockRun> &runs) {
+    extents[index] = runs;
+}
+
+/**
+ * @brief free every block of a file in the free block list, the extent block too if it has one
+ * @param index - the index of the file's inode
+*/
+void SuperBlock::clearFileBlocks(uint8_t index) {
+    for (BlockRun run : getRuns(index)) {
+        clearBlock(run.start, run.start + run.length - 1);
+    }
+    if (inode[index].hasExtentBlock()) {
+        clearBlock(inode[index].getExtentBlock(), inode[index].getExtentBlock());
+        extents[index].clear();
+    }
+}
+
+/**
+ * @brief set where errors are printed
+ * @param stream - the stream to print errors to
+*/
+void SuperBlock::setErrorStream(ostream &stream) {
+    err = &stream;
+}
+
+/**
+ * @brief set where directory map rebuilds and allocator scans are counted
+ * @param stats - the stats of the file system, null to not count them
+*/
+void SuperBlock::setStats(Stats *stats) {
+    this->stats = stats;
 }
 
 /**
@@ -21,6 +153,7 @@ SuperBlock::SuperBlock() {
  * @param index - the index of the node to update
 */
 void SuperBlock::setNode(Inode node, int index) {
+    mapOutOfDate = mapOutOfDate || inode[index].getParent() != node.getParent();
     inode[index] = node;
 }
 
@@ -45,7 +178,7 @@ Inode SuperBlock::getNode(uint8_t index) {
 void SuperBlock::setBlock(int start, int end) {
     for (int i = start; i <= end; i++) {
         if (free_block_list[i] == 1) {
-            cerr << "Block is already in use: " << start << " - " << end << endl;
+            *err << "Block is already in use: " << start << " - " << end << endl;
             return;
         }
         free_block_list[i] = 1;
@@ -61,7 +194,7 @@ void SuperBlock::clearBlock(int start, int end) {
 
     for (int i = start; i <= end; i++) {
         if (free_block_list[i] == 0) {
-            cerr << "Block is already free: " << start << " - " << end << endl;
+            *err << "Block is already free: " << start << " - " << end << endl;
             return;
         }
         free_block_list[i] = 0;
@@ -112,10 +245,27 @@ int SuperBlock::checkConsistency() {
  * @return bool - returns true if it is consistent
 */
 bool SuperBlock::checkFreeList() {
+    // the blocks of files with an extent block aren't in the range of their inode, so they are counted first,
+    // runs that don't fit their file are left to the start block check
+    int extentUse[NUM_BLOCKS] = {0};
+    for (int j = 0; j < NUM_NODES; j++) {
+        if (!inode[j].hasExtentBlock() || !checkRuns(j)) {
+            continue;
+        }
+        extentUse[inode[j].getExtentBlock()]++;
+        for (BlockRun run : extents[j]) {
+            for (int b = run.start; b < run.start + run.length && b < NUM_BLOCKS; b++) {
+                extentUse[b]++;
+            }
+        }
+    }
 
     bool blockIsUsed;
     for (int i = 1; i < NUM_BLOCKS; i++) {
-        blockIsUsed = false;
+        blockIsUsed = extentUse[i] > 0;
+        if (extentUse[i] > 1 || (blockIsUsed && free_block_list[i] != 1)) {
+            return false;
+        }
         for (int j = 0; j < NUM_NODES; j++) {
             if (inode[j].blockInNodeRange(i)) {
                 // block should be free but isn't
@@ -187,7 +337,7 @@ bool SuperBlock::checkFreeNodes() {
 }
 
 /**
- * @brief checks that all files have valid start blocks
+ * @brief checks that all files have valid start blocks, and that the runs in extent blocks fit their files
  * @return bool - true if all nodes pass
 */
 bool SuperBlock::checkFileStart() {
@@ -198,10 +348,33 @@ bool SuperBlock::checkFileStart() {
                 return false;
             }
         }
+        if (currNode.hasExtentBlock() && !checkRuns(i)) {
+            return false;
+        }
     }
     return true;
 }
 
+/**
+ * @brief checks the runs in the extent block of a file are on the disk and add up to its size,
+ * a file with fewer than two runs would have no extent block
+ * @param index - the index of a file with an extent block
+ * @return bool - true if the runs fit the file
+*/
+bool SuperBlock::checkRuns(uint8_t index) {
+    if (extents[index].size() < 2) {
+        return false;
+    }
+    int blocks = 0;
+    for (BlockRun run : extents[index]) {
+        if (run.length < 1 || run.start < (int)MIN_BLOCK_NUM || run.start + run.length - 1 > (int)MAX_BLOCK_NUM) {
+            return false;
+        }
+        blocks += run.length;
+    }
+    return blocks == inode[index].getUsedSize();
+}
+
 /**
  * @brief checks that all directories have valid attributes
  * @return bool - true if all dirs pass
@@ -272,6 +445,9 @@ void SuperBlock::fixFreeBlockList() {
  * @return int - the index of the node in the array
 */
 int SuperBlock::findFreeNode() {
+    if (stats) {
+        stats->count(STAT_ALLOCATOR_SCANS);
+    }
     for (int i = 0; i < NUM_NODES; i++) {
         if (!inode[i].nodeInUse()) {
             return i;
@@ -284,6 +460,9 @@ int SuperBlock::findFreeNode() {
  * @brief create a map of the directory structure for easier traversal
 */
 void SuperBlock::buildDirectoryMap() {
+    if (stats) {
+        stats->count(STAT_MAP_REBUILDS);
+    }
     directoryStructure.clear();
     for (int i = 0; i < NUM_NODES; i++) {
         uint8_t parent = inode[i].getParent();
@@ -292,6 +471,15 @@ void SuperBlock::buildDirectoryMap() {
         }
         directoryStructure[parent].push_back(i);
     }
+    mapOutOfDate = false;
+}
+
+/**
+ * @brief checks if the directory map is out of date, it only depends on the parent of each node
+ * @return bool - true if a node's parent changed since the map was built
+*/
+bool SuperBlock::directoryMapOutOfDate() {
+    return mapOutOfDate;
 }
 
 /**
@@ -307,7 +495,11 @@ bool SuperBlock::isReservedName(const string &name) {
  * @return bool - true if name is unique
 */
 bool SuperBlock::nameUniqueInDir(const string &name, const uint8_t cwd) {
-    for (auto index : directoryStructure[cwd]) {
+    auto dir = directoryStructure.find(cwd);
+    if (dir == directoryStructure.end()) {
+        return true;
+    }
+    for (auto index : dir->second) {
         if (name.compare(inode[index].getName()) == 0) {
             return false;
         }
@@ -331,6 +523,9 @@ bool SuperBlock::validNewName(const string &name, const uint8_t cwd) {
  * @return int - the index of the first block
 */
 int SuperBlock::findContigBlock(const int size) {
+    if (stats) {
+        stats->count(STAT_ALLOCATOR_SCANS);
+    }
     // check if theres enough free spaces at all
     size_t i = 1;
     while (i < NUM_BLOCKS) {
@@ -355,9 +550,12 @@ int SuperBlock::findContigBlock(const int size) {
  * @return uint8_t - the index of the node in the list
 */
  uint8_t SuperBlock::getInodeIndex(const string &name, const uint8_t cwd) {
-     // get all nodes in the directory
-    vector<uint8_t> inCWD = directoryStructure[cwd];
-    for (auto item : inCWD) {
+     // get all nodes in the directory, without adding it to the map so this is safe to call from several threads
+    auto dir = directoryStructure.find(cwd);
+    if (dir == directoryStructure.end()) {
+        return INVALID_NODE_NUM;
+    }
+    for (auto item : dir->second) {
         Inode node = inode[item];
         if (name == node.getName()) {
             return item;
@@ -373,7 +571,7 @@ int SuperBlock::findContigBlock(const int size) {
 void SuperBlock::deleteNode(const string &name, const uint8_t cwd) {
     uint8_t index = getInodeIndex(name, cwd);
     if (index == INVALID_NODE_NUM) {
-        cerr << "Error: File or directory " << name << " does not exist" << endl;
+        *err << "Error: File or directory " << name << " does not exist" << endl;
         return;
     }
     if (inode[index].isAFile()) {
@@ -385,6 +583,7 @@ void SuperBlock::deleteNode(const string &name, const uint8_t cwd) {
             deleteNode(childNode.getName(), index);
         }
     }
+    mapOutOfDate = mapOutOfDate || inode[index].getParent() != Inode().getParent();
     inode[index] = Inode();
 }
 
@@ -392,13 +591,28 @@ void SuperBlock::deleteNode(const string &name, const uint8_t cwd) {
  * @brief clear free block list of this file
 */
 void SuperBlock::deleteFile(uint8_t index) {
-    Inode n = inode[index];
-    int start = n.getStartBlock();
-    int end = n.getEndIndex();
-    clearBlock(start, end);
+    clearFileBlocks(index);
 }
 
 
+/**
+ * @brief checks if every block from first to last is free, unlike isFreeBlock the first block is checked too
+ * @param first - the first block of the range
+ * @param last - the last block of the range
+ * @return bool - true if all the blocks are free, false if any is used or the range goes off the disk
+*/
+bool SuperBlock::isFreeRange(int first, int last) {
+    if (first < 0 || last >= NUM_BLOCKS) {
+        return false;
+    }
+    for (int i = first; i <= last; i++) {
+        if (free_block_list[i] == 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
 /**
  * @brief checks if range of start-end is a free contiguous section
  * @return bool - true if all  blocks in range are free
@@ -416,6 +630,9 @@ bool SuperBlock::isFreeBlock(int start, int end) {
  * @return int - the index of the new start block
 */
 int SuperBlock::findNewStartBlock(int oldStart) {
+    if (stats) {
+        stats->count(STAT_ALLOCATOR_SCANS);
+    }
     int i = oldStart - 1;
     if (free_block_list[i] == 1) {
         return -1;
@@ -426,6 +643,87 @@ int SuperBlock::findNewStartBlock(int oldStart) {
     return i + 1;
 }
 
+/**
+ * @brief count the data blocks that are not in use
+ * @return int - the number of free blocks
+*/
+int SuperBlock::freeBlockCount() {
+    int count = 0;
+    for (int i = MIN_BLOCK_NUM; i < NUM_BLOCKS; i++) {
+        if (free_block_list[i] == 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief find the length of the longest contiguous section of free blocks
+ * @return int - the number of blocks in the section
+*/
+int SuperBlock::largestFreeRun() {
+    int longest = 0;
+    int run = 0;
+    for (int i = MIN_BLOCK_NUM; i < NUM_BLOCKS; i++) {
+        if (free_block_list[i] == 0) {
+            run++;
+            longest = max(longest, run);
+        } else {
+            run = 0;
+        }
+    }
+    return longest;
+}
+
+/**
+ * @brief measure how scattered the free space is, 0 means all free blocks are in one section
+ * @return int - the percentage of free blocks that are outside of the largest free section
+*/
+int SuperBlock::fragmentationLevel() {
+    int free = freeBlockCount();
+    if (free == 0) {
+        return 0;
+    }
+    return 100 - (largestFreeRun() * 100) / free;
+}
+
+/**
+ * @brief measure how far apart the files of each directory are
+ * a directory scan reads every file in the directory in listing order, and the seek distance
+ * is the number of blocks skipped between the end of one file and the start of the next
+ * @return double - the average seek distance of a scan over all directories that contain files
+*/
+double SuperBlock::averageDirectorySeek() {
+    int totalSeek = 0;
+    int scans = 0;
+    for (auto &entry : directoryStructure) {
+        int seek = 0;
+        int prevEnd = -1;
+        for (auto index : entry.second) {
+            Inode node = inode[index];
+            if (!node.isAFile()) {
+                continue;
+            }
+            // a file with an extent block seeks between its runs too
+            for (BlockRun run : getRuns(index)) {
+                if (prevEnd != -1) {
+                    seek += abs(run.start - (prevEnd + 1));
+                }
+                prevEnd = run.start + run.length - 1;
+            }
+        }
+        // only directories that have files in them are scanned
+        if (prevEnd != -1) {
+            totalSeek += seek;
+            scans++;
+        }
+    }
+    if (scans == 0) {
+        return 0;
+    }
+    return (double)totalSeek / scans;
+}
+
 /////////////////////////////////////////////
 // printing methods for debugging
 ////////////////////////////////////////////
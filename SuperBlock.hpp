@@ -2,9 +2,12 @@
 
 #include "Constants.hpp"
 #include "Inode.hpp"
+#include "Stats.hpp"
 #include <bitset>
 #include <map>
 #include <vector>
+#include <fstream>
+#include <ostream>
 using namespace std;
 
 class SuperBlock {
@@ -13,6 +16,7 @@ class SuperBlock {
         bool checkUniqueNames();                                        // checks that each directory contains elements with unique names
         bool checkFreeNodes();                                          // checks that all free nodes are also clean
         bool checkFileStart();                                          // checks that all files hav valid start positions
+        bool checkRuns(uint8_t index);                                  // checks the runs of a file with an extent block fit it
         bool checkDirectories();                                        // checks that all dirs hav valid attributes
         bool checkNodeParent();                                         // checks that all nodes have valid parents
         bool isReservedName(const string &name);                        // checks that a given name isn't on of the reserved names
@@ -20,13 +24,30 @@ class SuperBlock {
         void deleteFile(uint8_t index);                                 // delete a file in the superblock
         bitset<NUM_BLOCKS> free_block_list;                             // bitset representing free blocks in the file
         Inode inode[NUM_NODES];                                         // an array of all the inodes
+        map<uint8_t, vector<uint8_t>> directoryStructure;               // each dir mapped to its child nodes, not stored on disk
+        bool mapOutOfDate;                                              // if a node's parent changed since the directory map was built
+        ostream *err;                                                   // where errors are printed
+        Stats *stats;                                                   // where map rebuilds and allocator scans are counted, can be null
+        vector<BlockRun> extents[NUM_NODES];                            // the runs of each file with an extent block, read from that block
+        friend struct TestAccess;                                       // lets the tests corrupt the inodes and free list
     public:
         SuperBlock();                                                   // default constructor
+        void readFrom(fstream &disk);                                   // read the super block from the start of a disk
+        void writeTo(fstream &disk);                                    // write the super block to the start of a disk
+        void load(const char block[BLOCK_SIZE]);                        // read the super block from a copy of the first block
+        void store(char block[BLOCK_SIZE]);                             // copy the super block into a block
+        void setErrorStream(ostream &stream);                           // set where errors are printed
+        void setStats(Stats *stats);                                    // set where map rebuilds and allocator scans are counted
         void setNode(Inode node, int index);                
         void setBlock(int start, int end);
         void clearBlock(int start, int end);
         void fixFreeBlockList();                                        // flips the ordering of every 8 bits in the bitset
         
+        void loadExtentBlock(uint8_t index, const char block[BLOCK_SIZE]);  // read the runs of a file from its extent block
+        void storeExtentBlock(uint8_t index, char block[BLOCK_SIZE]);   // copy the runs of a file into an extent block
+        vector<BlockRun> getRuns(uint8_t index);                        // the runs of a file, in file order
+        void setRuns(uint8_t index, const vector<BlockRun> &runs);      // set the runs of a file with an extent block
+        void clearFileBlocks(uint8_t index);                            // free every block of a file, its extent block included
         int checkConsistency();                                         // runs consistency check on the superblock
         int findFreeNode();                                             // returns the index of the first free node
         bool validNewName(const string &name, const uint8_t cwd);       // checks that a given name is valid in the given directory
@@ -35,9 +56,15 @@ class SuperBlock {
         uint8_t getInodeIndex(const string &name, const uint8_t cwd);   // get the index of a node in the inode array given its name
         Inode getNode(uint8_t index);                                   // get a node given its index
         void buildDirectoryMap();                                       // build a map representation of the directory structure
+        bool directoryMapOutOfDate();                                   // checks if building the directory map would change it
         map<uint8_t, vector<uint8_t>> getDirectoryMap();                
         bool isFreeBlock(int start, int end);                           // checks if a section of blocks are all free
+        bool isFreeRange(int first, int last);                          // checks if every block from first to last is free
         int findNewStartBlock(int oldStart);                            // returns the index to a new start block for a file
+        int freeBlockCount();                                           // returns the number of free data blocks
+        int largestFreeRun();                                           // returns the length of the longest run of free blocks
+        int fragmentationLevel();                                       // returns how fragmented the free space is as a percentage
+        double averageDirectorySeek();                                  // returns the average seek distance of reading every file in a directory
 
         void printFBL();
         void printNodes();
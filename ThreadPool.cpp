@@ -0,0 +1,85 @@
+#include "ThreadPool.hpp"
+using namespace std;
+
+/**
+ * @brief constructor
+ * @param numThreads - the number of threads to run tasks on
+*/
+ThreadPool::ThreadPool(size_t numThreads) {
+    for (size_t i = 0; i < max(numThreads, (size_t)1); i++) {
+        workers.push_back(make_unique<Worker>());
+    }
+}
+
+/**
+ * @brief make sure no thread is still running when the pool goes away
+*/
+ThreadPool::~ThreadPool() {
+    wait();
+}
+
+/**
+ * @brief deal the tasks out to the workers and start the threads
+ * all tasks have to be given up front, once a thread finds every queue empty it stops
+ * @param tasks - the tasks to run, they are moved out of the vector
+*/
+void ThreadPool::start(vector<function<void()>> &tasks) {
+    for (size_t i = 0; i < tasks.size(); i++) {
+        workers[i % workers.size()]->tasks.push_back(move(tasks[i]));
+    }
+    tasks.clear();
+    for (size_t i = 0; i < workers.size(); i++) {
+        threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+/**
+ * @brief wait for all the threads to finish their tasks
+*/
+void ThreadPool::wait() {
+    for (auto &t : threads) {
+        t.join();
+    }
+    threads.clear();
+}
+
+/**
+ * @brief run tasks until there are none left anywhere in the pool
+ * @param self - the index of this thread's worker
+*/
+void ThreadPool::workerLoop(size_t self) {
+    function<void()> task;
+    while (takeTask(self, task)) {
+        task();
+    }
+}
+
+/**
+ * @brief take the next task from this thread's own queue, or steal the last one from another queue
+ * tasks are taken from the front so they finish roughly in the order they were given,
+ * and stolen from the back so the two threads don't fight over the same end
+ * @param self - the index of this thread's worker
+ * @param task - set to the task to run
+ * @return bool - false if every queue is empty
+*/
+bool ThreadPool::takeTask(size_t self, function<void()> &task) {
+    {
+        Worker &own = *workers[self];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = move(own.tasks.front());
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < workers.size(); i++) {
+        Worker &victim = *workers[(self + i) % workers.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = move(victim.tasks.back());
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+/**
+ * a fixed set of threads that each have their own queue of tasks,
+ * a thread that runs out of tasks steals from the back of another thread's queue
+*/
+class ThreadPool {
+    private:
+        struct Worker {
+            mutex lock;                                     // guards the task queue
+            deque<function<void()>> tasks;                  // tasks waiting to run on this worker
+        };
+        vector<unique_ptr<Worker>> workers;                 // one queue per thread
+        vector<thread> threads;                             // the running threads
+        bool takeTask(size_t self, function<void()> &task); // get the next task for a thread
+        void workerLoop(size_t self);                       // run tasks until there are none left
+    public:
+        ThreadPool(size_t numThreads);                      // constructor
+        ~ThreadPool();                                      // waits for all tasks to finish
+        void start(vector<function<void()>> &tasks);        // hand out the tasks and start the threads
+        void wait();                                        // wait for all tasks to finish
+};
@@ -0,0 +1,85 @@
+#include "Trace.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+/**
+ * @brief default constructor, tracing starts off
+*/
+Trace::Trace() {
+    fd = -1;
+}
+
+/**
+ * @brief destructor, writes anything still buffered
+*/
+Trace::~Trace() {
+    close();
+}
+
+/**
+ * @brief start a new trace file, an existing file is replaced
+ * @param path - the trace file
+ * @return bool - false if the file can't be created
+*/
+bool Trace::open(const string &path) {
+    close();
+    int newFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (newFd == -1) {
+        return false;
+    }
+    TraceHeader header;
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.blockSize = BLOCK_SIZE;
+    if (::write(newFd, &header, sizeof(header)) != sizeof(header)) {
+        ::close(newFd);
+        return false;
+    }
+    pending.reserve(TRACE_BUFFER_RECORDS);
+    fd = newFd;
+    return true;
+}
+
+/**
+ * @brief add a disk access to the trace
+ * @param op - TRACE_READ, TRACE_WRITE or TRACE_MARK
+ * @param block - the first block accessed
+ * @param blocks - the number of blocks accessed
+ * @param command - the command that made the access
+ * @param line - the line the command came from
+*/
+void Trace::record(char op, int block, int blocks, char command, long line) {
+    lock_guard<mutex> guard(lock);
+    if (fd == -1) {
+        return;
+    }
+    pending.push_back({(uint32_t)line, (uint32_t)block, (uint16_t)blocks, op, command});
+    if (pending.size() >= TRACE_BUFFER_RECORDS) {
+        writePending();
+    }
+}
+
+/**
+ * @brief write the buffered records to the file, a failed write drops them so tracing never stops a command
+*/
+void Trace::writePending() {
+    if (!pending.empty() && ::write(fd, pending.data(), pending.size() * sizeof(TraceRecord)) == -1) {
+        // the records are lost but the file system carries on
+    }
+    pending.clear();
+}
+
+/**
+ * @brief write anything buffered and close the trace file
+*/
+void Trace::close() {
+    lock_guard<mutex> guard(lock);
+    if (fd == -1) {
+        return;
+    }
+    writePending();
+    ::close(fd);
+    fd = -1;
+}
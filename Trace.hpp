@@ -0,0 +1,51 @@
+#pragma once
+
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Constants.hpp"
+using namespace std;
+
+/**
+ * the start of a trace file
+*/
+struct TraceHeader {
+    char magic[8];              // TRACE_MAGIC
+    uint32_t version;           // TRACE_VERSION
+    uint32_t blockSize;         // the bytes in a block, block numbers in the records are in these
+};
+
+/**
+ * one disk access, 12 bytes in the file in the byte order of the machine that wrote it
+*/
+struct TraceRecord {
+    uint32_t line;              // the line of the script or connection the command came from, 0 if none
+    uint32_t block;             // the first block accessed
+    uint16_t blocks;            // the number of blocks accessed
+    char op;                    // TRACE_READ, TRACE_WRITE or TRACE_MARK
+    char command;               // the command that made the access, 0 for background work
+};
+
+static_assert(sizeof(TraceRecord) == 12, "trace records must be 12 bytes");
+
+/**
+ * a binary trace of every disk access a file system makes, records are buffered and written in big chunks
+ * so tracing doesn't add a system call to every access, recording is safe from several threads
+*/
+class Trace {
+    private:
+        int fd;                                         // the trace file, -1 while tracing is off
+        mutex lock;                                     // guards the buffer and the file
+        vector<TraceRecord> pending;                    // records that haven't been written yet
+        void writePending();                            // write the buffered records, called with the lock held
+    public:
+        Trace();                                        // default constructor, tracing starts off
+        ~Trace();                                       // writes anything buffered and closes the file
+        Trace(const Trace&) = delete;
+        Trace &operator=(const Trace&) = delete;
+        bool open(const string &path);                  // start a new trace file, false if it can't be created
+        bool isEnabled() { return fd != -1; }
+        void record(char op, int block, int blocks, char command, long line);  // add a disk access
+        void close();                                   // write anything buffered and stop tracing
+};
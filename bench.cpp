@@ -0,0 +1,390 @@
+#include "FileSystem.hpp"
+#include "Session.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+/**
+ * Microbenchmarks of the super block primitives and the file system calls built on them.
+ * Every benchmark runs on the same disk layouts, one for each fill level and fragmentation pattern,
+ * and the results are printed as json with one result per line in a fixed order so two runs can be diffed.
+*/
+
+const int FILL_LEVELS[] = {0, 25, 50, 75, 95};             // percent of the data blocks used by files
+const char *PATTERNS[] = {"packed", "striped", "random"};   // how the files and the free space are laid out
+const int PACKED_FILE_BLOCKS = 4;                           // size of the files of the packed and striped layouts
+const int RANDOM_MAX_FILE_BLOCKS = 8;                       // largest file of the random layout
+const unsigned RANDOM_SEED = 20240;                         // seed of the random layout, fixed so every run gets the same disk
+const int REPETITIONS = 7;                                  // timed batches per result, the median and best are reported
+const int SINGLE_SHOT_SAMPLES = 21;                         // timed runs of benchmarks that need a fresh disk each time
+const string BENCH_DISK = "bench-disk";                     // the disk the file system benchmarks mount
+
+long sink = 0;                                              // results of the timed calls go here so they aren't optimized out
+long minBatchNanos = 10000000;                              // the shortest a timed batch may be
+string filter;                                              // only run benchmarks whose name contains this
+bool firstResult = true;
+
+/**
+ * a disk layout, the super block is kept without the on disk bit order
+*/
+struct Layout {
+    string pattern;
+    int fill;
+    SuperBlock superBlock;
+    vector<string> names;       // the files in the root directory, in inode order
+};
+
+struct Timing {
+    double median;              // nanoseconds per operation
+    double best;
+};
+
+///////////////////////////////////////////////////
+// Layouts
+///////////////////////////////////////////////////
+
+/**
+ * @brief add a file to a layout
+*/
+void addFile(Layout &layout, int start, int size) {
+    string name = to_string(layout.names.size());
+    name.insert(name.begin(), 'f');
+    layout.superBlock.setNode(Inode(name, size, start, ROOT_DIR), layout.names.size());
+    layout.superBlock.setBlock(start, start + size - 1);
+    layout.names.push_back(name);
+}
+
+/**
+ * @brief split a number of blocks into files no bigger than a size
+ * @return vector<int> - the sizes of the files
+*/
+vector<int> splitFiles(int blocks, int size) {
+    vector<int> sizes;
+    while (blocks > 0) {
+        sizes.push_back(min(blocks, size));
+        blocks -= sizes.back();
+    }
+    return sizes;
+}
+
+/**
+ * @brief build the layout of a pattern at a fill level
+ * packed puts every file at the bottom of the disk with all the free space after them,
+ * striped spreads the free space evenly between the files so no hole is bigger than it has to be,
+ * random shuffles files of random sizes with single free blocks
+ * @param pattern - one of PATTERNS
+ * @param fill - the percent of the data blocks used
+*/
+Layout buildLayout(const string &pattern, int fill) {
+    Layout layout;
+    layout.pattern = pattern;
+    layout.fill = fill;
+    layout.superBlock.setBlock(0, 0);
+    int used = fill * (NUM_BLOCKS - 1) / 100;
+    int free = NUM_BLOCKS - 1 - used;
+    if (pattern == "packed" || pattern == "striped") {
+        vector<int> sizes = splitFiles(used, PACKED_FILE_BLOCKS);
+        int start = 1;
+        for (size_t i = 0; i < sizes.size(); i++) {
+            if (pattern == "striped") {
+                start += free * (i + 1) / sizes.size() - free * i / sizes.size();
+            }
+            addFile(layout, start, sizes[i]);
+            start += sizes[i];
+        }
+    } else {
+        // mt19937 gives the same numbers everywhere, the distributions of the standard library don't
+        mt19937 rng(RANDOM_SEED + fill);
+        vector<int> pieces;
+        int remaining = used;
+        while (remaining > 0) {
+            int size = min(remaining, (int)(rng() % RANDOM_MAX_FILE_BLOCKS) + 1);
+            pieces.push_back(size);
+            remaining -= size;
+        }
+        // free blocks are pieces of size 0
+        pieces.insert(pieces.end(), free, 0);
+        for (size_t i = pieces.size(); i > 1; i--) {
+            swap(pieces[i - 1], pieces[rng() % i]);
+        }
+        int start = 1;
+        for (int size : pieces) {
+            if (size > 0) {
+                addFile(layout, start, size);
+            }
+            start += max(size, 1);
+        }
+    }
+    layout.superBlock.buildDirectoryMap();
+    return layout;
+}
+
+/**
+ * @brief write a layout to the benchmark disk, every data block is filled with its own index
+*/
+void writeDisk(const Layout &layout) {
+    SuperBlock onDisk = layout.superBlock;
+    onDisk.fixFreeBlockList();
+    vector<char> disk(NUM_BLOCKS * BLOCK_SIZE);
+    onDisk.store(disk.data());
+    for (int i = 1; i < NUM_BLOCKS; i++) {
+        memset(disk.data() + i * BLOCK_SIZE, i, BLOCK_SIZE);
+    }
+    ofstream file(BENCH_DISK, ios::binary | ios::trunc);
+    file.write(disk.data(), disk.size());
+}
+
+/**
+ * @brief mount the benchmark disk
+ * a mount leaves the directory map of the previous disk, so it is rebuilt here the way a delete would
+*/
+void mountDisk(FileSystem &fs, Session &session) {
+    if (fs.mount(session, BENCH_DISK) != FS_OK) {
+        cerr << "Error: benchmark disk failed to mount" << endl;
+        exit(1);
+    }
+    fs.superBlock.buildDirectoryMap();
+}
+
+///////////////////////////////////////////////////
+// Timing
+///////////////////////////////////////////////////
+
+/**
+ * @brief time an operation that can be repeated on the same state
+ * the batch size doubles until a batch takes minBatchNanos, then REPETITIONS batches of that size are timed
+ * @return Timing - the median and best nanoseconds per operation
+*/
+Timing measure(const function<void()> &op) {
+    using clock = chrono::steady_clock;
+    long iterations = 1;
+    while (true) {
+        auto start = clock::now();
+        for (long i = 0; i < iterations; i++) {
+            op();
+        }
+        long elapsed = chrono::duration_cast<chrono::nanoseconds>(clock::now() - start).count();
+        if (elapsed >= minBatchNanos) {
+            break;
+        }
+        iterations *= 2;
+    }
+    vector<double> samples;
+    for (int r = 0; r < REPETITIONS; r++) {
+        auto start = clock::now();
+        for (long i = 0; i < iterations; i++) {
+            op();
+        }
+        long elapsed = chrono::duration_cast<chrono::nanoseconds>(clock::now() - start).count();
+        samples.push_back((double)elapsed / iterations);
+    }
+    sort(samples.begin(), samples.end());
+    return {samples[samples.size() / 2], samples[0]};
+}
+
+/**
+ * @brief time an operation that changes its state, setup runs untimed before every run
+ * @return Timing - the median and best nanoseconds of a run
+*/
+Timing measureOnce(const function<void()> &setup, const function<void()> &op) {
+    using clock = chrono::steady_clock;
+    vector<double> samples;
+    for (int r = 0; r < SINGLE_SHOT_SAMPLES; r++) {
+        setup();
+        auto start = clock::now();
+        op();
+        samples.push_back(chrono::duration_cast<chrono::nanoseconds>(clock::now() - start).count());
+    }
+    sort(samples.begin(), samples.end());
+    return {samples[samples.size() / 2], samples[0]};
+}
+
+///////////////////////////////////////////////////
+// Output
+///////////////////////////////////////////////////
+
+/**
+ * @brief print one result as a line of json
+ * @param name - the benchmark
+ * @param layout - the disk it ran on
+ * @param variant - what the benchmark was asked to do on that disk
+ * @param timing - nanoseconds per operation
+ * @param bytes - bytes moved by one operation, 0 if it doesn't move any
+*/
+void report(const string &name, const Layout &layout, const string &variant, Timing timing, long bytes = 0) {
+    SuperBlock superBlock = layout.superBlock;
+    char line[512];
+    int len = snprintf(line, sizeof(line),
+                       "{\"name\":\"%s\",\"pattern\":\"%s\",\"fill\":%d,\"variant\":\"%s\",\"files\":%zu,"
+                       "\"fragmentation\":%d,\"median_ns\":%.1f,\"best_ns\":%.1f",
+                       name.c_str(), layout.pattern.c_str(), layout.fill, variant.c_str(), layout.names.size(),
+                       superBlock.fragmentationLevel(), timing.median, timing.best);
+    if (bytes > 0) {
+        // bytes per nanosecond times 1000 is megabytes per second
+        len += snprintf(line + len, sizeof(line) - len, ",\"mb_per_s\":%.1f", bytes * 1000.0 / timing.median);
+    }
+    cout << (firstResult ? "\n" : ",\n") << line << "}";
+    firstResult = false;
+}
+
+bool selected(const string &name) {
+    return name.find(filter) != string::npos;
+}
+
+///////////////////////////////////////////////////
+// Benchmarks
+///////////////////////////////////////////////////
+
+void benchFindContigBlock(Layout &layout) {
+    for (int size : {1, 16}) {
+        SuperBlock superBlock = layout.superBlock;
+        string variant = "size";
+        variant += to_string(size);
+        report("findContigBlock", layout, variant, measure([&]() {
+            sink += superBlock.findContigBlock(size);
+        }));
+    }
+}
+
+void benchFindFreeNode(Layout &layout) {
+    SuperBlock superBlock = layout.superBlock;
+    report("findFreeNode", layout, "first", measure([&]() {
+        sink += superBlock.findFreeNode();
+    }));
+}
+
+void benchGetInodeIndex(Layout &layout) {
+    SuperBlock superBlock = layout.superBlock;
+    // the last file is found after every other entry of the directory is compared
+    if (!layout.names.empty()) {
+        string last = layout.names.back();
+        report("getInodeIndex", layout, "last", measure([&]() {
+            sink += superBlock.getInodeIndex(last, ROOT_DIR);
+        }));
+    }
+    string missing = "zz";
+    report("getInodeIndex", layout, "missing", measure([&]() {
+        sink += superBlock.getInodeIndex(missing, ROOT_DIR);
+    }));
+}
+
+void benchBuildDirectoryMap(Layout &layout) {
+    SuperBlock superBlock = layout.superBlock;
+    report("buildDirectoryMap", layout, "all", measure([&]() {
+        superBlock.buildDirectoryMap();
+        sink++;
+    }));
+}
+
+void benchCheckConsistency(Layout &layout) {
+    SuperBlock superBlock = layout.superBlock;
+    report("checkConsistency", layout, "all", measure([&]() {
+        sink += superBlock.checkConsistency();
+    }));
+}
+
+void benchDefrag(Layout &layout) {
+    unique_ptr<FileSystem> fs;
+    Session session(cout, cerr);
+    report("fs_defrag", layout, "all", measureOnce([&]() {
+        if (fs) {
+            fs->close();
+        }
+        writeDisk(layout);
+        fs = make_unique<FileSystem>();
+        mountDisk(*fs, session);
+    }, [&]() {
+        sink += fs->defrag(session);
+    }));
+    fs->close();
+}
+
+void benchReadWrite(Layout &layout) {
+    if (layout.names.empty()) {
+        return;
+    }
+    writeDisk(layout);
+    FileSystem fs;
+    Session session(cout, cerr);
+    mountDisk(fs, session);
+    vector<uint8_t> data(NUM_BLOCKS * BLOCK_SIZE);
+    long bytes = 0;
+    vector<int> sizes;
+    for (size_t i = 0; i < layout.names.size(); i++) {
+        sizes.push_back(layout.superBlock.getNode(i).getUsedSize());
+        bytes += sizes.back() * BLOCK_SIZE;
+    }
+    // one operation reads or writes every file of the disk, each with a single call
+    if (selected("read")) {
+        report("read", layout, "whole_files", measure([&]() {
+            for (size_t i = 0; i < layout.names.size(); i++) {
+                sink += fs.read(session, layout.names[i], 0, span<uint8_t>(data.data(), sizes[i] * BLOCK_SIZE));
+            }
+        }), bytes);
+    }
+    if (selected("write")) {
+        report("write", layout, "whole_files", measure([&]() {
+            for (size_t i = 0; i < layout.names.size(); i++) {
+                sink += fs.write(session, layout.names[i], 0, span<const uint8_t>(data.data(), sizes[i] * BLOCK_SIZE));
+            }
+        }), bytes);
+    }
+    fs.close();
+}
+
+/**
+ * @brief usage: benchmark [--filter NAME] [--min-time MS]
+ * --filter only runs the benchmarks whose name contains NAME, --min-time sets the shortest timed batch
+*/
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            minBatchNanos = atol(argv[++i]) * 1000000;
+        } else {
+            cerr << "usage: " << argv[0] << " [--filter NAME] [--min-time MS]" << endl;
+            return 1;
+        }
+    }
+    struct Benchmark {
+        string name;
+        void (*run)(Layout &layout);
+    };
+    vector<Benchmark> benchmarks = {
+        {"findContigBlock", benchFindContigBlock},
+        {"findFreeNode", benchFindFreeNode},
+        {"getInodeIndex", benchGetInodeIndex},
+        {"buildDirectoryMap", benchBuildDirectoryMap},
+        {"checkConsistency", benchCheckConsistency},
+        {"fs_defrag", benchDefrag},
+    };
+    cout << "{\"block_size\":" << BLOCK_SIZE << ",\"num_blocks\":" << NUM_BLOCKS << ",\"results\":[";
+    for (const char *pattern : PATTERNS) {
+        for (int fill : FILL_LEVELS) {
+            Layout layout = buildLayout(pattern, fill);
+            for (Benchmark &benchmark : benchmarks) {
+                if (selected(benchmark.name)) {
+                    benchmark.run(layout);
+                }
+            }
+            if (selected("read") || selected("write")) {
+                benchReadWrite(layout);
+            }
+        }
+    }
+    cout << "\n]}" << endl;
+    remove(BENCH_DISK.c_str());
+    return 0;
+}
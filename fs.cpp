@@ -1,34 +1,139 @@
 #include "FileSystem.hpp"
 #include <iostream>
-#include "CommandParser.hpp"
+#include <cstring>
+#include <memory>
+#include "OutputSink.hpp"
+#include "ScriptRunner.hpp"
+#include "Daemon.hpp"
 using namespace std;
 
+/**
+ * @brief read the integer value that follows an option
+ * @return bool - false if the value is missing or not a number
+*/
+bool readOptionValue(int argc, char* argv[], int &i, int &value) {
+    if (i + 1 >= argc) {
+        return false;
+    }
+    try {
+        value = stoi(argv[++i]);
+    } catch (const exception&) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief read the flush policy named by an option
+ * @return bool - false if the policy isn't valid
+*/
+bool readFlushPolicy(int argc, char* argv[], int &i, FlushPolicy &policy, int &flushBytes) {
+    if (i + 1 >= argc) {
+        return false;
+    }
+    string name(argv[++i]);
+    if (name == "strict") {
+        policy = FLUSH_STRICT;
+    } else if (name == "command") {
+        policy = FLUSH_PER_COMMAND;
+    } else if (name == "exit") {
+        policy = FLUSH_AT_EXIT;
+    } else {
+        policy = FLUSH_BYTES;
+        i--;
+        return readOptionValue(argc, argv, i, flushBytes) && flushBytes > 0;
+    }
+    return true;
+}
+
 int main(int argc, char* argv[]) {
     if (argc < 2) {
         cerr << "No instruction file was provided" << endl;
         return 1;
     }
 
-    string filename(argv[1]);
-    
-    FileSystem fs = FileSystem();
-    CommandParser parser = CommandParser();
-    if (!fs.openInputFile(filename)) {
-        return 1;
+    vector<string> filenames;
+    RunOptions options = RunOptions();
+    string socketPath;
+    for (int i = 1; i < argc; i++) {
+        bool ok = true;
+        if (strcmp(argv[i], "--daemon") == 0 && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (i == 1 || strncmp(argv[i], "--", 2) != 0) {
+            filenames.push_back(argv[i]);
+        } else if (strcmp(argv[i], "--auto-defrag") == 0) {
+            options.autoDefrag = true;
+        } else if (strcmp(argv[i], "--dedup") == 0) {
+            options.dedup = true;
+        } else if (strcmp(argv[i], "--extents") == 0) {
+            options.extents = true;
+        } else if (strcmp(argv[i], "--grow-backward") == 0) {
+            options.growBackward = true;
+        } else if (strcmp(argv[i], "--prealloc") == 0) {
+            ok = readOptionValue(argc, argv, i, options.prealloc) && options.prealloc > 0;
+        } else if (strcmp(argv[i], "--compile") == 0) {
+            options.compile = true;
+        } else if (strcmp(argv[i], "--compile-report") == 0) {
+            options.compile = true;
+            options.compileReport = true;
+        } else if (strcmp(argv[i], "--flush") == 0) {
+            ok = readFlushPolicy(argc, argv, i, options.flushPolicy, options.flushBytes);
+        } else if (strcmp(argv[i], "--locality-defrag") == 0) {
+            options.localityDefrag = true;
+        } else if (strcmp(argv[i], "--defrag-threshold") == 0) {
+            ok = readOptionValue(argc, argv, i, options.defragThreshold);
+        } else if (strcmp(argv[i], "--defrag-step") == 0) {
+            ok = readOptionValue(argc, argv, i, options.defragStep);
+        } else if (strcmp(argv[i], "--defrag-budget") == 0) {
+            ok = readOptionValue(argc, argv, i, options.defragBudget);
+        } else if (strcmp(argv[i], "--jobs") == 0) {
+            ok = readOptionValue(argc, argv, i, options.jobs) && options.jobs > 0;
+        } else if (strcmp(argv[i], "--shared-disk") == 0) {
+            options.sharedDisk = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            options.stats = true;
+        } else if (strcmp(argv[i], "--stats-file") == 0 && i + 1 < argc) {
+            options.stats = true;
+            options.statsFile = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            options.traceFile = argv[++i];
+        } else if (strcmp(argv[i], "--output-dir") == 0 && i + 1 < argc) {
+            options.outputDir = argv[++i];
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            cerr << "Error: invalid option: " << argv[i] << endl;
+            return 1;
+        }
     }
-    queue<string> commandQueue = fs.readCommands();
 
-    int i = 1;
-    while (!commandQueue.empty()) {
-        vector<string> tokens = parser.parse(commandQueue.front());
-        if (parser.validate()) {
-            fs.runCommand(tokens);
-        } else {
-            cerr << "Command Error: " << filename << ", " << i << endl;
+    // serve commands over a socket instead of running scripts
+    if (!socketPath.empty()) {
+        if (!filenames.empty()) {
+            cerr << "Error: scripts can't be run in daemon mode" << endl;
+            return 1;
+        }
+        Daemon daemon(socketPath, options);
+        if (!daemon.listen()) {
+            return 1;
         }
-        i++;
-        commandQueue.pop();
+        daemon.run();
+        return 0;
+    }
+
+    // several scripts, asking for threads or sharing a disk, runs them all in parallel with separate output
+    if (filenames.size() > 1 || options.jobs > 1 || !options.outputDir.empty() || options.sharedDisk) {
+        return runScriptFiles(filenames, options) ? 0 : 1;
+    }
+
+    // strict output leaves cout and cerr alone, so the output is interleaved exactly like it always was
+    unique_ptr<OutputRedirect> output;
+    if (options.flushPolicy != FLUSH_STRICT) {
+        output = make_unique<OutputRedirect>(options.flushPolicy, options.flushBytes);
+    }
+    if (!runScriptFile(filenames[0], options, cout, cerr, output.get())) {
+        return 1;
     }
-    fs.close();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,313 @@
+#include "SuperBlock.hpp"
+#include "Inode.hpp"
+#include "Constants.hpp"
+#include "Compression.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+using namespace std;
+
+/**
+ * Formats disk images without the prebuilt create_fs. The image is made a sparse file with ftruncate and only
+ * the super block is written, plus the blocks of any files in the tree spec that are filled with a character,
+ * so the blocks nothing has written take no space and no time.
+ *
+ * A tree spec has one entry a line, blank lines and lines starting with # are skipped:
+ *     PATH/                a directory
+ *     PATH BLOCKS [CHAR]   a file of BLOCKS blocks, filled with CHAR or left as zeros
+ * Paths are relative to the root and separated by /, directories that aren't listed are made when an entry
+ * needs them. Files are given blocks in the order they are listed, each right after the one before.
+ *
+ * With --compress the disk is made as a compressed image, which the file system reads and writes a block at a
+ * time through its codec.
+*/
+
+/**
+ * the size of the disk to format
+*/
+struct Geometry {
+    long blocks;                    // the blocks on the disk, the super block included
+    long inodes;                    // the inodes in the super block
+    long blockSize;                 // the bytes in a block
+};
+
+/**
+ * @brief check the geometry can be stored, the super block has no fields for it so the file system is built
+ * for one geometry and every disk it mounts has to have it
+ * @return bool - false if it prints an error
+*/
+bool checkGeometry(const Geometry &geometry) {
+    if (geometry.blockSize != (long)BLOCK_SIZE) {
+        cerr << "Error: block size must be " << BLOCK_SIZE << ", the super block has to fit in one block" << endl;
+        return false;
+    }
+    if (geometry.blocks != NUM_BLOCKS) {
+        cerr << "Error: block count must be " << NUM_BLOCKS << ", the free block list has one bit for each of them" << endl;
+        return false;
+    }
+    if (geometry.inodes != NUM_NODES) {
+        cerr << "Error: inode count must be " << NUM_NODES << ", the inodes fill the rest of the super block" << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * builds the super block for a tree spec, keeping the inode of every directory by its path
+*/
+class TreeBuilder {
+    private:
+        SuperBlock &superBlock;
+        map<string, uint8_t> directories;               // the inode of every directory made so far, by path
+        vector<pair<int, string>> filledFiles;          // the first block and contents of files that aren't zeros
+        int nextBlock;                                  // where the next file starts
+        int lineNumber;                                 // the spec line being read, for errors
+        bool addNode(const string &path, int blocks, uint8_t &index);
+        bool directoryFor(const string &path, uint8_t &parent, string &name);
+    public:
+        int files;
+        int dirs;
+        TreeBuilder(SuperBlock &superBlock);
+        bool addLine(const string &line);
+        const vector<pair<int, string>> &filled() { return filledFiles; }
+};
+
+TreeBuilder::TreeBuilder(SuperBlock &superBlock) : superBlock(superBlock) {
+    directories[""] = ROOT_DIR;
+    nextBlock = 1;
+    lineNumber = 0;
+    files = 0;
+    dirs = 0;
+}
+
+/**
+ * @brief find the directory an entry goes in, making any that are missing
+ * @param path - the path of the entry
+ * @param parent - set to the inode of the directory
+ * @param name - set to the last part of the path
+ * @return bool - false if it prints an error
+*/
+bool TreeBuilder::directoryFor(const string &path, uint8_t &parent, string &name) {
+    size_t slash = path.rfind('/');
+    string dirPath = slash == string::npos ? "" : path.substr(0, slash);
+    name = slash == string::npos ? path : path.substr(slash + 1);
+    map<string, uint8_t>::iterator dir = directories.find(dirPath);
+    if (dir != directories.end()) {
+        parent = dir->second;
+        return true;
+    }
+    uint8_t index;
+    if (!addNode(dirPath, 0, index)) {
+        return false;
+    }
+    parent = index;
+    return true;
+}
+
+/**
+ * @brief add a file, or a directory if it has no blocks, to the super block
+ * @param index - set to the inode it was given
+ * @return bool - false if it prints an error
+*/
+bool TreeBuilder::addNode(const string &path, int blocks, uint8_t &index) {
+    uint8_t parent;
+    string name;
+    if (!directoryFor(path, parent, name)) {
+        return false;
+    }
+    if (name.empty() || name.length() > MAX_NAME_LEN) {
+        cerr << "Error: line " << lineNumber << ": invalid name: " << path << endl;
+        return false;
+    }
+    int freeIndex = superBlock.findFreeNode();
+    if (freeIndex == -1) {
+        cerr << "Error: line " << lineNumber << ": out of inodes at " << path << endl;
+        return false;
+    }
+    superBlock.buildDirectoryMap();
+    if (!superBlock.validNewName(name, parent)) {
+        cerr << "Error: line " << lineNumber << ": " << path << " already exists" << endl;
+        return false;
+    }
+    if (blocks > 0 && nextBlock + blocks > NUM_BLOCKS) {
+        cerr << "Error: line " << lineNumber << ": out of blocks at " << path << endl;
+        return false;
+    }
+    superBlock.setNode(Inode(name, blocks, nextBlock, parent), freeIndex);
+    index = freeIndex;
+    if (blocks == 0) {
+        directories[path] = index;
+        dirs++;
+    } else {
+        superBlock.setBlock(nextBlock, nextBlock + blocks - 1);
+        nextBlock += blocks;
+        files++;
+    }
+    return true;
+}
+
+/**
+ * @brief add the entry on one line of a tree spec
+ * @return bool - false if it prints an error
+*/
+bool TreeBuilder::addLine(const string &line) {
+    lineNumber++;
+    istringstream fields(line);
+    string path;
+    if (!(fields >> path) || path[0] == '#') {
+        return true;
+    }
+    uint8_t index;
+    if (path.back() == '/') {
+        path.pop_back();
+        return directories.count(path) != 0 || addNode(path, 0, index);
+    }
+    int blocks = 0;
+    string fill;
+    fields >> blocks >> fill;
+    if (blocks < (int)MIN_BLOCK_NUM || blocks > (int)MAX_BLOCK_NUM || fill.length() > 1) {
+        cerr << "Error: line " << lineNumber << ": expected PATH BLOCKS [CHAR]: " << line << endl;
+        return false;
+    }
+    int start = nextBlock;
+    if (!addNode(path, blocks, index)) {
+        return false;
+    }
+    if (!fill.empty()) {
+        filledFiles.push_back({start, string(blocks * BLOCK_SIZE, fill[0])});
+    }
+    return true;
+}
+
+/**
+ * @brief write a sparse image, the super block and then the filled files
+ * @return bool - false if it prints an error
+*/
+bool writeImage(const string &name, SuperBlock &superBlock, const vector<pair<int, string>> &filled) {
+    int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        cerr << "Error: Cannot write disk: " << name << endl;
+        return false;
+    }
+    char block[BLOCK_SIZE];
+    // the free list is stored with the first block of each byte in its highest bit
+    superBlock.fixFreeBlockList();
+    superBlock.store(block);
+    superBlock.fixFreeBlockList();
+    bool ok = ftruncate(fd, NUM_BLOCKS * BLOCK_SIZE) == 0 && pwrite(fd, block, BLOCK_SIZE, 0) == BLOCK_SIZE;
+    for (size_t i = 0; ok && i < filled.size(); i++) {
+        const string &data = filled[i].second;
+        ok = pwrite(fd, data.data(), data.size(), (off_t)filled[i].first * BLOCK_SIZE) == (ssize_t)data.size();
+    }
+    ok = close(fd) == 0 && ok;
+    if (!ok) {
+        cerr << "Error: Cannot write disk: " << name << endl;
+    }
+    return ok;
+}
+
+/**
+ * @brief write a compressed image, the super block and filled files are the only blocks that aren't zeros
+ * @return bool - false if it prints an error
+*/
+bool writeCompressedImage(const string &name, SuperBlock &superBlock, const vector<pair<int, string>> &filled) {
+    CompressedImage image;
+    if (!CompressedImage::create(name) || !image.open(name)) {
+        cerr << "Error: Cannot write disk: " << name << endl;
+        return false;
+    }
+    char block[BLOCK_SIZE];
+    superBlock.fixFreeBlockList();
+    superBlock.store(block);
+    superBlock.fixFreeBlockList();
+    bool written = image.write(0, reinterpret_cast<uint8_t*>(block)) != -1;
+    for (auto &[start, data] : filled) {
+        for (size_t i = 0; i < data.size(); i += BLOCK_SIZE) {
+            written = image.write(start + i / BLOCK_SIZE, reinterpret_cast<const uint8_t*>(data.data() + i)) != -1 && written;
+        }
+    }
+    image.close();
+    if (!written) {
+        cerr << "Error: Cannot write disk: " << name << endl;
+    }
+    return written;
+}
+
+/**
+ * @brief usage: mkfs DISK [--blocks N] [--inodes N] [--block-size N] [--tree SPEC] [--compress]
+*/
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argv[1][0] == '-') {
+        cerr << "usage: " << argv[0] << " DISK [--blocks N] [--inodes N] [--block-size N] [--tree SPEC] [--compress]" << endl;
+        return 1;
+    }
+    string diskName = argv[1];
+    Geometry geometry = {NUM_BLOCKS, NUM_NODES, (long)BLOCK_SIZE};
+    string treeFile;
+    bool compress = false;
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        bool ok = i + 1 < argc;
+        try {
+            if (arg == "--compress") {
+                compress = ok = true;
+            } else if (!ok) {
+            } else if (arg == "--blocks") {
+                geometry.blocks = stol(argv[++i]);
+            } else if (arg == "--inodes") {
+                geometry.inodes = stol(argv[++i]);
+            } else if (arg == "--block-size") {
+                geometry.blockSize = stol(argv[++i]);
+            } else if (arg == "--tree") {
+                treeFile = argv[++i];
+            } else {
+                ok = false;
+            }
+        } catch (const exception&) {
+            ok = false;
+        }
+        if (!ok) {
+            cerr << "Error: invalid option: " << arg << endl;
+            return 1;
+        }
+    }
+    if (!checkGeometry(geometry)) {
+        return 1;
+    }
+
+    SuperBlock superBlock;
+    superBlock.setBlock(0, 0);
+    TreeBuilder builder(superBlock);
+    if (!treeFile.empty()) {
+        ifstream spec(treeFile);
+        if (!spec.is_open()) {
+            cerr << "Error: Cannot read tree spec: " << treeFile << endl;
+            return 1;
+        }
+        string line;
+        while (getline(spec, line)) {
+            if (!builder.addLine(line)) {
+                return 1;
+            }
+        }
+    }
+    if (superBlock.checkConsistency() != 0) {
+        cerr << "Error: the tree spec doesn't give a consistent super block" << endl;
+        return 1;
+    }
+    bool written = compress ? writeCompressedImage(diskName, superBlock, builder.filled())
+        : writeImage(diskName, superBlock, builder.filled());
+    if (!written) {
+        return 1;
+    }
+    cout << diskName << ": " << geometry.blocks << " blocks of " << geometry.blockSize << " bytes, " << geometry.inodes
+        << " inodes, " << builder.files << " files, " << builder.dirs << " directories, " << superBlock.freeBlockCount()
+        << " blocks free" << endl;
+    return 0;
+}
@@ -1,4 +1,9 @@
 #include "FileSystem.hpp"
+#include "AsyncFileSystem.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
 #include <string>
 #include <sstream>
 #include <iostream>
@@ -10,6 +15,16 @@ stringstream out;
 streambuf *olderr;
 streambuf *oldout;
 
+/**
+ * the private parts of the file system the tests look at or break on purpose
+*/
+struct TestAccess {
+    static Inode *inodes(SuperBlock &superBlock) { return superBlock.inode; }
+    static bitset<NUM_BLOCKS> &freeBlocks(SuperBlock &superBlock) { return superBlock.free_block_list; }
+    static BlockDedup &dedup(FileSystem &fs) { return fs.dedup; }
+    static bool defragStep(FileSystem &fs, int maxBlocks) { return fs.defragStep(maxBlocks); }
+};
+
 
 void setup();
 void resetIO();
@@ -21,10 +36,30 @@ bool testCheckInodes();
 bool testFileStart();
 bool testDirecAtt();
 bool testCheckParents();
+bool testAsync();
+bool testAsyncReadWrite();
+bool testAsyncErrors();
+bool testSnapshot();
+bool testCompressedImage();
+bool testDedup();
+bool testExtents();
+bool testGrowth();
+bool testDefragStep();
+bool testUnwritten();
+bool testReadAhead();
 
 int main() {
     setup();
     if (!testMount()) return 1;
+    if (!testAsync()) return 1;
+    if (!testSnapshot()) return 1;
+    if (!testCompressedImage()) return 1;
+    if (!testDedup()) return 1;
+    if (!testExtents()) return 1;
+    if (!testGrowth()) return 1;
+    if (!testDefragStep()) return 1;
+    if (!testUnwritten()) return 1;
+    if (!testReadAhead()) return 1;
     err.flush();
     resetIO();
     cout << "passed all tests!" << endl;
@@ -89,31 +124,29 @@ bool testMount() {
 bool testBadDiskName() {
     FileSystem fs = FileSystem();
     string name = "dned";
-    fs.fs_mount(name);
-    string error = err.str();
-    string expected = "Error: Cannot find disk: " + name + "\n";
-    return error == expected;
+    Session session(cout, cerr);
+    return fs.mount(session, name) == FS_DISK_NOT_FOUND;
 }
 
 bool testFreeListCheck() {
     FileSystem fs = FileSystem();
-    fs.superBlock.inode[0].setStartBlock(3);
-    fs.superBlock.inode[0].setUsedSize(1);
+    TestAccess::inodes(fs.superBlock)[0].setStartBlock(3);
+    TestAccess::inodes(fs.superBlock)[0].setUsedSize(1);
     int error = fs.superBlock.checkConsistency();
     int expected = 1;
     if (error != expected) return false;
-    fs = FileSystem();
-    fs.superBlock.free_block_list[4] = 1;
+    fs.superBlock = SuperBlock();
+    TestAccess::freeBlocks(fs.superBlock)[4] = 1;
     error = fs.superBlock.checkConsistency();
     return error == expected;
 }
 
 bool testUniqueNames() {
     FileSystem fs = FileSystem();
-    fs.superBlock.inode[0].setParent(127);
-    fs.superBlock.inode[0].setName("c");
-    fs.superBlock.inode[1].setParent(127);
-    fs.superBlock.inode[1].setName("c");
+    TestAccess::inodes(fs.superBlock)[0].setParent(127);
+    TestAccess::inodes(fs.superBlock)[0].setName("c");
+    TestAccess::inodes(fs.superBlock)[1].setParent(127);
+    TestAccess::inodes(fs.superBlock)[1].setName("c");
     int error = fs.superBlock.checkConsistency();
     int expected = 2;
     return error == expected;
@@ -121,25 +154,25 @@ bool testUniqueNames() {
 
 bool testCheckInodes() {
     FileSystem fs = FileSystem();
-    fs.superBlock.inode[0].setStartBlock(3);
+    TestAccess::inodes(fs.superBlock)[0].setStartBlock(3);
     int error = fs.superBlock.checkConsistency();
     int expected = 3;
     if (error != expected) return false;
-    fs = FileSystem();
-    fs.superBlock.free_block_list[1] = 1;
-    fs.superBlock.inode[0].setInUse(true);
-    fs.superBlock.inode[0].setStartBlock(1);
-    fs.superBlock.inode[0].setUsedSize(1);
+    fs.superBlock = SuperBlock();
+    TestAccess::freeBlocks(fs.superBlock)[1] = 1;
+    TestAccess::inodes(fs.superBlock)[0].setInUse(true);
+    TestAccess::inodes(fs.superBlock)[0].setStartBlock(1);
+    TestAccess::inodes(fs.superBlock)[0].setUsedSize(1);
     error = fs.superBlock.checkConsistency();
     return error == expected;
 }
 
 bool testFileStart() {
     FileSystem fs = FileSystem();
-    fs.superBlock.inode[0].setIsFile(true);
-    fs.superBlock.inode[0].setInUse(true);
-    fs.superBlock.inode[0].setName("c");
-    fs.superBlock.inode[0].setStartBlock(129);
+    TestAccess::inodes(fs.superBlock)[0].setIsFile(true);
+    TestAccess::inodes(fs.superBlock)[0].setInUse(true);
+    TestAccess::inodes(fs.superBlock)[0].setName("c");
+    TestAccess::inodes(fs.superBlock)[0].setStartBlock(129);
     int error = fs.superBlock.checkConsistency();
     int expected = 4;
     return error == expected;
@@ -147,10 +180,10 @@ bool testFileStart() {
 
 bool testDirecAtt() {
     FileSystem fs = FileSystem();
-    fs.superBlock.inode[0].setIsFile(false);
-    fs.superBlock.inode[0].setInUse(true);
-    fs.superBlock.inode[0].setName("c");
-    fs.superBlock.inode[0].setUsedSize(1);
+    TestAccess::inodes(fs.superBlock)[0].setIsFile(false);
+    TestAccess::inodes(fs.superBlock)[0].setInUse(true);
+    TestAccess::inodes(fs.superBlock)[0].setName("c");
+    TestAccess::inodes(fs.superBlock)[0].setUsedSize(1);
     int error = fs.superBlock.checkConsistency();
     int expected = 5;
     return error == expected;
@@ -159,22 +192,533 @@ bool testDirecAtt() {
 bool testCheckParents() {
     resetIO();
     FileSystem fs = FileSystem();
-    fs.superBlock.inode[0].setIsFile(false);
-    fs.superBlock.inode[0].setInUse(true);
-    fs.superBlock.inode[0].setName("c");
-    fs.superBlock.inode[0].setParent(126);
+    TestAccess::inodes(fs.superBlock)[0].setIsFile(false);
+    TestAccess::inodes(fs.superBlock)[0].setInUse(true);
+    TestAccess::inodes(fs.superBlock)[0].setName("c");
+    TestAccess::inodes(fs.superBlock)[0].setParent(126);
     int error = fs.superBlock.checkConsistency();
     int expected = 6;
     if (error != expected) return false;
-    fs.superBlock.inode[0].setParent(1);
-    fs.superBlock.inode[1].setInUse(true);
-    fs.superBlock.inode[1].setIsFile(true);
-    fs.superBlock.inode[1].setName("b");
-    fs.superBlock.inode[1].setStartBlock(1);
-    fs.superBlock.inode[1].setUsedSize(1);
-    fs.superBlock.free_block_list[1] = 1;
+    TestAccess::inodes(fs.superBlock)[0].setParent(1);
+    TestAccess::inodes(fs.superBlock)[1].setInUse(true);
+    TestAccess::inodes(fs.superBlock)[1].setIsFile(true);
+    TestAccess::inodes(fs.superBlock)[1].setName("b");
+    TestAccess::inodes(fs.superBlock)[1].setStartBlock(1);
+    TestAccess::inodes(fs.superBlock)[1].setUsedSize(1);
+    TestAccess::freeBlocks(fs.superBlock)[1] = 1;
     error = fs.superBlock.checkConsistency();
     return error == expected;
 }
 
+///////////////////////////////////////////////////
+// Async Tests
+///////////////////////////////////////////////////
+string asyncDiskName = "async-test-disk";
+
+/**
+ * @brief write an empty disk, only the super block is marked as used
+*/
+void makeEmptyDisk(const string &name) {
+    char disk[NUM_BLOCKS * BLOCK_SIZE] = {0};
+    // the free list is stored with the first block in the highest bit
+    disk[0] = (char)0x80;
+    ofstream file(name, ios::binary);
+    file.write(disk, sizeof(disk));
+}
+
+bool testAsync() {
+    bool passed = true;
+    if (!testAsyncReadWrite()) {
+        cout << "Failed async read/write test" << endl;
+        passed = false;
+    } else if (!testAsyncErrors()) {
+        cout << "Failed async error test" << endl;
+        passed = false;
+    }
+    remove(asyncDiskName.c_str());
+    return passed;
+}
+
+/**
+ * @brief write one block of a file and read it back
+*/
+Task writeThenRead(AsyncFileSystem &async, Session &session, const string &name, int block, bool &ok) {
+    uint8_t data[BLOCK_SIZE];
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        data[i] = (uint8_t)(block + i);
+    }
+    FsError error = co_await async.write(session, name, block, data);
+    uint8_t result[BLOCK_SIZE] = {0};
+    FsError readError = co_await async.read(session, name, block, result);
+    ok = error == FS_OK && readError == FS_OK && equal(data, data + BLOCK_SIZE, result);
+}
+
+bool testAsyncReadWrite() {
+    FileSystem fs = FileSystem();
+    Session owner(cout, cerr);
+    makeEmptyDisk(asyncDiskName);
+    if (fs.mount(owner, asyncDiskName) != FS_OK || fs.create(owner, "a", 16) != FS_OK) {
+        return false;
+    }
+    Executor executor;
+    AsyncFileSystem async(fs, executor);
+    // every task has its own session so all of them can be in flight at once
+    vector<unique_ptr<Session>> sessions;
+    bool ok[16];
+    for (int i = 0; i < 16; i++) {
+        sessions.push_back(make_unique<Session>(cout, cerr));
+        executor.spawn(writeThenRead(async, *sessions[i], "a", i, ok[i]));
+    }
+    executor.run();
+    fs.close();
+    return all_of(ok, ok + 16, [](bool passed) { return passed; });
+}
+
+/**
+ * @brief read a block that doesn't exist
+*/
+Task readMissing(AsyncFileSystem &async, Session &session, FsError &noFile, FsError &noBlock) {
+    uint8_t data[BLOCK_SIZE];
+    noFile = co_await async.read(session, "zz", 0, data);
+    noBlock = co_await async.read(session, "a", 16, data);
+}
+
+bool testAsyncErrors() {
+    FileSystem fs = FileSystem();
+    Session session(cout, cerr);
+    makeEmptyDisk(asyncDiskName);
+    if (fs.mount(session, asyncDiskName) != FS_OK || fs.create(session, "a", 16) != FS_OK) {
+        return false;
+    }
+    Executor executor;
+    AsyncFileSystem async(fs, executor);
+    FsError noFile = FS_OK;
+    FsError noBlock = FS_OK;
+    executor.spawn(readMissing(async, session, noFile, noBlock));
+    executor.run();
+    fs.close();
+    return noFile == FS_NOT_FOUND && noBlock == FS_NO_SUCH_BLOCK;
+}
+
+///////////////////////////////////////////////////
+// Snapshot Tests
+///////////////////////////////////////////////////
+string snapshotDiskName = "snapshot-test-disk";
+
+/**
+ * @brief read the whole disk file
+*/
+string readDiskFile(const string &name) {
+    ifstream file(name, ios::binary);
+    return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+bool testSnapshot() {
+    FileSystem fs = FileSystem();
+    Session session(cout, cerr);
+    makeEmptyDisk(snapshotDiskName);
+    vector<uint8_t> first(BLOCK_SIZE, 'x');
+    vector<uint8_t> second(BLOCK_SIZE, 'y');
+    vector<uint8_t> result(BLOCK_SIZE, 0);
+    vector<DirEntry> entries;
+    bool passed = fs.mount(session, snapshotDiskName) == FS_OK && fs.create(session, "a", 2) == FS_OK
+        && fs.write(session, "a", 0, first) == FS_OK && fs.rollback(session) == FS_NO_SNAPSHOT
+        && fs.snapshot(session) == FS_OK;
+    string frozen = readDiskFile(snapshotDiskName);
+    // the disk file doesn't change while it has a snapshot, the writes go to the overlay
+    passed = passed && fs.write(session, "a", 0, second) == FS_OK && fs.create(session, "b", 4) == FS_OK
+        && fs.resize(session, "a", 8) == FS_OK && fs.read(session, "a", 0, result) == FS_OK && result == second
+        && readDiskFile(snapshotDiskName) == frozen;
+    passed = passed && fs.rollback(session) == FS_OK && fs.read(session, "a", 0, result) == FS_OK && result == first
+        && fs.read(session, "a", 2, result) == FS_NO_SUCH_BLOCK && fs.remove(session, "b") == FS_NOT_FOUND;
+    // a mount that fails leaves the snapshots of the mounted disk alone
+    passed = passed && fs.snapshot(session) == FS_OK && fs.write(session, "a", 0, second) == FS_OK
+        && fs.mount(session, "no-such-snapshot-disk") == FS_DISK_NOT_FOUND && fs.rollback(session) == FS_OK
+        && fs.list(session, entries) == FS_OK && fs.read(session, "a", 0, result) == FS_OK && result == first;
+    // closing keeps what was written since the snapshot
+    passed = passed && fs.snapshot(session) == FS_OK && fs.write(session, "a", 1, second) == FS_OK;
+    fs.close();
+    FileSystem reopened = FileSystem();
+    Session check(cout, cerr);
+    // a mount leaves the directory map of the last disk, listing rebuilds it
+    passed = passed && reopened.mount(check, snapshotDiskName) == FS_OK && reopened.list(check, entries) == FS_OK
+        && reopened.read(check, "a", 1, result) == FS_OK && result == second
+        && !ifstream(snapshotDiskName + ".snap").is_open();
+    reopened.close();
+    // a crash leaves the overlay behind and the next mount writes the blocks in it to the disk
+    vector<uint8_t> third(BLOCK_SIZE, 'w');
+    {
+        FileSystem crashed = FileSystem();
+        Session lost(cout, cerr);
+        passed = passed && crashed.mount(lost, snapshotDiskName) == FS_OK && crashed.list(lost, entries) == FS_OK
+            && crashed.snapshot(lost) == FS_OK && crashed.write(lost, "a", 0, third) == FS_OK && ifstream(snapshotDiskName + ".snap").is_open();
+    }
+    FileSystem recovered = FileSystem();
+    Session after(cout, cerr);
+    passed = passed && recovered.mount(after, snapshotDiskName) == FS_OK && recovered.list(after, entries) == FS_OK
+        && recovered.read(after, "a", 0, result) == FS_OK && result == third
+        && !ifstream(snapshotDiskName + ".snap").is_open();
+    recovered.close();
+    remove(snapshotDiskName.c_str());
+    if (!passed) {
+        resetIO();
+        cout << "Failed snapshot test" << endl;
+    }
+    return passed;
+}
+
+///////////////////////////////////////////////////
+// Compressed Image Tests
+///////////////////////////////////////////////////
+string compressedDiskName = "compressed-test-disk";
+
+bool testCompressedImage() {
+    FileSystem fs = FileSystem();
+    Session session(cout, cerr);
+    vector<uint8_t> text(BLOCK_SIZE, 0);
+    vector<uint8_t> noise(BLOCK_SIZE * 2);
+    vector<uint8_t> result(BLOCK_SIZE * 2, 0);
+    string line = "a line of text that repeats ";
+    for (size_t i = 0; i < BLOCK_SIZE / 2; i++) {
+        text[i] = line[i % line.length()];
+    }
+    // a block that doesn't compress is stored as it is
+    for (size_t i = 0; i < noise.size(); i++) {
+        noise[i] = (uint8_t)(i * 2654435761u >> 13);
+    }
+    // the image starts as an empty disk with only the super block block used
+    char superBlock[BLOCK_SIZE] = {0};
+    superBlock[0] = (char)0x80;
+    CompressedImage image;
+    bool passed = CompressedImage::create(compressedDiskName) && image.open(compressedDiskName);
+    long stored = passed ? image.write(0, reinterpret_cast<uint8_t*>(superBlock)) : -1;
+    passed = passed && stored > 0 && stored < (long)BLOCK_SIZE;
+    image.close();
+    passed = passed && fs.mount(session, compressedDiskName) == FS_OK && fs.create(session, "a", 4) == FS_OK
+        && fs.write(session, "a", 0, text) == FS_OK && fs.write(session, "a", 1, noise) == FS_OK;
+    fs.close();
+    FileSystem reopened = FileSystem();
+    Session check(cout, cerr);
+    vector<DirEntry> entries;
+    passed = passed && reopened.mount(check, compressedDiskName) == FS_OK && reopened.list(check, entries) == FS_OK
+        && reopened.read(check, "a", 0, span(result.data(), BLOCK_SIZE)) == FS_OK && equal(text.begin(), text.end(), result.begin())
+        && reopened.read(check, "a", 1, result) == FS_OK && result == noise;
+    reopened.close();
+    // a block that doesn't decompress is an error, not a block of zeros. the file starts at block 1 and its first
+    // block can be in either of the block's slots
+    vector<char> garbage(BLOCK_SIZE / 2, (char)0xFF);
+    {
+        fstream file(compressedDiskName, ios::in | ios::out | ios::binary);
+        file.seekp(2 * BLOCK_SIZE);
+        file.write(garbage.data(), garbage.size());
+        file.seekp((NUM_BLOCKS + 2) * BLOCK_SIZE);
+        file.write(garbage.data(), garbage.size());
+    }
+    FileSystem corrupted = FileSystem();
+    Session broken(cout, cerr);
+    passed = passed && corrupted.mount(broken, compressedDiskName) == FS_OK && corrupted.list(broken, entries) == FS_OK
+        && corrupted.read(broken, "a", 0, span(result.data(), BLOCK_SIZE)) == FS_IO_ERROR
+        && corrupted.read(broken, "a", 1, result) == FS_OK && result == noise;
+    corrupted.close();
+    remove(compressedDiskName.c_str());
+    if (!passed) {
+        resetIO();
+        cout << "Failed compressed image test" << endl;
+    }
+    return passed;
+}
+
+///////////////////////////////////////////////////
+// Dedup Tests
+///////////////////////////////////////////////////
+string dedupDiskName = "dedup-test-disk";
+
+bool testDedup() {
+    FileSystem fs = FileSystem();
+    Session session(cout, cerr);
+    makeEmptyDisk(dedupDiskName);
+    fs.enableDedup();
+    fs.enableStats("");
+    vector<uint8_t> first(BLOCK_SIZE, 'x');
+    vector<uint8_t> second(BLOCK_SIZE, 'y');
+    vector<uint8_t> result(BLOCK_SIZE, 0);
+    // the second and third writes share the block the first one stored
+    bool passed = fs.mount(session, dedupDiskName) == FS_OK && fs.create(session, "a", 2) == FS_OK
+        && fs.create(session, "b", 2) == FS_OK && fs.create(session, "c", 1) == FS_OK
+        && fs.write(session, "a", 0, first) == FS_OK && fs.write(session, "b", 0, first) == FS_OK
+        && fs.write(session, "b", 1, first) == FS_OK;
+    int stored = fs.superBlock.getNode(0).getStartBlock();
+    int copy = fs.superBlock.getNode(1).getStartBlock();
+    passed = passed && fs.getStats().get(STAT_DEDUP_HITS) >= 2 && TestAccess::dedup(fs).slotOf(copy) == stored
+        && TestAccess::dedup(fs).slotOf(copy + 1) == stored;
+    // the shared blocks were never written, the table in the disk file points them at the block that was
+    string disk = readDiskFile(dedupDiskName);
+    passed = passed && disk.compare(copy * BLOCK_SIZE, BLOCK_SIZE, string(BLOCK_SIZE, 0)) == 0
+        && disk.compare(stored * BLOCK_SIZE, BLOCK_SIZE, string(first.begin(), first.end())) == 0;
+    // a crash keeps the sharing since the table is written before a command returns
+    {
+        FileSystem crashed = FileSystem();
+        Session lost(cout, cerr);
+        vector<DirEntry> listed;
+        passed = passed && crashed.mount(lost, dedupDiskName) == FS_OK && crashed.list(lost, listed) == FS_OK
+            && crashed.read(lost, "b", 1, result) == FS_OK && result == first;
+    }
+    // overwriting the block the others share copies it out first, deleting zeros the file without touching the others
+    passed = passed && fs.write(session, "a", 0, second) == FS_OK && fs.getStats().get(STAT_DEDUP_BREAKS) == 1
+        && fs.read(session, "b", 0, result) == FS_OK && result == first && fs.remove(session, "a") == FS_OK
+        && fs.read(session, "b", 1, result) == FS_OK && result == first;
+    // shrinking zeros the block it frees, which breaks its sharing as well
+    passed = passed && fs.write(session, "c", 0, first) == FS_OK && fs.resize(session, "b", 1) == FS_OK
+        && fs.read(session, "c", 0, result) == FS_OK && result == first;
+    fs.close();
+    // the disk keeps its table and is read through it by a file system without dedup
+    FileSystem reopened = FileSystem();
+    Session check(cout, cerr);
+    vector<DirEntry> entries;
+    passed = passed && reopened.mount(check, dedupDiskName) == FS_OK && reopened.list(check, entries) == FS_OK
+        && reopened.read(check, "b", 0, result) == FS_OK && result == first
+        && reopened.read(check, "c", 0, result) == FS_OK && result == first;
+    reopened.close();
+    remove(dedupDiskName.c_str());
+    if (!passed) {
+        resetIO();
+        cout << "Failed dedup test" << endl;
+    }
+    return passed;
+}
+
+///////////////////////////////////////////////////
+// Extent Tests
+///////////////////////////////////////////////////
+string extentDiskName = "extent-test-disk";
+
+bool testExtents() {
+    FileSystem fs = FileSystem();
+    Session session(cout, cerr);
+    makeEmptyDisk(extentDiskName);
+    fs.enableExtents();
+    vector<uint8_t> data(BLOCK_SIZE * 4);
+    vector<uint8_t> result(BLOCK_SIZE * 4, 0);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (uint8_t)(i / BLOCK_SIZE + 'a');
+    }
+    // with b deleted there is one free block after a and the rest after c, so a grows into two runs
+    bool passed = fs.mount(session, extentDiskName) == FS_OK && fs.create(session, "a", 2) == FS_OK
+        && fs.create(session, "b", 1) == FS_OK && fs.create(session, "c", 2) == FS_OK
+        && fs.remove(session, "b") == FS_OK && fs.resize(session, "a", 4) == FS_OK;
+    uint8_t index = fs.superBlock.getInodeIndex("a", ROOT_DIR);
+    vector<BlockRun> runs = fs.superBlock.getRuns(index);
+    passed = passed && fs.superBlock.getNode(index).hasExtentBlock() && runs.size() == 2 && runs[0].start == 1
+        && runs[0].length == 3 && runs[1].length == 1;
+    passed = passed && fs.write(session, "a", 0, data) == FS_OK && fs.read(session, "a", 0, result) == FS_OK && result == data;
+    fs.close();
+    // the runs are read back from the extent block when the disk is mounted
+    FileSystem reopened = FileSystem();
+    Session check(cout, cerr);
+    vector<DirEntry> entries;
+    fill(result.begin(), result.end(), 0);
+    passed = passed && reopened.mount(check, extentDiskName) == FS_OK && reopened.list(check, entries) == FS_OK
+        && reopened.read(check, "a", 0, result) == FS_OK && result == data;
+    // shrinking it back to its first run gives up the extent block
+    passed = passed && reopened.resize(check, "a", 3) == FS_OK && !reopened.superBlock.getNode(index).hasExtentBlock()
+        && reopened.superBlock.getNode(index).getStartBlock() == 1 && reopened.read(check, "a", 2, span(result.data(), BLOCK_SIZE)) == FS_OK
+        && equal(result.begin(), result.begin() + BLOCK_SIZE, data.begin() + 2 * BLOCK_SIZE);
+    reopened.close();
+    remove(extentDiskName.c_str());
+    if (!passed) {
+        resetIO();
+        cout << "Failed extent test" << endl;
+    }
+    return passed;
+}
+
+///////////////////////////////////////////////////
+// Growth Tests
+///////////////////////////////////////////////////
+string growthDiskName = "growth-test-disk";
+
+bool testGrowth() {
+    FileSystem fs = FileSystem();
+    Session session(cout, cerr);
+    makeEmptyDisk(growthDiskName);
+    fs.enableBackwardGrowth();
+    fs.enablePrealloc(4);
+    fs.enableStats("");
+    vector<uint8_t> data(BLOCK_SIZE, 'b');
+    vector<uint8_t> result(BLOCK_SIZE * 2, 1);
+    vector<uint8_t> expected(data);
+    expected.resize(BLOCK_SIZE * 2, 0);
+    // with a deleted the only free block next to b is before it, so b moves back a block
+    bool passed = fs.mount(session, growthDiskName) == FS_OK && fs.create(session, "a", 1) == FS_OK
+        && fs.create(session, "b", 1) == FS_OK && fs.create(session, "c", 1) == FS_OK && fs.write(session, "b", 0, data) == FS_OK
+        && fs.remove(session, "a") == FS_OK && fs.resize(session, "b", 2) == FS_OK;
+    uint8_t index = fs.superBlock.getInodeIndex("b", ROOT_DIR);
+    passed = passed && fs.superBlock.getNode(index).getStartBlock() == 1 && fs.getStats().get(STAT_BACKWARD_GROWS) == 1
+        && fs.read(session, "b", 0, result) == FS_OK && result == expected;
+    // with d deleted e moves back over its own first block, so it is copied to the free blocks after f first
+    vector<uint8_t> both(BLOCK_SIZE * 2, 'e');
+    passed = passed && fs.create(session, "d", 1) == FS_OK && fs.create(session, "e", 2) == FS_OK
+        && fs.create(session, "f", 1) == FS_OK && fs.write(session, "e", 0, both) == FS_OK
+        && fs.remove(session, "d") == FS_OK && fs.resize(session, "e", 3) == FS_OK;
+    index = fs.superBlock.getInodeIndex("e", ROOT_DIR);
+    passed = passed && fs.superBlock.getNode(index).getStartBlock() == 4 && fs.getStats().get(STAT_BACKWARD_GROWS) == 2
+        && fs.getStats().get(STAT_RELOCATIONS) == 1
+        && fs.superBlock.isFreeRange(8, 9) && fs.read(session, "e", 0, result) == FS_OK && result == both
+        && fs.remove(session, "e") == FS_OK && fs.remove(session, "f") == FS_OK;
+    // the second grow reserves blocks after x and the third one takes them
+    passed = passed && fs.create(session, "x", 2) == FS_OK && fs.resize(session, "x", 3) == FS_OK
+        && fs.resize(session, "x", 4) == FS_OK && fs.resize(session, "x", 6) == FS_OK
+        && fs.getStats().get(STAT_PREALLOC_HITS) == 1;
+    // a create that only fits in the blocks reserved after x gets them back
+    int free = fs.superBlock.freeBlockCount();
+    passed = passed && fs.create(session, "y", free + 4) == FS_OK && fs.getStats().get(STAT_PREALLOC_RECLAIMS) == 1;
+    fs.close();
+    // the reserved blocks were never marked used on the disk
+    FileSystem reopened = FileSystem();
+    Session check(cout, cerr);
+    passed = passed && reopened.mount(check, growthDiskName) == FS_OK;
+    reopened.close();
+    remove(growthDiskName.c_str());
+    if (!passed) {
+        resetIO();
+        cout << "Failed growth test" << endl;
+    }
+    return passed;
+}
+
+///////////////////////////////////////////////////
+// Defrag Step Tests
+///////////////////////////////////////////////////
+string defragDiskName = "defrag-test-disk";
+
+bool testDefragStep() {
+    FileSystem fs = FileSystem();
+    Session session(cout, cerr);
+    makeEmptyDisk(defragDiskName);
+    fs.enableStats("");
+    vector<uint8_t> data(BLOCK_SIZE * 3, 'm');
+    vector<uint8_t> result(BLOCK_SIZE * 3, 0);
+    // b moves down over its own blocks, so it is copied to the free blocks after it first
+    bool passed = fs.mount(session, defragDiskName) == FS_OK && fs.create(session, "a", 1) == FS_OK
+        && fs.create(session, "b", 3) == FS_OK && fs.write(session, "b", 0, data) == FS_OK && fs.remove(session, "a") == FS_OK
+        && !TestAccess::defragStep(fs, 8);
+    uint8_t index = fs.superBlock.getInodeIndex("b", ROOT_DIR);
+    passed = passed && fs.superBlock.getNode(index).getStartBlock() == 1 && fs.superBlock.isFreeRange(4, 7)
+        && fs.superBlock.checkConsistency() == 0 && fs.getStats().get(STAT_RELOCATIONS) == 2 && fs.read(session, "b", 0, result) == FS_OK && result == data;
+    // with c filling the rest of the disk there is no free run to copy h to, so it stays where it is
+    passed = passed && fs.remove(session, "b") == FS_OK && fs.create(session, "g", 1) == FS_OK
+        && fs.create(session, "h", 2) == FS_OK && fs.write(session, "h", 0, span(data.data(), BLOCK_SIZE * 2)) == FS_OK
+        && fs.create(session, "c", fs.superBlock.freeBlockCount()) == FS_OK && fs.remove(session, "g") == FS_OK
+        && !TestAccess::defragStep(fs, 8);
+    index = fs.superBlock.getInodeIndex("h", ROOT_DIR);
+    passed = passed && fs.superBlock.getNode(index).getStartBlock() == 2 && fs.superBlock.isFreeRange(1, 1)
+        && fs.superBlock.checkConsistency() == 0;
+    fs.close();
+    FileSystem reopened = FileSystem();
+    Session check(cout, cerr);
+    vector<DirEntry> entries;
+    passed = passed && reopened.mount(check, defragDiskName) == FS_OK && reopened.list(check, entries) == FS_OK
+        && reopened.read(check, "h", 0, span(result.data(), BLOCK_SIZE * 2)) == FS_OK
+        && equal(result.begin(), result.begin() + BLOCK_SIZE * 2, data.begin());
+    reopened.close();
+    remove(defragDiskName.c_str());
+    if (!passed) {
+        resetIO();
+        cout << "Failed defrag step test" << endl;
+    }
+    return passed;
+}
+
+///////////////////////////////////////////////////
+// Unwritten Block Tests
+///////////////////////////////////////////////////
+string unwrittenDiskName = "unwritten-test-disk";
 
+bool testUnwritten() {
+    // a sparse disk like mkfs makes, only the super block is written and the rest is a hole
+    char superBlock[BLOCK_SIZE] = {0};
+    superBlock[0] = (char)0x80;
+    ofstream file(unwrittenDiskName, ios::binary);
+    file.write(superBlock, BLOCK_SIZE);
+    file.close();
+    if (truncate(unwrittenDiskName.c_str(), NUM_BLOCKS * BLOCK_SIZE) != 0) {
+        return false;
+    }
+    FileSystem fs = FileSystem();
+    Session session(cout, cerr);
+    fs.enableStats("");
+    Stats &stats = fs.getStats();
+    vector<uint8_t> data(BLOCK_SIZE, 'u');
+    vector<uint8_t> result(BLOCK_SIZE * 4, 1);
+    vector<uint8_t> expected(BLOCK_SIZE * 4, 0);
+    copy(data.begin(), data.end(), expected.begin() + BLOCK_SIZE);
+    // the disk file's holes are found a page at a time, the file is put past the page the super block is in
+    bool passed = fs.mount(session, unwrittenDiskName) == FS_OK && fs.create(session, "pad", 15) == FS_OK
+        && fs.create(session, "a", 4) == FS_OK && fs.write(session, "a", 1, data) == FS_OK;
+    // only the written block is read, the blocks around it are zeros without touching the disk
+    uint64_t bytesRead = stats.get(STAT_BYTES_READ);
+    passed = passed && fs.read(session, "a", 0, result) == FS_OK && result == expected
+        && stats.get(STAT_BYTES_READ) - bytesRead == BLOCK_SIZE && stats.get(STAT_UNWRITTEN_READS) == 3;
+    // a delete only zeroes the block that was written, and a file made in the same blocks reads nothing
+    passed = passed && fs.remove(session, "a") == FS_OK && stats.get(STAT_ZEROING_SKIPPED) == 3
+        && fs.create(session, "b", 4) == FS_OK;
+    bytesRead = stats.get(STAT_BYTES_READ);
+    passed = passed && fs.read(session, "b", 0, result) == FS_OK && result == vector<uint8_t>(BLOCK_SIZE * 4, 0)
+        && stats.get(STAT_BYTES_READ) == bytesRead;
+    // a shrink zeroes every block it frees, b is in blocks 16 to 19
+    passed = passed && fs.write(session, "b", 1, data) == FS_OK && fs.write(session, "b", 2, data) == FS_OK
+        && fs.resize(session, "b", 1) == FS_OK;
+    fs.close();
+    passed = passed && readDiskFile(unwrittenDiskName).substr(17 * BLOCK_SIZE, 3 * BLOCK_SIZE) == string(3 * BLOCK_SIZE, 0);
+    remove(unwrittenDiskName.c_str());
+    if (!passed) {
+        resetIO();
+        cout << "Failed unwritten block test" << endl;
+    }
+    return passed;
+}
+
+///////////////////////////////////////////////////
+// Read Ahead Tests
+///////////////////////////////////////////////////
+string readAheadDiskName = "readahead-test-disk";
+
+bool testReadAhead() {
+    FileSystem fs = FileSystem();
+    Session session(cout, cerr);
+    makeEmptyDisk(readAheadDiskName);
+    fs.enableStats("");
+    Stats &stats = fs.getStats();
+    vector<uint8_t> data(BLOCK_SIZE * 8);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = 'a' + i / BLOCK_SIZE;
+    }
+    bool passed = fs.mount(session, readAheadDiskName) == FS_OK && fs.create(session, "a", 8) == FS_OK
+        && fs.write(session, "a", 0, data) == FS_OK;
+    // the second read is sequential and reads 2 blocks ahead, the one after them reads the rest of the file
+    vector<uint8_t> block(BLOCK_SIZE);
+    for (int i = 0; i < 8; i++) {
+        passed = passed && fs.read(session, "a", i, block) == FS_OK
+            && equal(block.begin(), block.end(), data.begin() + i * BLOCK_SIZE);
+    }
+    passed = passed && stats.get(STAT_READAHEAD_BLOCKS) == 5 && stats.get(STAT_READAHEAD_HITS) == 5
+        && stats.get(STAT_READAHEAD_MISSES) == 3;
+    // a write drops the blocks read ahead that it changes
+    vector<uint8_t> changed(BLOCK_SIZE, 'z');
+    passed = passed && fs.write(session, "a", 6, changed) == FS_OK && fs.read(session, "a", 6, block) == FS_OK
+        && block == changed && stats.get(STAT_READAHEAD_HITS) == 5;
+    // a read somewhere else turns reading ahead off
+    passed = passed && fs.read(session, "a", 2, block) == FS_OK && fs.read(session, "a", 4, block) == FS_OK
+        && stats.get(STAT_READAHEAD_BLOCKS) == 5;
+    // a session that can't open the disk file gets an error instead of the data it asked for
+    Session other(cout, cerr);
+    remove(readAheadDiskName.c_str());
+    passed = passed && fs.read(other, "a", 0, block) == FS_IO_ERROR;
+    fs.close();
+    remove(readAheadDiskName.c_str());
+    if (!passed) {
+        resetIO();
+        cout << "Failed read ahead test" << endl;
+    }
+    return passed;
+}
@@ -0,0 +1,93 @@
+#include "Trace.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+using namespace std;
+
+/**
+ * Prints a trace written by fs --trace, either every access or a summary of the accesses of each command.
+ * The summary counts the seek distance, how far the disk had to move from the end of one access to the start
+ * of the next, so the seek heavy commands of a run stand out.
+*/
+
+/**
+ * the accesses made by one command of a script
+*/
+struct LineSummary {
+    char command;
+    long accesses;
+    long blocks;
+    long seekDistance;
+};
+
+/**
+ * @brief the name of a command in the output, background work has no command
+*/
+string commandName(char command) {
+    return command == 0 ? string("-") : string(1, command);
+}
+
+/**
+ * @brief usage: tracedump TRACE [--summary]
+*/
+int main(int argc, char *argv[]) {
+    if (argc < 2 || (argc == 3 && strcmp(argv[2], "--summary") != 0) || argc > 3) {
+        cerr << "usage: " << argv[0] << " TRACE [--summary]" << endl;
+        return 1;
+    }
+    bool summary = argc == 3;
+    ifstream in(argv[1], ios::binary);
+    TraceHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) {
+        cerr << "Error: not a trace: " << argv[1] << endl;
+        return 1;
+    }
+    if (header.version != TRACE_VERSION) {
+        cerr << "Error: trace version " << header.version << " isn't supported" << endl;
+        return 1;
+    }
+
+    map<long, LineSummary> lines;
+    long head = 0;
+    long totalAccesses = 0;
+    long totalSeek = 0;
+    long maps = 0;
+    TraceRecord record;
+    if (!summary) {
+        printf("%-8s %-3s %-2s %6s %6s\n", "line", "cmd", "op", "block", "blocks");
+    }
+    while (in.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+        if (record.op == TRACE_MARK) {
+            maps++;
+            if (!summary) {
+                printf("%-8u %-3s -- block map %ld\n", record.line, commandName(record.command).c_str(), maps);
+            }
+            continue;
+        }
+        long seek = labs((long)record.block - head);
+        head = record.block + record.blocks;
+        totalAccesses++;
+        totalSeek += seek;
+        if (!summary) {
+            printf("%-8u %-3s %-2c %6u %6u\n", record.line, commandName(record.command).c_str(), record.op, record.block, record.blocks);
+            continue;
+        }
+        LineSummary &line = lines[record.line];
+        line.command = record.command;
+        line.accesses++;
+        line.blocks += record.blocks;
+        line.seekDistance += seek;
+    }
+    if (summary) {
+        printf("%-8s %-3s %8s %8s %8s\n", "line", "cmd", "accesses", "blocks", "seek");
+        for (auto &[number, line] : lines) {
+            printf("%-8ld %-3s %8ld %8ld %8ld\n", number, commandName(line.command).c_str(), line.accesses, line.blocks, line.seekDistance);
+        }
+    }
+    printf("%ld accesses, %ld blocks of seek distance, %ld block maps, block size %u\n", totalAccesses, totalSeek, maps, header.blockSize);
+    return 0;
+}
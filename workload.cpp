@@ -0,0 +1,575 @@
+#include "FileSystem.hpp"
+#include "ScriptRunner.hpp"
+#include "Session.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+/**
+ * Generates command scripts from a seeded model of a workload and replays scripts against a disk image.
+ * The generator runs every command it picks on a scratch file system first and only writes the ones that
+ * succeed, so a generated script replays without errors on the image it was generated for.
+*/
+
+const string GENERATE_DISK = "workload-gen-disk";   // the scratch disk the generator checks commands on
+const string REPLAY_DISK = "workload-replay-disk";  // the copy of the image a replay runs on
+const char MIX_OPS[] = "CDEWRYOL";                  // the commands the mix can pick
+const size_t NUM_MIX_OPS = sizeof(MIX_OPS) - 1;
+const int MAX_ATTEMPTS_PER_COMMAND = 20;            // picks that may fail in a row before the generator gives up
+
+/**
+ * the model a script is generated from
+*/
+struct WorkloadOptions {
+    unsigned seed;                  // the same seed and options always give the same script
+    long commands;                  // the number of lines to generate
+    int mix[NUM_MIX_OPS];           // the weight of each command in MIX_OPS
+    int depth;                      // how deep directories can be nested
+    int dirPercent;                 // percent of creates that make a directory
+    string sizes;                   // the file size distribution, uniform:MIN:MAX, geometric:MEAN or fixed:N
+    int fill;                       // percent of the data blocks the workload tries to keep in use
+    string disk;                    // the disk the script mounts
+    string image;                   // the image the script will be replayed on, empty for an empty disk
+    string outFile;                 // where the script goes, empty for stdout
+    WorkloadOptions();
+};
+
+WorkloadOptions::WorkloadOptions() {
+    seed = 1;
+    commands = 1000;
+    int defaultMix[NUM_MIX_OPS] = {20, 10, 10, 25, 25, 8, 1, 1};
+    memcpy(mix, defaultMix, sizeof(mix));
+    depth = 2;
+    dirPercent = 10;
+    sizes = "uniform:1:8";
+    fill = 50;
+    disk = "workload-disk";
+}
+
+///////////////////////////////////////////////////
+// Disks
+///////////////////////////////////////////////////
+
+/**
+ * @brief write an empty disk, only the super block is marked as used
+*/
+void makeEmptyDisk(const string &name) {
+    vector<char> disk(NUM_BLOCKS * BLOCK_SIZE, 0);
+    // the free list is stored with the first block in the highest bit
+    disk[0] = (char)LAST_BIT_MASK;
+    ofstream file(name, ios::binary | ios::trunc);
+    file.write(disk.data(), disk.size());
+}
+
+/**
+ * @brief make a scratch disk that starts out like an image, so the image itself is never changed
+ * @param image - the image, empty for an empty disk
+ * @return bool - false if the image can't be read
+*/
+bool makeScratchDisk(const string &scratch, const string &image) {
+    if (image.empty()) {
+        makeEmptyDisk(scratch);
+        return true;
+    }
+    ifstream in(image, ios::binary);
+    if (!in.is_open()) {
+        cerr << "Error: Cannot read image: " << image << endl;
+        return false;
+    }
+    ofstream out(scratch, ios::binary | ios::trunc);
+    out << in.rdbuf();
+    return true;
+}
+
+///////////////////////////////////////////////////
+// Generator
+///////////////////////////////////////////////////
+
+/**
+ * a seeded model of a workload, it keeps a scratch file system in the state the script leaves the disk in
+*/
+class WorkloadGenerator {
+    private:
+        const WorkloadOptions &options;
+        mt19937 rng;                    // mt19937 gives the same numbers everywhere, the distributions of the standard library don't
+        ostream discard;                // the scratch file system's output isn't part of the script
+        FileSystem fs;
+        Session session;
+        ostream &script;
+        set<string> usedNames;          // names that were on the image or were generated, never generated again
+        unsigned long nextName;
+        int depth;                      // how deep the working directory is
+        int targetBlocks;               // the data blocks the workload tries to keep in use
+        int mixTotal;
+        long emitted;
+        char bufferChar;
+        int random(int n) { return rng() % n; }
+        string newName(char prefix);
+        int pickSize();
+        bool pickEntry(bool filesOnly, DirEntry &entry);
+        int usedBlocks() { return NUM_BLOCKS - 1 - fs.superBlock.freeBlockCount(); }
+        void emit(const string &line);
+        bool tryCreate();
+        bool tryDelete();
+        bool tryResize();
+        bool tryWrite();
+        bool tryRead();
+        bool tryChangeDirectory();
+    public:
+        WorkloadGenerator(const WorkloadOptions &options, ostream &script);
+        bool generate();
+};
+
+WorkloadGenerator::WorkloadGenerator(const WorkloadOptions &options, ostream &script)
+    : options(options), rng(options.seed), discard(nullptr), session(discard, discard), script(script) {
+    nextName = 0;
+    depth = 0;
+    targetBlocks = options.fill * (NUM_BLOCKS - 1) / 100;
+    mixTotal = 0;
+    for (size_t i = 0; i < NUM_MIX_OPS; i++) {
+        mixTotal += options.mix[i];
+    }
+    emitted = 0;
+    bufferChar = 0;
+}
+
+/**
+ * @brief a name that isn't on the image and hasn't been generated before, it fits in the 5 characters of an inode
+ * @param prefix - 'f' for a file, 'd' for a directory
+*/
+string WorkloadGenerator::newName(char prefix) {
+    const char *digits = "0123456789abcdefghijklmnopqrstuvwxyz";
+    string name;
+    do {
+        name = string(1, prefix);
+        unsigned long n = nextName++;
+        do {
+            name.insert(name.begin() + 1, digits[n % 36]);
+            n /= 36;
+        } while (n > 0);
+    } while (usedNames.count(name) > 0);
+    usedNames.insert(name);
+    return name;
+}
+
+/**
+ * @brief the size of a new file or a resize, from the size distribution
+*/
+int WorkloadGenerator::pickSize() {
+    int size = 1;
+    int a = 0;
+    int b = 0;
+    if (sscanf(options.sizes.c_str(), "uniform:%d:%d", &a, &b) == 2) {
+        size = a + random(b - a + 1);
+    } else if (sscanf(options.sizes.c_str(), "geometric:%d", &a) == 1) {
+        // count the trials until one with a chance of 1 in a succeeds
+        while (size < (int)MAX_BLOCK_NUM && random(a) != 0) {
+            size++;
+        }
+    } else if (sscanf(options.sizes.c_str(), "fixed:%d", &a) == 1) {
+        size = a;
+    }
+    return max(1, min(size, (int)MAX_BLOCK_NUM));
+}
+
+/**
+ * @brief pick an entry of the working directory
+ * @param filesOnly - if directories can't be picked
+ * @return bool - false if there is nothing to pick
+*/
+bool WorkloadGenerator::pickEntry(bool filesOnly, DirEntry &entry) {
+    vector<DirEntry> entries;
+    fs.list(session, entries);
+    vector<DirEntry> candidates;
+    for (DirEntry &e : entries) {
+        if (e.name != CUR_DIR_STRING && e.name != PARENT_DIR_STRING && (!filesOnly || !e.isDirectory)) {
+            candidates.push_back(e);
+        }
+    }
+    if (candidates.empty()) {
+        return false;
+    }
+    entry = candidates[random(candidates.size())];
+    return true;
+}
+
+void WorkloadGenerator::emit(const string &line) {
+    script << line << '\n';
+    emitted++;
+}
+
+/**
+ * @brief create a file or a directory, if the file would go over the target fill something is deleted instead
+*/
+bool WorkloadGenerator::tryCreate() {
+    if (depth < options.depth && random(100) < options.dirPercent) {
+        string name = newName('d');
+        if (fs.create(session, name, 0) != FS_OK) {
+            return false;
+        }
+        emit("C " + name + " 0");
+        return true;
+    }
+    int size = pickSize();
+    if (usedBlocks() + size > targetBlocks) {
+        return tryDelete();
+    }
+    string name = newName('f');
+    if (fs.create(session, name, size) != FS_OK) {
+        return false;
+    }
+    emit("C " + name + " " + to_string(size));
+    return true;
+}
+
+bool WorkloadGenerator::tryDelete() {
+    DirEntry entry;
+    if (!pickEntry(false, entry) || fs.remove(session, entry.name) != FS_OK) {
+        return false;
+    }
+    emit("D " + entry.name);
+    return true;
+}
+
+/**
+ * @brief resize a file, growing it is turned into shrinking it if it would go over the target fill
+*/
+bool WorkloadGenerator::tryResize() {
+    DirEntry entry;
+    if (!pickEntry(true, entry)) {
+        return tryCreate();
+    }
+    int size = pickSize();
+    if (size > entry.size && usedBlocks() + size - entry.size > targetBlocks) {
+        if (entry.size == 1) {
+            return false;
+        }
+        size = 1 + random(entry.size - 1);
+    }
+    if (size == entry.size || fs.resize(session, entry.name, size) != FS_OK) {
+        return false;
+    }
+    emit("E " + entry.name + " " + to_string(size));
+    return true;
+}
+
+/**
+ * @brief write a block of a file, the buffer is sometimes loaded with a new character first
+*/
+bool WorkloadGenerator::tryWrite() {
+    DirEntry entry;
+    if (!pickEntry(true, entry)) {
+        return tryCreate();
+    }
+    int block = random(entry.size);
+    uint8_t data[BLOCK_SIZE] = {0};
+    if (fs.write(session, entry.name, block, data) != FS_OK) {
+        return false;
+    }
+    // the buffer isn't reloaded when that would go past the number of lines asked for
+    bool reload = bufferChar == 0 || random(4) == 0;
+    if (reload && (bufferChar == 0 || emitted + 2 <= options.commands)) {
+        bufferChar = 'a' + random(26);
+        emit(string("B ") + bufferChar);
+    }
+    emit("W " + entry.name + " " + to_string(block));
+    return true;
+}
+
+bool WorkloadGenerator::tryRead() {
+    DirEntry entry;
+    if (!pickEntry(true, entry)) {
+        return tryCreate();
+    }
+    int block = random(entry.size);
+    uint8_t data[BLOCK_SIZE];
+    if (fs.read(session, entry.name, block, data) != FS_OK) {
+        return false;
+    }
+    emit("R " + entry.name + " " + to_string(block));
+    return true;
+}
+
+/**
+ * @brief go into a directory of the working directory or back up to the parent
+*/
+bool WorkloadGenerator::tryChangeDirectory() {
+    vector<DirEntry> entries;
+    fs.list(session, entries);
+    vector<string> targets;
+    for (DirEntry &e : entries) {
+        if (e.isDirectory && e.name != CUR_DIR_STRING && (e.name != PARENT_DIR_STRING || depth > 0)) {
+            targets.push_back(e.name);
+        }
+    }
+    if (targets.empty()) {
+        return false;
+    }
+    string name = targets[random(targets.size())];
+    if (fs.changeDirectory(session, name) != FS_OK) {
+        return false;
+    }
+    depth += name == PARENT_DIR_STRING ? -1 : 1;
+    emit("Y " + name);
+    return true;
+}
+
+/**
+ * @brief write the script
+ * @return bool - false if the image can't be mounted or the model keeps picking commands that fail
+*/
+bool WorkloadGenerator::generate() {
+    if (!makeScratchDisk(GENERATE_DISK, options.image)) {
+        return false;
+    }
+    if (fs.mount(session, GENERATE_DISK) != FS_OK) {
+        cerr << "Error: Cannot mount image: " << options.image << endl;
+        return false;
+    }
+    for (int i = 0; i < NUM_NODES; i++) {
+        Inode node = fs.superBlock.getNode(i);
+        if (node.nodeInUse()) {
+            usedNames.insert(node.getName());
+        }
+    }
+    emit("M " + options.disk);
+    // a mount can leave the directory map of the disk mounted before it, listing rebuilds it,
+    // so the script lists the root too and sees the same files the model does
+    vector<DirEntry> entries;
+    fs.list(session, entries);
+    emit("L");
+    int failures = 0;
+    while (emitted < options.commands) {
+        int pick = random(mixTotal);
+        size_t op = 0;
+        while (pick >= options.mix[op]) {
+            pick -= options.mix[op];
+            op++;
+        }
+        bool ok = false;
+        switch (MIX_OPS[op]) {
+            case CREATE:
+                ok = tryCreate();
+                break;
+            case DELETE:
+                ok = tryDelete();
+                break;
+            case RESIZE:
+                ok = tryResize();
+                break;
+            case WRITE:
+                ok = tryWrite();
+                break;
+            case READ:
+                ok = tryRead();
+                break;
+            case CD:
+                ok = tryChangeDirectory();
+                break;
+            case DEFRAG:
+                ok = fs.defrag(session) == FS_OK;
+                if (ok) {
+                    emit("O");
+                }
+                break;
+            case LS:
+                emit("L");
+                ok = true;
+                break;
+        }
+        failures = ok ? 0 : failures + 1;
+        if (failures > MAX_ATTEMPTS_PER_COMMAND * (int)NUM_MIX_OPS) {
+            cerr << "Error: the workload model can't make progress after " << emitted << " commands" << endl;
+            return false;
+        }
+    }
+    fs.close();
+    remove(GENERATE_DISK.c_str());
+    return true;
+}
+
+/**
+ * @brief read a mix like C:20,D:10,R:50, commands that aren't named get a weight of 0
+*/
+bool parseMix(const string &text, int mix[NUM_MIX_OPS]) {
+    fill(mix, mix + NUM_MIX_OPS, 0);
+    stringstream ss(text);
+    string item;
+    int total = 0;
+    while (getline(ss, item, ',')) {
+        const char *op = item.size() > 2 && item[1] == ':' ? strchr(MIX_OPS, item[0]) : nullptr;
+        if (op == nullptr || *op == 0) {
+            return false;
+        }
+        try {
+            mix[op - MIX_OPS] = stoi(item.substr(2));
+        } catch (const exception&) {
+            return false;
+        }
+        if (mix[op - MIX_OPS] < 0) {
+            return false;
+        }
+        total += mix[op - MIX_OPS];
+    }
+    return total > 0;
+}
+
+bool validSizes(const string &sizes) {
+    int a = 0;
+    int b = 0;
+    return (sscanf(sizes.c_str(), "uniform:%d:%d", &a, &b) == 2 && a >= 1 && b >= a)
+        || (sscanf(sizes.c_str(), "geometric:%d", &a) == 1 && a >= 1)
+        || (sscanf(sizes.c_str(), "fixed:%d", &a) == 1 && a >= 1);
+}
+
+int generateMain(int argc, char *argv[]) {
+    WorkloadOptions options;
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        bool ok = i + 1 < argc;
+        try {
+            if (!ok) {
+            } else if (arg == "--seed") {
+                options.seed = stoul(argv[++i]);
+            } else if (arg == "--commands") {
+                options.commands = stol(argv[++i]);
+            } else if (arg == "--mix") {
+                ok = parseMix(argv[++i], options.mix);
+            } else if (arg == "--depth") {
+                options.depth = stoi(argv[++i]);
+            } else if (arg == "--dir-percent") {
+                options.dirPercent = stoi(argv[++i]);
+            } else if (arg == "--sizes") {
+                options.sizes = argv[++i];
+                ok = validSizes(options.sizes);
+            } else if (arg == "--fill") {
+                options.fill = stoi(argv[++i]);
+                ok = options.fill >= 0 && options.fill <= 100;
+            } else if (arg == "--disk") {
+                options.disk = argv[++i];
+            } else if (arg == "--image") {
+                options.image = argv[++i];
+            } else if (arg == "-o") {
+                options.outFile = argv[++i];
+            } else {
+                ok = false;
+            }
+        } catch (const exception&) {
+            ok = false;
+        }
+        if (!ok) {
+            cerr << "Error: invalid option: " << arg << endl;
+            return 1;
+        }
+    }
+    ofstream file;
+    if (!options.outFile.empty()) {
+        file.open(options.outFile, ios::out | ios::trunc);
+        if (!file.is_open()) {
+            cerr << "Error: Cannot write script: " << options.outFile << endl;
+            return 1;
+        }
+    }
+    WorkloadGenerator generator(options, options.outFile.empty() ? cout : file);
+    return generator.generate() ? 0 : 1;
+}
+
+///////////////////////////////////////////////////
+// Replayer
+///////////////////////////////////////////////////
+
+/**
+ * @brief run a script against a copy of an image and print its throughput and per command latencies as json
+ * every mount in the script mounts the copy, output is thrown away and error messages are only counted
+*/
+int replayMain(int argc, char *argv[]) {
+    if (argc < 3) {
+        cerr << "Error: no script to replay" << endl;
+        return 1;
+    }
+    string scriptName = argv[2];
+    string image;
+    bool compile = false;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+            image = argv[++i];
+        } else if (strcmp(argv[i], "--compile") == 0) {
+            compile = true;
+        } else {
+            cerr << "Error: invalid option: " << argv[i] << endl;
+            return 1;
+        }
+    }
+    ifstream in(scriptName);
+    if (!in.is_open()) {
+        cerr << "Error: input file does not exist: " << scriptName << endl;
+        return 1;
+    }
+    // the whole script is read first so reading it isn't timed
+    string script;
+    string line;
+    long commands = 0;
+    while (getline(in, line)) {
+        if (line.size() > 2 && line[0] == MOUNT && line[1] == ' ') {
+            line = string("M ") + REPLAY_DISK;
+        }
+        script += line;
+        script += '\n';
+        commands++;
+    }
+    if (!makeScratchDisk(REPLAY_DISK, image)) {
+        return 1;
+    }
+    FileSystem fs;
+    fs.enableStats("");
+    ostream discard(nullptr);
+    stringstream errors;
+    Session session(discard, errors);
+    istringstream input(script);
+
+    auto start = chrono::steady_clock::now();
+    if (compile) {
+        runCompiledScript(fs, session, input, scriptName, nullptr, false);
+    } else {
+        runScript(fs, session, input, scriptName, nullptr);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    fs.close();
+    remove(REPLAY_DISK.c_str());
+
+    // the super block's warnings about the free list aren't errors of a command
+    long errorCount = 0;
+    while (getline(errors, line)) {
+        errorCount += line.find("Error") != string::npos;
+    }
+    string stats = fs.getStats().toJson();
+    stats.pop_back();
+    printf("{\"script\":\"%s\",\"commands\":%ld,\"errors\":%ld,\"seconds\":%.6f,\"commands_per_s\":%.1f,\"stats\":%s}\n",
+           scriptName.c_str(), commands, errorCount, seconds, commands / seconds, stats.c_str());
+    return 0;
+}
+
+/**
+ * @brief usage:
+ * workload generate [--seed N] [--commands N] [--mix C:20,D:10,...] [--depth N] [--dir-percent P]
+ *                   [--sizes uniform:MIN:MAX|geometric:MEAN|fixed:N] [--fill P] [--disk NAME] [--image PATH] [-o FILE]
+ * workload replay SCRIPT [--image PATH] [--compile]
+*/
+int main(int argc, char *argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "generate") == 0) {
+        return generateMain(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "replay") == 0) {
+        return replayMain(argc, argv);
+    }
+    cerr << "usage: " << argv[0] << " generate [options] | replay SCRIPT [--image PATH] [--compile]" << endl;
+    return 1;
+}